@@ -0,0 +1,464 @@
+// arrow_writer.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arrow_writer.h"
+
+// Values from the Arrow format's flatbuffers schemas
+#define ARROW_METADATA_V5 4
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_BOOL 6
+#define ARROW_PRECISION_DOUBLE 2
+#define ARROW_FB_MAX_FIELDS 8
+
+// Minimal flatbuffers builder. The buffer is built back to front, children before their
+// parents, as the format's unsigned offsets only point forward; an object is referred to by
+// the size of the buffer when it was finished (its distance from the end).
+typedef struct FbBuilder
+{
+    unsigned char *buf; // The data is the last size bytes
+    size_t cap, size;
+    size_t table_start;                    // size when the open table was started
+    size_t fields[ARROW_FB_MAX_FIELDS];    // Reference of each field of the open table (0: absent)
+    int num_fields;
+} FbBuilder;
+
+typedef struct ArrowBlock
+{
+    uint64_t offset;
+    uint32_t metadata_len;
+    uint64_t body_len;
+} ArrowBlock;
+
+typedef struct ArrowFile
+{
+    uint64_t offset; // Bytes written so far
+    ArrowBlock *blocks;
+    size_t num_blocks, blocks_cap;
+} ArrowFile;
+
+static void *safe_arrow_realloc(void *ptr, size_t size)
+{
+    void *grown = realloc(ptr, size);
+    if (!grown)
+    {
+        perror("Error: arrow_writer realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+static void fb_prepend(FbBuilder *fb, const void *data, size_t n)
+{
+    if (fb->cap - fb->size < n)
+    {
+        size_t cap = fb->cap ? fb->cap : 1024;
+        while (cap - fb->size < n)
+            cap *= 2;
+        unsigned char *grown = (unsigned char *)safe_arrow_realloc(NULL, cap);
+        if (fb->size > 0)
+            memcpy(grown + cap - fb->size, fb->buf + fb->cap - fb->size, fb->size);
+        free(fb->buf);
+        fb->buf = grown;
+        fb->cap = cap;
+    }
+    fb->size += n;
+    if (data)
+        memcpy(fb->buf + fb->cap - fb->size, data, n);
+    else
+        memset(fb->buf + fb->cap - fb->size, 0, n);
+}
+
+// Pads so that align divides the size once extra more bytes are prepended
+static void fb_prep(FbBuilder *fb, size_t align, size_t extra)
+{
+    size_t pad = (align - (fb->size + extra) % align) % align;
+    if (pad)
+        fb_prepend(fb, NULL, pad);
+}
+
+static void fb_scalar(FbBuilder *fb, uint64_t v, size_t n)
+{
+    unsigned char le[8];
+    for (size_t i = 0; i < n; ++i)
+        le[i] = (unsigned char)(v >> (8 * i));
+    fb_prep(fb, n, 0);
+    fb_prepend(fb, le, n);
+}
+
+static void fb_uoffset(FbBuilder *fb, size_t ref)
+{
+    fb_prep(fb, 4, 0);
+    fb_scalar(fb, (uint32_t)(fb->size + 4 - ref), 4);
+}
+
+static size_t fb_string(FbBuilder *fb, const char *s)
+{
+    size_t len = strlen(s);
+    fb_prep(fb, 4, len + 1);
+    fb_prepend(fb, NULL, 1); // Terminating NUL
+    fb_prepend(fb, s, len);
+    fb_scalar(fb, len, 4);
+    return fb->size;
+}
+
+static void fb_start_vector(FbBuilder *fb, size_t elem_size, size_t n, size_t align)
+{
+    fb_prep(fb, 4, elem_size * n);
+    fb_prep(fb, align, elem_size * n);
+}
+
+static size_t fb_end_vector(FbBuilder *fb, size_t n)
+{
+    fb_scalar(fb, n, 4);
+    return fb->size;
+}
+
+static size_t fb_offset_vector(FbBuilder *fb, const size_t *refs, size_t n)
+{
+    fb_start_vector(fb, 4, n, 4);
+    for (size_t i = n; i-- > 0;)
+        fb_uoffset(fb, refs[i]);
+    return fb_end_vector(fb, n);
+}
+
+static void fb_start_table(FbBuilder *fb)
+{
+    fb->table_start = fb->size;
+    fb->num_fields = 0;
+    memset(fb->fields, 0, sizeof(fb->fields));
+}
+
+static void fb_field_scalar(FbBuilder *fb, int id, uint64_t v, size_t n)
+{
+    fb_scalar(fb, v, n);
+    fb->fields[id] = fb->size;
+    if (id >= fb->num_fields)
+        fb->num_fields = id + 1;
+}
+
+static void fb_field_offset(FbBuilder *fb, int id, size_t ref)
+{
+    fb_uoffset(fb, ref);
+    fb->fields[id] = fb->size;
+    if (id >= fb->num_fields)
+        fb->num_fields = id + 1;
+}
+
+static size_t fb_end_table(FbBuilder *fb)
+{
+    fb_scalar(fb, 0, 4); // The vtable offset, set below
+    size_t table = fb->size;
+    for (int id = fb->num_fields; id-- > 0;)
+        fb_scalar(fb, fb->fields[id] ? table - fb->fields[id] : 0, 2);
+    fb_scalar(fb, table - fb->table_start, 2);
+    fb_scalar(fb, 4 + 2 * (size_t)fb->num_fields, 2);
+    uint32_t soffset = (uint32_t)(fb->size - table); // The vtable comes right before the table
+    unsigned char *at = fb->buf + fb->cap - table;
+    for (int i = 0; i < 4; ++i)
+        at[i] = (unsigned char)(soffset >> (8 * i));
+    return table;
+}
+
+static void fb_finish(FbBuilder *fb, size_t root)
+{
+    fb_prep(fb, 8, 4);
+    fb_uoffset(fb, root);
+}
+
+static const unsigned char *fb_data(const FbBuilder *fb)
+{
+    return fb->buf + fb->cap - fb->size;
+}
+
+// Schema table: one nullable field per column
+static size_t build_schema(FbBuilder *fb, const RowBatch *b)
+{
+    size_t *fields = (size_t *)safe_arrow_realloc(NULL, (b->num_columns ? b->num_columns : 1) * sizeof(size_t));
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        const BatchColumn *col = &b->columns[c];
+        size_t name = fb_string(fb, col->name);
+        int type_type;
+        fb_start_table(fb);
+        switch (col->type)
+        {
+        case COLUMN_INT:
+            type_type = ARROW_TYPE_INT;
+            fb_field_scalar(fb, 0, 64, 4); // bitWidth
+            fb_field_scalar(fb, 1, 1, 1);  // is_signed
+            break;
+        case COLUMN_FLOAT:
+            type_type = ARROW_TYPE_FLOATING_POINT;
+            fb_field_scalar(fb, 0, ARROW_PRECISION_DOUBLE, 2);
+            break;
+        case COLUMN_BOOL:
+            type_type = ARROW_TYPE_BOOL;
+            break;
+        default:
+            type_type = ARROW_TYPE_UTF8;
+            break;
+        }
+        size_t type = fb_end_table(fb);
+        size_t children = fb_offset_vector(fb, NULL, 0);
+        fb_start_table(fb);
+        fb_field_offset(fb, 0, name);
+        fb_field_scalar(fb, 1, 1, 1); // nullable
+        fb_field_scalar(fb, 2, (uint64_t)type_type, 1);
+        fb_field_offset(fb, 3, type);
+        fb_field_offset(fb, 5, children);
+        fields[c] = fb_end_table(fb);
+    }
+    size_t field_vector = fb_offset_vector(fb, fields, (size_t)b->num_columns);
+    free(fields);
+    fb_start_table(fb);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    fb_field_scalar(fb, 0, 1, 2); // Buffers are written in host order
+#endif
+    fb_field_offset(fb, 1, field_vector);
+    return fb_end_table(fb);
+}
+
+// Message table around a finished header
+static void finish_message(FbBuilder *fb, int header_type, size_t header, uint64_t body_len)
+{
+    fb_start_table(fb);
+    fb_field_scalar(fb, 3, body_len, 8);
+    fb_field_offset(fb, 2, header);
+    fb_field_scalar(fb, 0, ARROW_METADATA_V5, 2);
+    fb_field_scalar(fb, 1, (uint64_t)header_type, 1);
+    fb_finish(fb, fb_end_table(fb));
+}
+
+static void put_bytes(ArrowFile *a, CsvWriter *w, const void *data, size_t n)
+{
+    csv_writer_write(w, (const char *)data, n);
+    a->offset += n;
+}
+
+static void put_padding(ArrowFile *a, CsvWriter *w)
+{
+    static const char zeros[8] = {0};
+    put_bytes(a, w, zeros, (8 - a->offset % 8) % 8);
+}
+
+// Encapsulated message: continuation marker, metadata length, metadata padded to 8 bytes.
+// Returns the bytes written.
+static uint32_t put_message(ArrowFile *a, CsvWriter *w, const FbBuilder *fb)
+{
+    uint32_t padded = (uint32_t)((fb->size + 7) / 8 * 8);
+    uint32_t prefix[2] = {0xFFFFFFFFu, padded};
+    put_bytes(a, w, prefix, sizeof(prefix));
+    put_bytes(a, w, fb_data(fb), fb->size);
+    put_padding(a, w);
+    return (uint32_t)sizeof(prefix) + padded;
+}
+
+static ArrowFile *start_file(RowBatch *b)
+{
+    if (b->encoder)
+        return (ArrowFile *)b->encoder;
+    ArrowFile *a = (ArrowFile *)safe_arrow_realloc(NULL, sizeof(ArrowFile));
+    memset(a, 0, sizeof(*a));
+    b->encoder = a;
+    static const char magic[8] = ARROW_MAGIC;
+    put_bytes(a, b->out, magic, sizeof(magic));
+    FbBuilder fb = {0};
+    finish_message(&fb, ARROW_HEADER_SCHEMA, build_schema(&fb, b), 0);
+    put_message(a, b->out, &fb);
+    free(fb.buf);
+    return a;
+}
+
+static size_t bitmap_len(size_t n)
+{
+    return (n + 7) / 8;
+}
+
+static size_t padded_len(size_t n)
+{
+    return (n + 7) / 8 * 8;
+}
+
+// Validity (or bool value) bitmap, least significant bit first, padded to 8 bytes
+static void put_bitmap(ArrowFile *a, CsvWriter *w, const BatchColumn *col, size_t n, int values)
+{
+    unsigned char byte = 0;
+    for (size_t r = 0; r < n; ++r)
+    {
+        int bit = col->kinds[r] != COLUMN_NULL && (!values || col->values[r].b);
+        byte |= (unsigned char)(bit << (r % 8));
+        if (r % 8 == 7 || r == n - 1)
+        {
+            put_bytes(a, w, &byte, 1);
+            byte = 0;
+        }
+    }
+    put_padding(a, w);
+}
+
+void arrow_write_batch(RowBatch *b)
+{
+    ArrowFile *a = start_file(b);
+    CsvWriter *w = b->out;
+    size_t n = b->num_rows;
+    int num_buffers = 0;
+    for (int c = 0; c < b->num_columns; ++c)
+        num_buffers += b->columns[c].type == COLUMN_TEXT ? 3 : 2;
+
+    // Buffer layout of the body: validity, then values (offsets and data for text)
+    uint64_t (*buffers)[2] = (uint64_t(*)[2])safe_arrow_realloc(NULL, (num_buffers ? num_buffers : 1) * sizeof(*buffers));
+    uint64_t (*nodes)[2] = (uint64_t(*)[2])safe_arrow_realloc(NULL, (b->num_columns ? b->num_columns : 1) * sizeof(*nodes));
+    uint64_t body_len = 0;
+    int k = 0;
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        const BatchColumn *col = &b->columns[c];
+        size_t nulls = 0;
+        for (size_t r = 0; r < n; ++r)
+            nulls += col->kinds[r] == COLUMN_NULL;
+        nodes[c][0] = n;
+        nodes[c][1] = nulls;
+        size_t validity = nulls ? bitmap_len(n) : 0; // Left out when every value is there
+        buffers[k][0] = body_len;
+        buffers[k++][1] = validity;
+        body_len += padded_len(validity);
+        size_t values = col->type == COLUMN_BOOL ? bitmap_len(n) : col->type == COLUMN_TEXT ? (n + 1) * 4 : n * 8;
+        buffers[k][0] = body_len;
+        buffers[k++][1] = values;
+        body_len += padded_len(values);
+        if (col->type == COLUMN_TEXT)
+        {
+            size_t data = 0;
+            for (size_t r = 0; r < n; ++r)
+                data += col->kinds[r] == COLUMN_NULL ? 0 : col->values[r].s.len;
+            buffers[k][0] = body_len;
+            buffers[k++][1] = data;
+            body_len += padded_len(data);
+        }
+    }
+
+    FbBuilder fb = {0};
+    fb_start_vector(&fb, 16, (size_t)num_buffers, 8);
+    for (int i = num_buffers; i-- > 0;)
+    {
+        fb_scalar(&fb, buffers[i][1], 8);
+        fb_scalar(&fb, buffers[i][0], 8);
+    }
+    size_t buffer_vector = fb_end_vector(&fb, (size_t)num_buffers);
+    fb_start_vector(&fb, 16, (size_t)b->num_columns, 8);
+    for (int c = b->num_columns; c-- > 0;)
+    {
+        fb_scalar(&fb, nodes[c][1], 8);
+        fb_scalar(&fb, nodes[c][0], 8);
+    }
+    size_t node_vector = fb_end_vector(&fb, (size_t)b->num_columns);
+    fb_start_table(&fb);
+    fb_field_scalar(&fb, 0, n, 8);
+    fb_field_offset(&fb, 1, node_vector);
+    fb_field_offset(&fb, 2, buffer_vector);
+    finish_message(&fb, ARROW_HEADER_RECORD_BATCH, fb_end_table(&fb), body_len);
+    free(buffers);
+    free(nodes);
+
+    if (a->num_blocks == a->blocks_cap)
+    {
+        a->blocks_cap = a->blocks_cap ? a->blocks_cap * 2 : 16;
+        a->blocks = (ArrowBlock *)safe_arrow_realloc(a->blocks, a->blocks_cap * sizeof(ArrowBlock));
+    }
+    ArrowBlock *block = &a->blocks[a->num_blocks++];
+    block->offset = a->offset;
+    block->metadata_len = put_message(a, w, &fb);
+    block->body_len = body_len;
+    free(fb.buf);
+
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        const BatchColumn *col = &b->columns[c];
+        size_t r;
+        for (r = 0; r < n && col->kinds[r] != COLUMN_NULL; ++r)
+            ;
+        if (r < n)
+            put_bitmap(a, w, col, n, 0);
+        switch (col->type)
+        {
+        case COLUMN_BOOL:
+            put_bitmap(a, w, col, n, 1);
+            break;
+        case COLUMN_INT:
+        case COLUMN_FLOAT:
+            for (r = 0; r < n; ++r)
+            { // A null's slot is zeroed
+                RowValue v = col->values[r];
+                if (col->kinds[r] == COLUMN_NULL)
+                    v.i = 0;
+                put_bytes(a, w, col->type == COLUMN_INT ? (const void *)&v.i : (const void *)&v.d, 8);
+            }
+            break;
+        default:
+        {
+            int32_t offset = 0;
+            put_bytes(a, w, &offset, 4);
+            for (r = 0; r < n; ++r)
+            {
+                if (col->kinds[r] != COLUMN_NULL)
+                    offset += (int32_t)col->values[r].s.len;
+                put_bytes(a, w, &offset, 4);
+            }
+            put_padding(a, w);
+            for (r = 0; r < n; ++r)
+            {
+                if (col->kinds[r] != COLUMN_NULL)
+                    put_bytes(a, w, row_batch_text(b, &col->values[r]), col->values[r].s.len);
+            }
+            break;
+        }
+        }
+        put_padding(a, w);
+    }
+}
+
+void arrow_finish(RowBatch *b)
+{
+    int empty = !b->encoder;
+    ArrowFile *a = start_file(b);
+    CsvWriter *w = b->out;
+    uint32_t end_of_stream[2] = {0xFFFFFFFFu, 0};
+    put_bytes(a, w, end_of_stream, sizeof(end_of_stream));
+
+    FbBuilder fb = {0};
+    size_t schema = build_schema(&fb, b);
+    fb_start_vector(&fb, 24, a->num_blocks, 8);
+    for (size_t i = a->num_blocks; i-- > 0;)
+    { // struct Block { offset: long; metaDataLength: int; (4 bytes padding) bodyLength: long; }
+        fb_scalar(&fb, a->blocks[i].body_len, 8);
+        fb_scalar(&fb, 0, 4);
+        fb_scalar(&fb, a->blocks[i].metadata_len, 4);
+        fb_scalar(&fb, a->blocks[i].offset, 8);
+    }
+    size_t batch_vector = fb_end_vector(&fb, a->num_blocks);
+    fb_start_vector(&fb, 24, 0, 8);
+    size_t dictionary_vector = fb_end_vector(&fb, 0);
+    fb_start_table(&fb);
+    fb_field_offset(&fb, 1, schema);
+    fb_field_offset(&fb, 2, dictionary_vector);
+    fb_field_offset(&fb, 3, batch_vector);
+    fb_field_scalar(&fb, 0, ARROW_METADATA_V5, 2);
+    fb_finish(&fb, fb_end_table(&fb));
+    put_bytes(a, w, fb_data(&fb), fb.size);
+    uint32_t footer_len = (uint32_t)fb.size;
+    put_bytes(a, w, &footer_len, 4);
+    put_bytes(a, w, ARROW_MAGIC, 6);
+    free(fb.buf);
+    if (empty)
+        csv_writer_end_header(w); // No rows: --skip-empty-tables leaves the file out
+    free(a->blocks);
+    free(a);
+    b->encoder = NULL;
+}
@@ -0,0 +1,20 @@
+// arrow_writer.h
+#ifndef ARROW_WRITER_H
+#define ARROW_WRITER_H
+
+#include "row_batch.h"
+
+// Arrow IPC file output (--format arrow), written without the Arrow libraries.
+//
+// Each table becomes <name>.arrow: the "ARROW1" magic, the schema message, one record batch
+// message per row batch, the end-of-stream marker and the footer that indexes the batches. The
+// bytes between the magic and the footer are also a valid Arrow IPC stream. Columns are
+// nullable int64, float64, bool or utf8 with validity bitmaps; the flatbuffers metadata is
+// built by hand (Schema.fbs, Message.fbs and File.fbs of the Arrow format, metadata version 5).
+
+#define ARROW_MAGIC "ARROW1"
+
+void arrow_write_batch(RowBatch *b); // Writes b's rows (types fixed) as one record batch
+void arrow_finish(RowBatch *b);      // Writes the end of the file and frees b->encoder
+
+#endif // ARROW_WRITER_H
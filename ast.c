@@ -5,6 +5,7 @@
 #include <string.h>
 #include <math.h> // For NAN, INFINITY if handling those for numbers
 #include "ast.h"
+#include "intern.h" // For --intern
 
 // Helper for malloc with error checking
 static void *safe_malloc(size_t size)
@@ -18,6 +19,65 @@ static void *safe_malloc(size_t size)
     return ptr;
 }
 
+// --- Node recycling (--release-early) ---
+// Freed nodes are kept on per-type free lists and handed out again by the ast_create_* and
+// append functions, so subtrees released during conversion feed the ones parsed after them.
+// Only enabled on the converting thread once parsing is done (the lists are not locked).
+
+typedef struct FreeNode
+{
+    struct FreeNode *next;
+} FreeNode;
+
+static int G_recycle_nodes = 0;
+static FreeNode *G_free_values = NULL;      // JsonValue
+static FreeNode *G_free_value_nodes = NULL; // ValueNode
+static FreeNode *G_free_pair_nodes = NULL;  // PairNode
+
+static void *node_alloc(FreeNode **list, size_t size)
+{
+    if (*list)
+    {
+        FreeNode *node = *list;
+        *list = node->next;
+        return node;
+    }
+    return safe_malloc(size);
+}
+
+static void node_free(FreeNode **list, void *ptr)
+{
+    if (!G_recycle_nodes)
+    {
+        free(ptr);
+        return;
+    }
+    FreeNode *node = (FreeNode *)ptr;
+    node->next = *list;
+    *list = node;
+}
+
+static void drain_free_list(FreeNode **list)
+{
+    while (*list)
+    {
+        FreeNode *next = (*list)->next;
+        free(*list);
+        *list = next;
+    }
+}
+
+void ast_set_node_recycling(int enabled)
+{
+    G_recycle_nodes = enabled;
+    if (!enabled)
+    {
+        drain_free_list(&G_free_values);
+        drain_free_list(&G_free_value_nodes);
+        drain_free_list(&G_free_pair_nodes);
+    }
+}
+
 // Helper for strdup with error checking
 static char *safe_strdup(const char *s)
 {
@@ -34,59 +94,119 @@ static char *safe_strdup(const char *s)
 
 JsonValue *ast_create_null()
 {
-    JsonValue *val = (JsonValue *)safe_malloc(sizeof(JsonValue));
+    JsonValue *val = (JsonValue *)node_alloc(&G_free_values, sizeof(JsonValue));
     val->type = JSON_NULL_TYPE;
     return val;
 }
 
 JsonValue *ast_create_boolean(int b_val)
 {
-    JsonValue *val = (JsonValue *)safe_malloc(sizeof(JsonValue));
+    JsonValue *val = (JsonValue *)node_alloc(&G_free_values, sizeof(JsonValue));
     val->type = JSON_BOOLEAN_TYPE;
     val->data.bool_val = b_val;
     return val;
 }
 
+JsonValue *ast_create_number(double n_val)
+{
+    JsonValue *val = (JsonValue *)node_alloc(&G_free_values, sizeof(JsonValue));
+    val->type = JSON_NUMBER_TYPE;
+    val->data.num_val = n_val;
+    return val;
+}
+
 JsonValue *ast_create_number_from_string(const char *s_val)
 {
-    JsonValue *val = (JsonValue *)safe_malloc(sizeof(JsonValue));
+    JsonValue *val = (JsonValue *)node_alloc(&G_free_values, sizeof(JsonValue));
     val->type = JSON_NUMBER_TYPE;
     val->data.num_val = atof(s_val); // Handles int, float, scientific
     return val;
 }
 
+static int G_intern_strings = 0; // Set before parsing starts, read by every parser thread
+
+void ast_set_string_interning(int enabled)
+{
+    G_intern_strings = enabled;
+    if (!enabled)
+        intern_clear();
+}
+
 JsonValue *ast_create_string(char *str_val)
 { // Assumes str_val is already heap-allocated and unescaped
-    JsonValue *val = (JsonValue *)safe_malloc(sizeof(JsonValue));
+    JsonValue *val = (JsonValue *)node_alloc(&G_free_values, sizeof(JsonValue));
+    val->type = JSON_STRING_TYPE;
+    val->inline_len = 0;
+    val->string_id = 0;
+    size_t len;
+    if (G_intern_strings && str_val)
+    {
+        val->data.string_val = (char *)intern_string(str_val, &val->string_id); // Shared, never freed by the node
+    }
+    else if (str_val && (len = strlen(str_val)) <= AST_INLINE_STRING_MAX)
+    {
+        memcpy(val->data.inline_str, str_val, len + 1);
+        val->inline_len = (unsigned char)(len + 1);
+        free(str_val);
+    }
+    else
+    {
+        val->data.string_val = str_val; // Takes ownership
+    }
+    return val;
+}
+
+JsonValue *ast_create_string_from_lexeme(const char *lexeme, int length_with_quotes)
+{
+    // unescape_json_string_into needs length_with_quotes bytes (the text plus one for the NUL)
+    if (G_intern_strings || length_with_quotes < 2 || (size_t)length_with_quotes > AST_INLINE_STRING_MAX + 1)
+        return ast_create_string(unescape_json_string(lexeme, length_with_quotes));
+
+    JsonValue *val = (JsonValue *)node_alloc(&G_free_values, sizeof(JsonValue));
     val->type = JSON_STRING_TYPE;
-    val->data.string_val = str_val; // Takes ownership
+    val->string_id = 0;
+    int len = unescape_json_string_into(val->data.inline_str, lexeme, length_with_quotes);
+    val->inline_len = (unsigned char)(len + 1);
     return val;
 }
 
 JsonValue *ast_create_array()
 {
-    JsonValue *val = (JsonValue *)safe_malloc(sizeof(JsonValue));
+    JsonValue *val = (JsonValue *)node_alloc(&G_free_values, sizeof(JsonValue));
     val->type = JSON_ARRAY_TYPE;
     val->data.array_val.head = NULL;
+    val->data.array_val.tail = NULL;
     val->data.array_val.num_elements = 0;
     return val;
 }
 
 JsonValue *ast_create_object()
 {
-    JsonValue *val = (JsonValue *)safe_malloc(sizeof(JsonValue));
+    JsonValue *val = (JsonValue *)node_alloc(&G_free_values, sizeof(JsonValue));
     val->type = JSON_OBJECT_TYPE;
     val->data.object_val.head = NULL;
+    val->data.object_val.tail = NULL;
     val->data.object_val.num_members = 0;
     return val;
 }
 
+JsonValue *ast_create_lazy(const struct JsonIndex *index, size_t begin, JsonValueType container_type)
+{
+    JsonValue *val = (JsonValue *)node_alloc(&G_free_values, sizeof(JsonValue));
+    val->type = JSON_LAZY_TYPE;
+    val->data.lazy_val = (JsonLazy *)safe_malloc(sizeof(JsonLazy));
+    val->data.lazy_val->index = index;
+    val->data.lazy_val->begin = begin;
+    val->data.lazy_val->container_type = container_type;
+    return val;
+}
+
 void ast_array_append(JsonValue *array_val, JsonValue *element_val)
 {
     if (!array_val || array_val->type != JSON_ARRAY_TYPE)
         return;
 
-    ValueNode *new_node = (ValueNode *)safe_malloc(sizeof(ValueNode));
+    ValueNode *new_node = (ValueNode *)node_alloc(&G_free_value_nodes, sizeof(ValueNode));
     new_node->value = element_val;
     new_node->next = NULL;
 
@@ -96,23 +216,41 @@ void ast_array_append(JsonValue *array_val, JsonValue *element_val)
     }
     else
     {
-        ValueNode *current = array_val->data.array_val.head;
-        while (current->next)
-        {
-            current = current->next;
-        }
-        current->next = new_node;
+        array_val->data.array_val.tail->next = new_node;
     }
+    array_val->data.array_val.tail = new_node;
     array_val->data.array_val.num_elements++;
 }
 
+void ast_array_splice(JsonValue *dst_array, JsonValue *src_array)
+{
+    if (!dst_array || dst_array->type != JSON_ARRAY_TYPE || !src_array || src_array->type != JSON_ARRAY_TYPE ||
+        !src_array->data.array_val.head)
+        return;
+
+    if (!dst_array->data.array_val.head)
+        dst_array->data.array_val.head = src_array->data.array_val.head;
+    else
+        dst_array->data.array_val.tail->next = src_array->data.array_val.head;
+    dst_array->data.array_val.tail = src_array->data.array_val.tail;
+    dst_array->data.array_val.num_elements += src_array->data.array_val.num_elements;
+
+    src_array->data.array_val.head = NULL;
+    src_array->data.array_val.tail = NULL;
+    src_array->data.array_val.num_elements = 0;
+}
+
 void ast_object_add_member(JsonValue *object_val, char *key, JsonValue *member_val)
 { // key is from lexer, unescaped
     if (!object_val || object_val->type != JSON_OBJECT_TYPE)
         return;
 
-    PairNode *new_node = (PairNode *)safe_malloc(sizeof(PairNode));
-    new_node->data.key = key; // Takes ownership of unescaped key
+    PairNode *new_node = (PairNode *)node_alloc(&G_free_pair_nodes, sizeof(PairNode));
+    unsigned int key_id;
+    if (G_intern_strings && key)
+        new_node->data.key = (char *)intern_string(key, &key_id); // Shared while interning is on
+    else
+        new_node->data.key = key; // Takes ownership of unescaped key
     new_node->data.value = member_val;
     new_node->next = NULL;
 
@@ -122,58 +260,132 @@ void ast_object_add_member(JsonValue *object_val, char *key, JsonValue *member_v
     }
     else
     {
-        PairNode *current = object_val->data.object_val.head;
-        while (current->next)
+        object_val->data.object_val.tail->next = new_node;
+    }
+    object_val->data.object_val.tail = new_node;
+    object_val->data.object_val.num_members++;
+}
+
+// Frame of the explicit work stack used by the tree walks below (one per open container)
+typedef struct AstWalkFrame
+{
+    const JsonValue *container;
+    ValueNode *element; // Next element (arrays)
+    PairNode *member;   // Next member (objects)
+    int index;          // Index of the next element (printing)
+    int indent_level;   // Indentation of the container (printing)
+} AstWalkFrame;
+
+typedef struct AstWalkStack
+{
+    AstWalkFrame *frames;
+    size_t depth, cap;
+} AstWalkStack;
+
+static AstWalkFrame *walk_push(AstWalkStack *st, const JsonValue *container, int indent_level)
+{
+    if (st->depth == st->cap)
+    {
+        st->cap = st->cap ? st->cap * 2 : 32;
+        AstWalkFrame *grown = (AstWalkFrame *)realloc(st->frames, st->cap * sizeof(AstWalkFrame));
+        if (!grown)
         {
-            current = current->next;
+            perror("Error: realloc failed");
+            exit(EXIT_FAILURE);
         }
-        current->next = new_node;
+        st->frames = grown;
     }
-    object_val->data.object_val.num_members++;
+    AstWalkFrame *f = &st->frames[st->depth++];
+    f->container = container;
+    f->element = container->type == JSON_ARRAY_TYPE ? container->data.array_val.head : NULL;
+    f->member = container->type == JSON_OBJECT_TYPE ? container->data.object_val.head : NULL;
+    f->index = 0;
+    f->indent_level = indent_level;
+    return f;
+}
+
+// Frees a node that has no children left to visit
+static void free_node_shallow(JsonValue *val)
+{
+    if (val->type == JSON_STRING_TYPE && !val->string_id && !val->inline_len)
+        free(val->data.string_val);
+    else if (val->type == JSON_LAZY_TYPE)
+        free(val->data.lazy_val); // The input span belongs to the index
+    node_free(&G_free_values, val);
 }
 
 void ast_free_value(JsonValue *val)
 {
     if (!val)
         return;
-
-    switch (val->type)
+    if (val->type != JSON_ARRAY_TYPE && val->type != JSON_OBJECT_TYPE)
     {
-    case JSON_STRING_TYPE:
-        free(val->data.string_val);
-        break;
-    case JSON_ARRAY_TYPE:
+        free_node_shallow(val);
+        return;
+    }
+
+    // Depth-first with an explicit stack: each frame frees its list nodes as it walks them,
+    // and the container itself once the list is exhausted
+    AstWalkStack st = {NULL, 0, 0};
+    walk_push(&st, val, 0);
+    while (st.depth > 0)
     {
-        ValueNode *current_element = val->data.array_val.head;
-        while (current_element)
+        AstWalkFrame *top = &st.frames[st.depth - 1];
+        JsonValue *child;
+        if (top->element)
         {
-            ValueNode *next_element = current_element->next;
-            ast_free_value(current_element->value);
-            free(current_element);
-            current_element = next_element;
+            ValueNode *node = top->element;
+            top->element = node->next;
+            child = node->value;
+            node_free(&G_free_value_nodes, node);
         }
-        break;
-    }
-    case JSON_OBJECT_TYPE:
-    {
-        PairNode *current_member = val->data.object_val.head;
-        while (current_member)
+        else if (top->member)
         {
-            PairNode *next_member = current_member->next;
-            free(current_member->data.key);
-            ast_free_value(current_member->data.value);
-            free(current_member);
-            current_member = next_member;
+            PairNode *node = top->member;
+            top->member = node->next;
+            child = node->data.value;
+            if (!G_intern_strings)
+                free(node->data.key);
+            node_free(&G_free_pair_nodes, node);
         }
-        break;
-    }
-    case JSON_NULL_TYPE:
-    case JSON_BOOLEAN_TYPE:
-    case JSON_NUMBER_TYPE:
-        // No heap-allocated data within the union itself
-        break;
+        else
+        {
+            node_free(&G_free_values, (JsonValue *)top->container);
+            st.depth--;
+            continue;
+        }
+        if (!child)
+            continue;
+        if (child->type == JSON_ARRAY_TYPE || child->type == JSON_OBJECT_TYPE)
+            walk_push(&st, child, 0);
+        else
+            free_node_shallow(child);
     }
-    free(val);
+    free(st.frames);
+}
+
+void ast_release_children(JsonValue *container)
+{
+    if (!container || (container->type != JSON_ARRAY_TYPE && container->type != JSON_OBJECT_TYPE))
+        return;
+    // Move the lists to a temporary container so the walk above frees them
+    JsonValue *detached = container->type == JSON_ARRAY_TYPE ? ast_create_array() : ast_create_object();
+    detached->data = container->data;
+    ast_free_value(detached);
+    memset(&container->data, 0, sizeof(container->data));
+}
+
+void ast_make_lazy(JsonValue *val, const struct JsonIndex *index, size_t begin)
+{
+    if (!val || (val->type != JSON_ARRAY_TYPE && val->type != JSON_OBJECT_TYPE))
+        return;
+    JsonValueType container_type = val->type;
+    ast_release_children(val);
+    val->type = JSON_LAZY_TYPE;
+    val->data.lazy_val = (JsonLazy *)safe_malloc(sizeof(JsonLazy));
+    val->data.lazy_val->index = index;
+    val->data.lazy_val->begin = begin;
+    val->data.lazy_val->container_type = container_type;
 }
 
 static void print_indent(int level)
@@ -182,13 +394,14 @@ static void print_indent(int level)
         printf("  ");
 }
 
-void ast_print_value(const JsonValue *val, int indent_level)
+// Prints one node's own line. Returns 1 if it is a non-empty container whose children follow.
+static int print_node_line(const JsonValue *val, int indent_level)
 {
     if (!val)
     {
         print_indent(indent_level);
         printf("(null_ast_node)\n");
-        return;
+        return 0;
     }
 
     print_indent(indent_level);
@@ -204,59 +417,84 @@ void ast_print_value(const JsonValue *val, int indent_level)
         printf("NUMBER: %g\n", val->data.num_val); // %g for general float format
         break;
     case JSON_STRING_TYPE:
-        printf("STRING: \"%s\"\n", val->data.string_val);
+        printf("STRING: \"%s\"\n", ast_string_value(val));
         break;
     case JSON_ARRAY_TYPE:
         printf("ARRAY (%d elements):\n", val->data.array_val.num_elements);
-        ValueNode *current_element = val->data.array_val.head;
-        int i = 0;
-        while (current_element)
-        {
-            print_indent(indent_level + 1);
-            printf("[%d]:\n", i++);
-            ast_print_value(current_element->value, indent_level + 2);
-            current_element = current_element->next;
-        }
         if (val->data.array_val.num_elements == 0)
         {
             print_indent(indent_level + 1);
             printf("(empty)\n");
+            break;
         }
-        break;
+        return 1;
     case JSON_OBJECT_TYPE:
         printf("OBJECT (%d members):\n", val->data.object_val.num_members);
-        PairNode *current_member = val->data.object_val.head;
-        while (current_member)
-        {
-            print_indent(indent_level + 1);
-            printf("\"%s\":\n", current_member->data.key);
-            ast_print_value(current_member->data.value, indent_level + 2);
-            current_member = current_member->next;
-        }
         if (val->data.object_val.num_members == 0)
         {
             print_indent(indent_level + 1);
             printf("(empty)\n");
+            break;
         }
+        return 1;
+    case JSON_LAZY_TYPE:
+        printf("%s (not parsed)\n", val->data.lazy_val->container_type == JSON_OBJECT_TYPE ? "OBJECT" : "ARRAY");
         break;
     default:
         printf("Unknown Type\n");
     }
+    return 0;
 }
 
-// Unescapes a JSON string. Input is yytext (including quotes). Length includes quotes.
-// Returns a new heap-allocated string (unescaped, without outer quotes).
-char *unescape_json_string(const char *input_str, int length_with_quotes)
+void ast_print_value(const JsonValue *val, int indent_level)
+{
+    if (!print_node_line(val, indent_level))
+        return;
+
+    AstWalkStack st = {NULL, 0, 0};
+    walk_push(&st, val, indent_level);
+    while (st.depth > 0)
+    {
+        AstWalkFrame *top = &st.frames[st.depth - 1];
+        const JsonValue *child;
+        int child_indent = top->indent_level + 2;
+        if (top->element)
+        {
+            print_indent(top->indent_level + 1);
+            printf("[%d]:\n", top->index++);
+            child = top->element->value;
+            top->element = top->element->next;
+        }
+        else if (top->member)
+        {
+            print_indent(top->indent_level + 1);
+            printf("\"%s\":\n", top->member->data.key);
+            child = top->member->data.value;
+            top->member = top->member->next;
+        }
+        else
+        {
+            st.depth--;
+            continue;
+        }
+        if (print_node_line(child, child_indent))
+            walk_push(&st, child, child_indent);
+    }
+    free(st.frames);
+}
+
+// Unescapes a JSON string into unescaped_str, which must hold at least length_with_quotes bytes.
+// Returns the unescaped length (the result is also null-terminated).
+int unescape_json_string_into(char *unescaped_str, const char *input_str, int length_with_quotes)
 {
     if (!input_str || length_with_quotes < 2 || input_str[0] != '"' || input_str[length_with_quotes - 1] != '"')
     {
         // Should not happen if lexer rule is correct
-        return safe_strdup("");
+        unescaped_str[0] = '\0';
+        return 0;
     }
 
-    // Max possible length is length_with_quotes - 2
-    char *unescaped_str = (char *)safe_malloc(length_with_quotes); // A bit more for safety, then realloc if needed
-    int s_idx = 0;                                                 // Index for unescaped_str
+    int s_idx = 0; // Index for unescaped_str
 
     for (int i = 1; i < length_with_quotes - 1; ++i)
     { // Skip outer quotes
@@ -323,6 +561,22 @@ char *unescape_json_string(const char *input_str, int length_with_quotes)
         }
     }
     unescaped_str[s_idx] = '\0';
+    return s_idx;
+}
+
+// Unescapes a JSON string. Input is yytext (including quotes). Length includes quotes.
+// Returns a new heap-allocated string (unescaped, without outer quotes).
+char *unescape_json_string(const char *input_str, int length_with_quotes)
+{
+    if (!input_str || length_with_quotes < 2)
+    {
+        // Should not happen if lexer rule is correct
+        return safe_strdup("");
+    }
+
+    // Max possible length is length_with_quotes - 2
+    char *unescaped_str = (char *)safe_malloc(length_with_quotes);
+    unescape_json_string_into(unescaped_str, input_str, length_with_quotes);
 
     // Optional: realloc to actual size if memory is critical
     // char* final_str = realloc(unescaped_str, s_idx + 1);
@@ -3,6 +3,7 @@
 #define AST_H
 
 #include <stdio.h> // For FILE* in TableSchema, though it's more of a schema_csv concern
+#include <stddef.h> // For size_t
 
 // Enum for JSON value types
 typedef enum
@@ -12,7 +13,8 @@ typedef enum
     JSON_NUMBER_TYPE,
     JSON_STRING_TYPE,
     JSON_ARRAY_TYPE,
-    JSON_OBJECT_TYPE
+    JSON_OBJECT_TYPE,
+    JSON_LAZY_TYPE // Object/array not parsed yet (--lazy); see json_lazy_resolve in json_index.h
 } JsonValueType;
 
 // Forward declarations
@@ -22,6 +24,7 @@ struct JsonArray;
 struct Pair;
 struct PairNode;  // Linked list node for key-value pairs in an object
 struct ValueNode; // Linked list node for values in an array
+struct JsonIndex; // Structural index of the input (json_index.h)
 
 // Structure for a key-value pair in an object
 typedef struct Pair
@@ -48,6 +51,7 @@ typedef struct ValueNode
 typedef struct JsonObject
 {
     PairNode *head; // Head of the linked list of pairs
+    PairNode *tail; // Last pair, so members are appended in O(1)
     int num_members;
 } JsonObject;
 
@@ -55,40 +59,80 @@ typedef struct JsonObject
 typedef struct JsonArray
 {
     ValueNode *head; // Head of the linked list of values
+    ValueNode *tail; // Last value, so elements are appended in O(1)
     int num_elements;
 } JsonArray;
 
-// Generic JSON value structure
+// Unparsed container: a span of the input, identified by the index entry of its opening bracket
+typedef struct JsonLazy
+{
+    const struct JsonIndex *index; // Borrowed; must outlive the AST
+    size_t begin;                  // Index entry of the '{' or '['
+    JsonValueType container_type;  // JSON_OBJECT_TYPE or JSON_ARRAY_TYPE
+} JsonLazy;
+
+// Longest string stored inside the node itself (in the bytes the union has anyway)
+#define AST_INLINE_STRING_MAX (sizeof(JsonArray) - 1)
+
+// Generic JSON value structure (32 bytes on 64-bit targets)
 typedef struct JsonValue
 {
-    JsonValueType type;
+    unsigned char type;       // JsonValueType
+    unsigned char inline_len; // JSON_STRING_TYPE: length + 1 of a string kept in data.inline_str, 0 if it is behind string_val
+    unsigned int string_id;   // JSON_STRING_TYPE: intern.h ID of a shared string_val, or 0 if the node owns it
     union
     {
         int bool_val;          // For JSON_BOOLEAN_TYPE
         double num_val;        // For JSON_NUMBER_TYPE
-        char *string_val;      // For JSON_STRING_TYPE (unescaped, null-terminated)
+        char *string_val;      // For JSON_STRING_TYPE (unescaped, null-terminated); read it with ast_string_value
+        char inline_str[sizeof(JsonArray)]; // For short JSON_STRING_TYPE values (see inline_len)
         JsonArray array_val;   // For JSON_ARRAY_TYPE
         JsonObject object_val; // For JSON_OBJECT_TYPE
+        JsonLazy *lazy_val;    // For JSON_LAZY_TYPE
     } data;
 } JsonValue;
 
+// Characters of a JSON_STRING_TYPE value, wherever they are stored
+static inline const char *ast_string_value(const JsonValue *val)
+{
+    return val->inline_len ? val->data.inline_str : val->data.string_val;
+}
+
 // --- AST Node Creation Functions (Prototypes) ---
 JsonValue *ast_create_null();
 JsonValue *ast_create_boolean(int val);
 JsonValue *ast_create_number(double val);
 JsonValue *ast_create_number_from_string(const char *s_val);
 JsonValue *ast_create_string(char *s_val); // Takes ownership of s_val (which should be heap-allocated and unescaped)
+// With interning on, ast_create_string and ast_object_add_member share identical string values
+// and keys through intern.h (thread-safe). Only change it while no AST exists: keys carry no
+// ownership flag, and turning it off frees the shared strings.
+void ast_set_string_interning(int enabled);
+// Same as ast_create_string(unescape_json_string(lexeme, length_with_quotes)), but short strings
+// are unescaped straight into the node without a heap copy
+JsonValue *ast_create_string_from_lexeme(const char *lexeme, int length_with_quotes);
 JsonValue *ast_create_array();
 JsonValue *ast_create_object();
+JsonValue *ast_create_lazy(const struct JsonIndex *index, size_t begin, JsonValueType container_type);
 
 void ast_array_append(JsonValue *array_val, JsonValue *element_val);
+void ast_array_splice(JsonValue *dst_array, JsonValue *src_array); // Moves all of src's elements to the end of dst in O(1)
 void ast_object_add_member(JsonValue *object_val, char *key, JsonValue *member_val); // key is duplicated, member_val is adopted
 
 // --- AST Utility Functions (Prototypes) ---
 void ast_free_value(JsonValue *val);
 void ast_print_value(const JsonValue *val, int indent_level);
+// Frees everything below an object/array and leaves it empty (--release-early)
+void ast_release_children(JsonValue *container);
+// Frees everything below an object/array and turns it back into an unparsed node for index[begin]
+void ast_make_lazy(JsonValue *val, const struct JsonIndex *index, size_t begin);
+// Keeps freed nodes on free lists for reuse by later ast_create_* calls; 0 frees the lists.
+// Not thread-safe: only enable it on one thread, after any parallel parsing has finished.
+void ast_set_node_recycling(int enabled);
 
 // Helper for string unescaping (used by lexer or parser actions)
 char *unescape_json_string(const char *input_str, int length_with_quotes);
+// Same, but writes into a caller buffer of at least length_with_quotes bytes; returns the unescaped length
+int unescape_json_string_into(char *unescaped_str, const char *input_str, int length_with_quotes);
 
 #endif // AST_H
\ No newline at end of file
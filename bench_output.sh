@@ -0,0 +1,42 @@
+#!/bin/bash
+# Compares the output back ends (--io-backend) end to end.
+# Usage: ./bench_output.sh [input.json] [runs]
+# Without an input, a document with 2000 tables of 200 rows each is generated in bench_output/.
+BIN=./json2relcsv
+RUNS=${2:-3}
+OUT=./bench_output
+mkdir -p "$OUT"
+
+INPUT=$1
+if [ -z "$INPUT" ]; then
+    INPUT=$OUT/bench_tables.json
+    if [ ! -f "$INPUT" ]; then
+        echo "Generating $INPUT"
+        awk 'BEGIN {
+            tables = 2000; rows = 200
+            printf "{"
+            for (t = 0; t < tables; t++) {
+                printf "%s\"group%d\": [", (t ? "," : ""), t
+                for (i = 0; i < rows; i++)
+                    printf "%s{\"id\": %d, \"label\": \"item %d of %d\", \"value\": %.2f}", (i ? "," : ""), i, i, t, i * 1.5
+                printf "]\n"
+            }
+            printf "}\n"
+        }' > "$INPUT"
+    fi
+fi
+
+echo "Input: $INPUT ($(wc -c < "$INPUT") bytes), best of $RUNS runs"
+TIMEFORMAT=%R
+for backend in write pwritev uring mmap spill; do
+    best=""
+    for ((r = 0; r < RUNS; r++)); do
+        rm -rf "$OUT/csv"
+        t=$( { time "$BIN" "$INPUT" --parser rd --io-backend "$backend" -out-dir "$OUT/csv" > /dev/null 2> /dev/null; } 2>&1 )
+        if [ -z "$best" ] || awk -v a="$t" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+            best=$t
+        fi
+    done
+    printf "  %-8s %ss\n" "$backend" "$best"
+done
+rm -rf "$OUT/csv"
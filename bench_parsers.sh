@@ -0,0 +1,40 @@
+#!/bin/bash
+# Compares the parser back ends end to end (parse + CSV generation).
+# Usage: ./bench_parsers.sh [input.json] [runs]
+# Without an input, a ~20 MB array of objects is generated in bench_output/.
+BIN=./json2relcsv
+RUNS=${2:-3}
+OUT=./bench_output
+mkdir -p "$OUT"
+
+INPUT=$1
+if [ -z "$INPUT" ]; then
+    INPUT=$OUT/bench_input.json
+    if [ ! -f "$INPUT" ]; then
+        echo "Generating $INPUT"
+        awk 'BEGIN {
+            n = 150000
+            printf "["
+            for (i = 0; i < n; i++) {
+                printf "%s{\"id\": %d, \"name\": \"user %d\", \"score\": %.3f, \"active\": %s, \"note\": null, ", (i ? "," : ""), i, i, i * 0.37, (i % 2 ? "true" : "false")
+                printf "\"address\": {\"street\": \"%d Main St\", \"zip\": \"%05d\"}}\n", i, i % 100000
+            }
+            printf "]\n"
+        }' > "$INPUT"
+    fi
+fi
+
+echo "Input: $INPUT ($(wc -c < "$INPUT") bytes), best of $RUNS runs"
+TIMEFORMAT=%R
+for parser in flex simd rd; do
+    best=""
+    for ((r = 0; r < RUNS; r++)); do
+        rm -rf "$OUT/csv"
+        t=$( { time "$BIN" "$INPUT" --parser "$parser" -out-dir "$OUT/csv" > /dev/null 2> /dev/null; } 2>&1 )
+        if [ -z "$best" ] || awk -v a="$t" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+            best=$t
+        fi
+    done
+    printf "  %-5s %ss\n" "$parser" "$best"
+done
+rm -rf "$OUT/csv"
@@ -0,0 +1,409 @@
+// csv_batch.c
+#define _GNU_SOURCE // For pwritev and syscall
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>       // For IOV_MAX
+#include <unistd.h>       // For pwrite, close, syscall
+#include <sys/uio.h>      // For pwritev
+#include <sys/mman.h>     // For the ring mappings
+#include <sys/syscall.h>
+#include <sys/resource.h> // For getrlimit
+#include <linux/io_uring.h>
+
+#include "csv_batch.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+typedef struct BatchWrite
+{
+    int slot;
+    const char *data;
+    size_t len;
+    off_t offset;
+    char *owned; // Buffer taken over from the table (NULL: data is in the staging area)
+} BatchWrite;
+
+// io_uring, set up with the raw system calls (no liburing)
+typedef struct Ring
+{
+    int fd;
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    int fixed_files;   // Slots below this are registered files (IOSQE_FIXED_FILE)
+    int fixed_buffers; // The staging area is registered (IORING_OP_WRITE_FIXED)
+} Ring;
+
+static Ring G_ring = {.fd = -1};
+static int G_use_ring = 0;
+static BatchWrite G_batch[CSV_BATCH_MAX_WRITES];
+static int G_batch_len = 0;
+static char *G_stage = NULL;
+static size_t G_stage_used = 0;
+
+static int G_num_slots = 0;
+static int *G_slot_fd = NULL;      // Open file of every slot (-1: free)
+static int *G_slot_pending = NULL; // Queued writes per slot
+static char **G_slot_path = NULL;  // For error messages (the table may be gone when its writes are)
+static int *G_free_slots = NULL, G_num_free = 0;
+static int *G_deferred = NULL, G_num_deferred = 0; // Slots closed while writes were queued
+
+static void *safe_batch_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (!ptr)
+    {
+        perror("Error: csv_batch malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void ring_close(void)
+{
+    if (G_ring.sqes)
+        munmap(G_ring.sqes, G_ring.sqes_len);
+    if (G_ring.cq_map && G_ring.cq_map != G_ring.sq_map)
+        munmap(G_ring.cq_map, G_ring.cq_map_len);
+    if (G_ring.sq_map)
+        munmap(G_ring.sq_map, G_ring.sq_map_len);
+    if (G_ring.fd >= 0)
+        close(G_ring.fd);
+    memset(&G_ring, 0, sizeof(G_ring));
+    G_ring.fd = -1;
+}
+
+static int ring_open(void)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    G_ring.fd = sys_io_uring_setup(CSV_BATCH_MAX_WRITES, &p);
+    if (G_ring.fd < 0)
+        return -1;
+
+    G_ring.sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    G_ring.cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (G_ring.cq_map_len > G_ring.sq_map_len)
+            G_ring.sq_map_len = G_ring.cq_map_len;
+        G_ring.cq_map_len = G_ring.sq_map_len;
+    }
+    G_ring.sq_map = mmap(NULL, G_ring.sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, G_ring.fd, IORING_OFF_SQ_RING);
+    if (G_ring.sq_map == MAP_FAILED)
+    {
+        G_ring.sq_map = NULL;
+        ring_close();
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        G_ring.cq_map = G_ring.sq_map;
+    else
+    {
+        G_ring.cq_map = mmap(NULL, G_ring.cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, G_ring.fd, IORING_OFF_CQ_RING);
+        if (G_ring.cq_map == MAP_FAILED)
+        {
+            G_ring.cq_map = NULL;
+            ring_close();
+            return -1;
+        }
+    }
+    G_ring.sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    G_ring.sqes = (struct io_uring_sqe *)mmap(NULL, G_ring.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, G_ring.fd, IORING_OFF_SQES);
+    if (G_ring.sqes == MAP_FAILED)
+    {
+        G_ring.sqes = NULL;
+        ring_close();
+        return -1;
+    }
+
+    char *sq = (char *)G_ring.sq_map, *cq = (char *)G_ring.cq_map;
+    G_ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    G_ring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    G_ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+    G_ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+    G_ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    G_ring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    G_ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    // Registered files and buffers are optimizations: without them the same operations take plain
+    // descriptors and addresses. The kernel caps the file table at RLIMIT_NOFILE.
+    int num_fixed = G_num_slots;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY && (rlim_t)num_fixed > rl.rlim_cur)
+        num_fixed = (int)rl.rlim_cur;
+    int *fds = (int *)safe_batch_malloc((size_t)num_fixed * sizeof(int));
+    for (int i = 0; i < num_fixed; ++i)
+        fds[i] = -1;
+    if (sys_io_uring_register(G_ring.fd, IORING_REGISTER_FILES, fds, (unsigned)num_fixed) == 0)
+        G_ring.fixed_files = num_fixed;
+    free(fds);
+    struct iovec stage = {G_stage, CSV_BATCH_STAGE_SIZE};
+    G_ring.fixed_buffers = sys_io_uring_register(G_ring.fd, IORING_REGISTER_BUFFERS, &stage, 1) == 0;
+    return 0;
+}
+
+int csv_batch_init(int use_uring, int max_files)
+{
+    G_num_slots = max_files + CSV_BATCH_MAX_WRITES; // Closed files wait for their writes in their slots
+    G_slot_fd = (int *)safe_batch_malloc((size_t)G_num_slots * sizeof(int));
+    G_slot_pending = (int *)safe_batch_malloc((size_t)G_num_slots * sizeof(int));
+    G_slot_path = (char **)safe_batch_malloc((size_t)G_num_slots * sizeof(char *));
+    G_free_slots = (int *)safe_batch_malloc((size_t)G_num_slots * sizeof(int));
+    G_deferred = (int *)safe_batch_malloc((size_t)G_num_slots * sizeof(int));
+    for (int i = 0; i < G_num_slots; ++i)
+    {
+        G_slot_fd[i] = -1;
+        G_slot_pending[i] = 0;
+        G_slot_path[i] = NULL;
+        G_free_slots[i] = G_num_slots - 1 - i; // Lowest slots first
+    }
+    G_num_free = G_num_slots;
+    G_stage = (char *)safe_batch_malloc(CSV_BATCH_STAGE_SIZE);
+    G_use_ring = use_uring && ring_open() == 0;
+    return G_use_ring;
+}
+
+static void close_slot(int slot)
+{
+    if (G_use_ring && slot < G_ring.fixed_files)
+    {
+        int none = -1;
+        struct io_uring_files_update up = {.offset = (unsigned)slot, .fds = (unsigned long)&none};
+        sys_io_uring_register(G_ring.fd, IORING_REGISTER_FILES_UPDATE, &up, 1);
+    }
+    if (close(G_slot_fd[slot]) != 0)
+    {
+        perror("Error closing CSV file");
+        fprintf(stderr, "Failed to close: %s\n", G_slot_path[slot]);
+    }
+    G_slot_fd[slot] = -1;
+    free(G_slot_path[slot]);
+    G_slot_path[slot] = NULL;
+    G_free_slots[G_num_free++] = slot;
+}
+
+int csv_batch_open_file(int fd, const char *path)
+{
+    int slot = G_free_slots[--G_num_free]; // The caller keeps at most max_files open
+    G_slot_fd[slot] = fd;
+    size_t path_len = strlen(path);
+    G_slot_path[slot] = (char *)safe_batch_malloc(path_len + 1);
+    memcpy(G_slot_path[slot], path, path_len + 1);
+    if (G_use_ring && slot < G_ring.fixed_files)
+    {
+        struct io_uring_files_update up = {.offset = (unsigned)slot, .fds = (unsigned long)&G_slot_fd[slot]};
+        if (sys_io_uring_register(G_ring.fd, IORING_REGISTER_FILES_UPDATE, &up, 1) != 1)
+            G_ring.fixed_files = 0; // Stop using them rather than fail
+    }
+    return slot;
+}
+
+void csv_batch_close_file(int slot)
+{
+    if (G_slot_pending[slot] == 0)
+    {
+        close_slot(slot);
+        return;
+    }
+    G_deferred[G_num_deferred++] = slot;
+}
+
+int csv_batch_closing(void)
+{
+    return G_num_deferred;
+}
+
+// Writes what is left of a write after a short or failed attempt
+static int finish_write(const BatchWrite *bw, size_t done)
+{
+    while (done < bw->len)
+    {
+        ssize_t n = pwrite(G_slot_fd[bw->slot], bw->data + done, bw->len - done, bw->offset + (off_t)done);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Error writing CSV file");
+            fprintf(stderr, "Failed to write: %s\n", G_slot_path[bw->slot]);
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+// One pwritev per run of consecutive writes that continue each other in the same file
+static int submit_pwritev(void)
+{
+    int rc = 0;
+    struct iovec iov[CSV_BATCH_MAX_WRITES];
+    for (int i = 0; i < G_batch_len;)
+    {
+        int j = i + 1;
+        size_t total = G_batch[i].len;
+        while (j < G_batch_len && j - i < IOV_MAX && G_batch[j].slot == G_batch[i].slot &&
+               G_batch[j].offset == G_batch[i].offset + (off_t)total)
+            total += G_batch[j++].len;
+        for (int k = i; k < j; ++k)
+        {
+            iov[k - i].iov_base = (void *)G_batch[k].data;
+            iov[k - i].iov_len = G_batch[k].len;
+        }
+        ssize_t n;
+        do
+            n = pwritev(G_slot_fd[G_batch[i].slot], iov, j - i, G_batch[i].offset);
+        while (n < 0 && errno == EINTR);
+        size_t written = n > 0 ? (size_t)n : 0;
+        for (int k = i; k < j; ++k)
+        { // Short write: finish each remaining piece on its own
+            size_t done = written < G_batch[k].len ? written : G_batch[k].len;
+            written -= done;
+            if (done < G_batch[k].len && finish_write(&G_batch[k], done) != 0)
+                rc = -1;
+        }
+        i = j;
+    }
+    return rc;
+}
+
+static int submit_ring(void)
+{
+    unsigned tail = *G_ring.sq_tail, mask = *G_ring.sq_mask;
+    for (int i = 0; i < G_batch_len; ++i)
+    {
+        const BatchWrite *bw = &G_batch[i];
+        unsigned idx = tail & mask;
+        struct io_uring_sqe *sqe = &G_ring.sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        int staged = bw->owned == NULL;
+        sqe->opcode = staged && G_ring.fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->buf_index = 0;
+        if (bw->slot < G_ring.fixed_files)
+        {
+            sqe->fd = bw->slot;
+            sqe->flags = IOSQE_FIXED_FILE;
+        }
+        else
+            sqe->fd = G_slot_fd[bw->slot];
+        sqe->addr = (unsigned long)bw->data;
+        sqe->len = (unsigned)bw->len;
+        sqe->off = (unsigned long long)bw->offset;
+        sqe->user_data = (unsigned long long)i;
+        G_ring.sq_array[idx] = idx;
+        tail++;
+    }
+    __atomic_store_n(G_ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+    // One system call submits the whole batch and waits for it
+    int rc = 0;
+    unsigned to_submit = (unsigned)G_batch_len, completed = 0;
+    while (completed < (unsigned)G_batch_len)
+    {
+        int n = sys_io_uring_enter(G_ring.fd, to_submit, (unsigned)G_batch_len - completed, IORING_ENTER_GETEVENTS);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("Error: io_uring_enter failed");
+            return -1; // The writes still queued in the ring are lost; the run fails anyway
+        }
+        if (n > 0)
+            to_submit -= (unsigned)n < to_submit ? (unsigned)n : to_submit;
+        unsigned head = *G_ring.cq_head;
+        unsigned cq_tail = __atomic_load_n(G_ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; ++head)
+        {
+            const struct io_uring_cqe *cqe = &G_ring.cqes[head & *G_ring.cq_mask];
+            const BatchWrite *bw = &G_batch[cqe->user_data];
+            size_t done = cqe->res > 0 ? (size_t)cqe->res : 0;
+            if (done < bw->len && finish_write(bw, done) != 0) // Short writes and errors go through pwrite
+                rc = -1;
+            completed++;
+        }
+        __atomic_store_n(G_ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    return rc;
+}
+
+int csv_batch_submit(void)
+{
+    if (G_batch_len == 0)
+        return 0;
+    int rc = G_use_ring ? submit_ring() : submit_pwritev();
+    for (int i = 0; i < G_batch_len; ++i)
+    {
+        free(G_batch[i].owned);
+        G_slot_pending[G_batch[i].slot]--;
+    }
+    G_batch_len = 0;
+    G_stage_used = 0;
+    for (int i = 0; i < G_num_deferred; ++i)
+        close_slot(G_deferred[i]);
+    G_num_deferred = 0;
+    return rc;
+}
+
+int csv_batch_add(int slot, char **buf, size_t len, size_t cap, off_t offset)
+{
+    int staged = len <= CSV_BATCH_COPY_MAX;
+    if (G_batch_len == CSV_BATCH_MAX_WRITES || (staged && G_stage_used + len > CSV_BATCH_STAGE_SIZE))
+        if (csv_batch_submit() != 0)
+            return -1;
+    BatchWrite *bw = &G_batch[G_batch_len++];
+    bw->slot = slot;
+    bw->len = len;
+    bw->offset = offset;
+    if (staged)
+    {
+        memcpy(G_stage + G_stage_used, *buf, len);
+        bw->data = G_stage + G_stage_used;
+        bw->owned = NULL;
+        G_stage_used += len;
+    }
+    else
+    {
+        bw->data = bw->owned = *buf;
+        *buf = (char *)safe_batch_malloc(cap);
+    }
+    G_slot_pending[slot]++;
+    return 0;
+}
+
+void csv_batch_shutdown(void)
+{
+    if (G_use_ring)
+        ring_close();
+    G_use_ring = 0;
+    free(G_slot_fd);
+    free(G_slot_pending);
+    free(G_slot_path);
+    free(G_free_slots);
+    free(G_deferred);
+    free(G_stage);
+    G_slot_fd = G_slot_pending = G_free_slots = G_deferred = NULL;
+    G_slot_path = NULL;
+    G_stage = NULL;
+    G_num_slots = G_num_free = G_num_deferred = 0;
+}
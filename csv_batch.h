@@ -0,0 +1,39 @@
+// csv_batch.h
+#ifndef CSV_BATCH_H
+#define CSV_BATCH_H
+
+#include <stddef.h>    // For size_t
+#include <sys/types.h> // For off_t
+
+// Batched submission of CSV buffer writes (--io-backend uring|pwritev).
+//
+// Flushed table buffers are queued instead of written one write(2) at a time. Up to
+// CSV_BATCH_MAX_WRITES of them go to the kernel together: with io_uring as one submission
+// (io_uring_enter), otherwise with one pwritev per run of consecutive buffers of the same file.
+// Small buffers are copied into a staging area registered with the ring (IORING_OP_WRITE_FIXED)
+// so the table keeps its own buffer; large ones are taken over and freed once written. Files
+// are registered with the ring as fixed files while they are open.
+
+#define CSV_BATCH_MAX_WRITES 64
+#define CSV_BATCH_STAGE_SIZE (1024 * 1024) // Registered staging area for small buffers
+#define CSV_BATCH_COPY_MAX (64 * 1024)     // Larger buffers are written from where they are
+
+// Sets up batching for up to max_files open files. With use_uring, tries io_uring first;
+// returns 1 if it is used, 0 if writes go through pwritev.
+int csv_batch_init(int use_uring, int max_files);
+void csv_batch_shutdown(void);
+
+// Registers an opened file; the returned slot identifies it in csv_batch_add.
+int csv_batch_open_file(int fd, const char *path);
+// Closes the file in slot, right away or, if writes to it are still queued, after they are done.
+void csv_batch_close_file(int slot);
+
+// Queues len bytes of *buf for offset. *buf either stays with the caller (its bytes were copied)
+// or is taken over and replaced by a new buffer of cap bytes. Returns -1 if a batch had to be
+// written first and failed.
+int csv_batch_add(int slot, char **buf, size_t len, size_t cap, off_t offset);
+// Writes everything queued and closes the files waiting for it. Returns -1 after reporting an error.
+int csv_batch_submit(void);
+int csv_batch_closing(void); // Closed files still waiting for their writes
+
+#endif // CSV_BATCH_H
@@ -0,0 +1,217 @@
+// csv_compress.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "csv_compress.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+struct CsvCompressor
+{
+    CsvCompression codec;
+    char *out;
+    size_t out_cap;
+#ifdef HAVE_ZLIB
+    z_stream gz;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zstd;
+#endif
+};
+
+static void *safe_compress_realloc(void *ptr, size_t size)
+{
+    void *grown = realloc(ptr, size);
+    if (!grown)
+    {
+        perror("Error: csv_compress realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+int csv_compress_available(CsvCompression c)
+{
+    switch (c)
+    {
+    case CSV_COMPRESS_NONE:
+        return 1;
+    case CSV_COMPRESS_GZIP:
+#ifdef HAVE_ZLIB
+        return 1;
+#else
+        return 0;
+#endif
+    case CSV_COMPRESS_ZSTD:
+#ifdef HAVE_ZSTD
+        return 1;
+#else
+        return 0;
+#endif
+    }
+    return 0;
+}
+
+const char *csv_compress_suffix(CsvCompression c)
+{
+    return c == CSV_COMPRESS_GZIP ? ".gz" : c == CSV_COMPRESS_ZSTD ? ".zst" : "";
+}
+
+int csv_compress_default_level(CsvCompression c)
+{
+    return c == CSV_COMPRESS_GZIP ? 6 : c == CSV_COMPRESS_ZSTD ? 3 : 0;
+}
+
+int csv_compress_max_level(CsvCompression c)
+{
+#ifdef HAVE_ZSTD
+    if (c == CSV_COMPRESS_ZSTD)
+        return ZSTD_maxCLevel();
+#endif
+    return c == CSV_COMPRESS_GZIP ? 9 : c == CSV_COMPRESS_ZSTD ? 19 : 0;
+}
+
+CsvCompressor *csv_compressor_create(CsvCompression c, int level)
+{
+    CsvCompressor *z = (CsvCompressor *)safe_compress_realloc(NULL, sizeof(CsvCompressor));
+    memset(z, 0, sizeof(*z));
+    z->codec = c;
+#ifdef HAVE_ZLIB
+    if (c == CSV_COMPRESS_GZIP)
+    {
+        // windowBits 15 + 16: a gzip header and trailer instead of the zlib ones
+        if (deflateInit2(&z->gz, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            fprintf(stderr, "Error: Could not set up gzip compression (level %d).\n", level);
+            free(z);
+            return NULL;
+        }
+        return z;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (c == CSV_COMPRESS_ZSTD)
+    {
+        z->zstd = ZSTD_createCCtx();
+        if (!z->zstd || ZSTD_isError(ZSTD_CCtx_setParameter(z->zstd, ZSTD_c_compressionLevel, level)))
+        {
+            fprintf(stderr, "Error: Could not set up zstd compression (level %d).\n", level);
+            ZSTD_freeCCtx(z->zstd);
+            free(z);
+            return NULL;
+        }
+        return z;
+    }
+#endif
+    (void)level;
+    fprintf(stderr, "Error: This build has no %s support.\n", c == CSV_COMPRESS_ZSTD ? "zstd" : "gzip");
+    free(z);
+    return NULL;
+}
+
+// Makes sure at least room more bytes fit after used bytes of output
+static void reserve_out(CsvCompressor *z, size_t used, size_t room)
+{
+    if (z->out_cap - used >= room)
+        return;
+    size_t cap = z->out_cap ? z->out_cap : 64 * 1024;
+    while (cap - used < room)
+        cap *= 2;
+    z->out = (char *)safe_compress_realloc(z->out, cap);
+    z->out_cap = cap;
+}
+
+int csv_compressor_run(CsvCompressor *z, const char *data, size_t len, int finish, const char **out, size_t *out_len)
+{
+    size_t used = 0;
+#ifdef HAVE_ZLIB
+    if (z->codec == CSV_COMPRESS_GZIP)
+    {
+        z->gz.next_in = (Bytef *)data;
+        z->gz.avail_in = (uInt)len;
+        for (;;)
+        {
+            reserve_out(z, used, 64 * 1024);
+            z->gz.next_out = (Bytef *)(z->out + used);
+            z->gz.avail_out = (uInt)(z->out_cap - used);
+            int rc = deflate(&z->gz, finish ? Z_FINISH : Z_NO_FLUSH);
+            used = z->out_cap - z->gz.avail_out;
+            if (rc == Z_STREAM_ERROR)
+            {
+                fprintf(stderr, "Error: gzip compression failed.\n");
+                return -1;
+            }
+            if (finish ? rc == Z_STREAM_END : z->gz.avail_in == 0 && z->gz.avail_out > 0)
+                break;
+        }
+        *out = z->out;
+        *out_len = used;
+        return 0;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (z->codec == CSV_COMPRESS_ZSTD)
+    {
+        ZSTD_inBuffer in = {data, len, 0};
+        for (;;)
+        {
+            reserve_out(z, used, ZSTD_CStreamOutSize());
+            ZSTD_outBuffer o = {z->out + used, z->out_cap - used, 0};
+            size_t left = ZSTD_compressStream2(z->zstd, &o, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+            used += o.pos;
+            if (ZSTD_isError(left))
+            {
+                fprintf(stderr, "Error: zstd compression failed: %s\n", ZSTD_getErrorName(left));
+                return -1;
+            }
+            if (finish ? left == 0 : in.pos == in.size)
+                break;
+        }
+        *out = z->out;
+        *out_len = used;
+        return 0;
+    }
+#endif
+    (void)data;
+    (void)len;
+    (void)finish;
+    (void)used;
+    *out = NULL;
+    *out_len = 0;
+    return -1;
+}
+
+void csv_compressor_reset(CsvCompressor *z)
+{
+#ifdef HAVE_ZLIB
+    if (z->codec == CSV_COMPRESS_GZIP)
+        deflateReset(&z->gz);
+#endif
+#ifdef HAVE_ZSTD
+    if (z->codec == CSV_COMPRESS_ZSTD)
+        ZSTD_CCtx_reset(z->zstd, ZSTD_reset_session_only);
+#endif
+    (void)z;
+}
+
+void csv_compressor_free(CsvCompressor *z)
+{
+    if (!z)
+        return;
+#ifdef HAVE_ZLIB
+    if (z->codec == CSV_COMPRESS_GZIP)
+        deflateEnd(&z->gz);
+#endif
+#ifdef HAVE_ZSTD
+    if (z->codec == CSV_COMPRESS_ZSTD)
+        ZSTD_freeCCtx(z->zstd);
+#endif
+    free(z->out);
+    free(z);
+}
@@ -0,0 +1,35 @@
+// csv_compress.h
+#ifndef CSV_COMPRESS_H
+#define CSV_COMPRESS_H
+
+#include <stddef.h> // For size_t
+
+// Streaming compressors for the CSV output (--compress gzip|zstd).
+//
+// gzip needs zlib (HAVE_ZLIB) and zstd needs libzstd (HAVE_ZSTD); the Makefile defines them when
+// the libraries are found. A codec that was not built in reports itself unavailable.
+
+typedef enum
+{
+    CSV_COMPRESS_NONE,
+    CSV_COMPRESS_GZIP,
+    CSV_COMPRESS_ZSTD
+} CsvCompression;
+
+typedef struct CsvCompressor CsvCompressor;
+
+int csv_compress_available(CsvCompression c);
+const char *csv_compress_suffix(CsvCompression c); // Appended to ".csv": ".gz", ".zst" or ""
+int csv_compress_default_level(CsvCompression c);
+int csv_compress_max_level(CsvCompression c);
+
+CsvCompressor *csv_compressor_create(CsvCompression c, int level);
+// Compresses len bytes of data; with finish, also ends the stream (gzip member / zstd frame).
+// *out and *out_len receive the compressed bytes produced so far (possibly none), valid until
+// the next call. Returns -1 after reporting an error.
+int csv_compressor_run(CsvCompressor *z, const char *data, size_t len, int finish, const char **out, size_t *out_len);
+// Starts a new stream with the same settings, keeping the allocated state and output buffer.
+void csv_compressor_reset(CsvCompressor *z);
+void csv_compressor_free(CsvCompressor *z);
+
+#endif // CSV_COMPRESS_H
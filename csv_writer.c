@@ -0,0 +1,975 @@
+// csv_writer.c
+#define _GNU_SOURCE // For fallocate and copy_file_range
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>        // For open
+#include <unistd.h>       // For pwrite, close
+#include <sched.h>        // For sched_yield
+#include <pthread.h>      // For the writer threads
+#include <semaphore.h>
+#include <sys/mman.h>     // For the mapped output mode
+#include <sys/stat.h>     // For fstat
+#include <sys/resource.h> // For getrlimit
+
+#include "csv_writer.h"
+#include "csv_batch.h"
+#include "csv_compress.h"
+
+#define CSV_WRITER_RESERVED_FDS 16 // Left for stdio, the input, the cache and the schema files
+
+static int G_max_open = 0; // Pool size (0: not decided yet)
+static int G_skip_empty = 0;
+static int G_batching = 0; // Writes go through csv_batch
+static int G_mapped_output = 0; // Large tables are written through a mapping of their file
+static int G_spill_output = 0;  // Flushes go to one spill log, copied to the tables' files on close
+static int G_spill_fd = -1;     // The spill log (unlinked as soon as it is created)
+static off_t G_spill_end = 0;
+static int G_spill_copy_range = 1; // copy_file_range works between the log and the tables' files
+static char *G_spill_bounce = NULL; // Copy buffer where it does not
+static CsvCompression G_compression = CSV_COMPRESS_NONE;
+static int G_compress_level = 0;
+static int G_block_threads = 0; // Compression pool size (0: each table is one stream)
+static int G_block_compression = 0;
+static atomic_int G_num_open = 0; // Writer threads close the files of closed writers
+static CsvWriter *G_lru_head = NULL, *G_lru_tail = NULL;
+static CsvWriter **G_writers = NULL; // Every live writer, flushed if the program exits early
+static size_t G_num_writers = 0, G_writers_cap = 0;
+static int G_exit_flush_registered = 0;
+static int G_in_exit_flush = 0;
+
+// Writer threads (--writer-threads). The converter hands each full buffer over as a job and
+// carries on with a fresh one; the threads pwrite it at the offset it was given, so chunks of
+// one file may be written in any order. The queue is a ring of sequence-numbered slots filled
+// by the converter thread alone; the semaphores only put a side to sleep when the ring is
+// empty or full (the latter is the back-pressure that bounds buffered output).
+typedef struct WriteJob
+{
+    CsvWriter *w; // NULL: the thread exits
+    int fd;
+    char *buf; // Freed by the thread
+    size_t len;
+    off_t offset;
+    int is_block; // Compress the buffer as a block instead of writing it
+    size_t seq;   // The block's position in its table
+} WriteJob;
+
+// Parallel block compression (--compress-threads). Every flushed buffer is compressed by a
+// thread into a self-contained gzip member / zstd frame; the converter thread collects the
+// blocks and writes each table's blocks in sequence order, so the file is the same whatever
+// the number of threads. Concatenated members and frames are valid gzip and zstd files.
+typedef struct CompressedBlock
+{
+    CsvWriter *w;
+    size_t seq;
+    char *data;
+    size_t len;
+    struct CompressedBlock *next;
+} CompressedBlock;
+
+static CompressedBlock *G_done_blocks = NULL; // Compressed by the threads, not collected yet (G_done_lock)
+static size_t G_blocks_outstanding = 0;       // Handed over and not written yet
+static _Thread_local CsvCompressor *T_compressor = NULL;
+
+typedef struct JobSlot
+{
+    atomic_size_t seq; // Position of the job it holds + 1, or of the next job it may hold
+    WriteJob job;
+} JobSlot;
+
+static JobSlot G_queue[CSV_WRITER_QUEUE_LEN];
+static atomic_size_t G_queue_head = 0; // Next job taken by a thread
+static size_t G_queue_tail = 0;        // Next job handed over (converter thread only)
+static sem_t G_queue_jobs, G_queue_free;
+static pthread_t *G_threads = NULL;
+static int G_num_threads = 0;
+static atomic_size_t G_jobs_done = 0;
+static pthread_mutex_t G_done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t G_done_cond = PTHREAD_COND_INITIALIZER;
+static atomic_int G_write_failed = 0;
+
+static void *safe_writer_realloc(void *ptr, size_t size)
+{
+    void *grown = realloc(ptr, size);
+    if (!grown)
+    {
+        perror("Error: csv_writer realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+static void *writer_thread(void *arg);
+static int max_open(void);
+static int acquire_fd(CsvWriter *w);
+
+void csv_writers_set_compression(CsvCompression c, int level, int block_threads)
+{
+    G_compression = c;
+    G_compress_level = level;
+    G_block_threads = c != CSV_COMPRESS_NONE ? block_threads : 0;
+}
+
+void csv_writers_configure(int max_open_files, int skip_empty, int writer_threads, CsvIoBackend io_backend)
+{
+    G_max_open = max_open_files;
+    G_skip_empty = skip_empty;
+    G_mapped_output = io_backend == CSV_IO_MMAP;
+    G_spill_output = io_backend == CSV_IO_SPILL;
+    if ((io_backend == CSV_IO_PWRITEV || io_backend == CSV_IO_URING) && !G_batching)
+    {
+        G_batching = 1;
+        if (!csv_batch_init(io_backend == CSV_IO_URING, max_open()) && io_backend == CSV_IO_URING)
+            fprintf(stderr, "Warning: io_uring is not available; writing with pwritev.\n");
+    }
+    if (G_block_threads > 0)
+        writer_threads = G_block_threads;
+    if (writer_threads <= 0 || G_num_threads > 0)
+        return;
+    for (size_t i = 0; i < CSV_WRITER_QUEUE_LEN; ++i)
+        atomic_init(&G_queue[i].seq, i);
+    sem_init(&G_queue_jobs, 0, 0);
+    sem_init(&G_queue_free, 0, CSV_WRITER_QUEUE_LEN);
+    G_threads = (pthread_t *)safe_writer_realloc(NULL, (size_t)writer_threads * sizeof(pthread_t));
+    while (G_num_threads < writer_threads && pthread_create(&G_threads[G_num_threads], NULL, writer_thread, NULL) == 0)
+        G_num_threads++;
+    if (G_num_threads < writer_threads)
+        fprintf(stderr, "Warning: Started %d of %d writer threads.\n", G_num_threads, writer_threads);
+    if (G_num_threads == 0)
+    { // Writes (and compression) stay on the converter thread
+        free(G_threads);
+        G_threads = NULL;
+    }
+    G_block_compression = G_block_threads > 0 && G_num_threads > 0;
+}
+
+static int max_open(void)
+{
+    if (G_max_open > 0)
+        return G_max_open;
+    struct rlimit rl;
+    long limit = 1024;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+        limit = rl.rlim_cur == RLIM_INFINITY ? 65536 : (long)rl.rlim_cur;
+    limit -= CSV_WRITER_RESERVED_FDS;
+    G_max_open = limit < 4 ? 4 : limit > 65536 ? 65536 : (int)limit;
+    return G_max_open;
+}
+
+static void lru_unlink(CsvWriter *w)
+{
+    if (w->lru_prev)
+        w->lru_prev->lru_next = w->lru_next;
+    else
+        G_lru_head = w->lru_next;
+    if (w->lru_next)
+        w->lru_next->lru_prev = w->lru_prev;
+    else
+        G_lru_tail = w->lru_prev;
+    w->lru_prev = w->lru_next = NULL;
+}
+
+static void lru_push_front(CsvWriter *w)
+{
+    w->lru_prev = NULL;
+    w->lru_next = G_lru_head;
+    if (G_lru_head)
+        G_lru_head->lru_prev = w;
+    G_lru_head = w;
+    if (!G_lru_tail)
+        G_lru_tail = w;
+}
+
+static void close_fd(CsvWriter *w)
+{
+    if (w->fd < 0)
+        return;
+    lru_unlink(w);
+    if (G_batching)
+        csv_batch_close_file(w->file_slot); // Once its queued writes are done
+    else if (close(w->fd) != 0)
+    {
+        perror("Error closing CSV file");
+        fprintf(stderr, "Failed to close: %s\n", w->path);
+    }
+    w->fd = -1;
+    atomic_fetch_sub(&G_num_open, 1);
+}
+
+// Writes len bytes at offset; returns -1 after reporting an error
+static int write_at(int fd, const char *p, size_t len, off_t offset, const char *path)
+{
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Error writing CSV file");
+            fprintf(stderr, "Failed to write: %s\n", path);
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+static void enqueue_job(const WriteJob *job)
+{
+    while (sem_wait(&G_queue_free) != 0)
+        ; // EINTR
+    JobSlot *slot = &G_queue[G_queue_tail % CSV_WRITER_QUEUE_LEN];
+    while (atomic_load_explicit(&slot->seq, memory_order_acquire) != G_queue_tail)
+        sched_yield(); // A thread is still copying out the job a lap earlier
+    slot->job = *job;
+    atomic_store_explicit(&slot->seq, G_queue_tail + 1, memory_order_release);
+    G_queue_tail++;
+    sem_post(&G_queue_jobs);
+}
+
+static void dequeue_job(WriteJob *job)
+{
+    while (sem_wait(&G_queue_jobs) != 0)
+        ; // EINTR
+    size_t pos = atomic_fetch_add(&G_queue_head, 1);
+    JobSlot *slot = &G_queue[pos % CSV_WRITER_QUEUE_LEN];
+    while (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1)
+        sched_yield();
+    *job = slot->job;
+    atomic_store_explicit(&slot->seq, pos + CSV_WRITER_QUEUE_LEN, memory_order_release);
+    sem_post(&G_queue_free);
+}
+
+static void free_writer(CsvWriter *w)
+{
+    if (w->map_base)
+        munmap(w->map_base, w->map_len);
+    else
+        free(w->buf);
+    csv_compressor_free(w->compressor);
+    free(w->extents);
+    free(w->path);
+    free(w);
+}
+
+// Compresses the buffer into w's file (with finish, also ends the stream). The compressor is
+// only created by the first flush, so tables that never fill their buffer do not keep one.
+static int write_compressed(CsvWriter *w, int finish)
+{
+    if (!w->compressor)
+    {
+        w->compressor = csv_compressor_create(G_compression, G_compress_level);
+        if (!w->compressor)
+            return -1;
+    }
+    const char *out;
+    size_t out_len;
+    if (csv_compressor_run(w->compressor, w->buf, w->len, finish, &out, &out_len) != 0)
+    {
+        fprintf(stderr, "Failed to write: %s\n", w->path);
+        return -1;
+    }
+    if (out_len > 0 && write_at(w->fd, out, out_len, (off_t)w->file_len, w->path) != 0)
+        return -1;
+    w->file_len += out_len;
+    if (finish)
+    {
+        csv_compressor_free(w->compressor);
+        w->compressor = NULL;
+    }
+    return 0;
+}
+
+// Writes what is left and ends the compressed stream
+static int finish_compressed(CsvWriter *w)
+{
+    if (acquire_fd(w) != 0 || write_compressed(w, 1) != 0)
+        return -1;
+    w->flushed += w->len;
+    w->len = 0;
+    return 0;
+}
+
+// The table got no row: with skip_empty it gets no file
+static int is_empty_table(const CsvWriter *w)
+{
+    return G_skip_empty && !w->created && w->num_extents == 0 && w->len <= w->header_len;
+}
+
+// Creates the spill log next to the first table that needs it (the same file system, so
+// copy_file_range can move extents without copying them through user space)
+static int open_spill_log(const char *table_path)
+{
+    const char *slash = strrchr(table_path, '/');
+    int dir_len = slash ? (int)(slash - table_path) + 1 : 0;
+    size_t path_len = (size_t)dir_len + 64;
+    char *path = (char *)safe_writer_realloc(NULL, path_len);
+    snprintf(path, path_len, "%.*s.json2relcsv-spill-%ld", dir_len, table_path, (long)getpid());
+    G_spill_fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (G_spill_fd < 0)
+    {
+        perror("Error creating spill log");
+        fprintf(stderr, "Failed to open: %s\n", path);
+        free(path);
+        return -1;
+    }
+    unlink(path); // Nothing to clean up however the program ends
+    free(path);
+    return 0;
+}
+
+// Appends w's buffer to the spill log and records where it went
+static int spill_buffer(CsvWriter *w)
+{
+    if (G_spill_fd < 0 && open_spill_log(w->path) != 0)
+        return -1;
+    if (write_at(G_spill_fd, w->buf, w->len, G_spill_end, "spill log") != 0)
+        return -1;
+    if (w->num_extents > 0 && w->extents[w->num_extents - 1].offset + (off_t)w->extents[w->num_extents - 1].len == G_spill_end)
+        w->extents[w->num_extents - 1].len += w->len; // Continues its previous extent
+    else
+    {
+        if (w->num_extents == w->extents_cap)
+        {
+            w->extents_cap = w->extents_cap ? w->extents_cap * 2 : 8;
+            w->extents = (SpillExtent *)safe_writer_realloc(w->extents, w->extents_cap * sizeof(SpillExtent));
+        }
+        w->extents[w->num_extents].offset = G_spill_end;
+        w->extents[w->num_extents].len = w->len;
+        w->num_extents++;
+    }
+    G_spill_end += (off_t)w->len;
+    w->flushed += w->len;
+    w->len = 0;
+    return 0;
+}
+
+static int copy_extent(int out_fd, const SpillExtent *e, off_t out_off, const char *path)
+{
+    loff_t in = e->offset, out = out_off;
+    size_t left = e->len;
+    while (left > 0 && G_spill_copy_range)
+    {
+        ssize_t n = copy_file_range(G_spill_fd, &in, out_fd, &out, left, 0);
+        if (n > 0)
+        {
+            left -= (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)
+        {
+            perror("Error copying from spill log");
+            fprintf(stderr, "Failed to write: %s\n", path);
+            return -1;
+        }
+        G_spill_copy_range = 0; // Not supported here: copy through a buffer from now on
+    }
+    while (left > 0)
+    {
+        if (!G_spill_bounce)
+            G_spill_bounce = (char *)safe_writer_realloc(NULL, CSV_WRITER_BUFFER_MAX);
+        size_t chunk = left < CSV_WRITER_BUFFER_MAX ? left : CSV_WRITER_BUFFER_MAX;
+        ssize_t n = pread(G_spill_fd, G_spill_bounce, chunk, in);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            perror("Error reading spill log");
+            return -1;
+        }
+        if (write_at(out_fd, G_spill_bounce, (size_t)n, out, path) != 0)
+            return -1;
+        in += n;
+        out += n;
+        left -= (size_t)n;
+    }
+    return 0;
+}
+
+// Writes w's file in one go: its extents of the spill log, then the rest of its buffer
+static int scatter_spilled(CsvWriter *w)
+{
+    int fd = open(w->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        perror("Error opening CSV file for writing");
+        fprintf(stderr, "Failed to open: %s\n", w->path);
+        return -1;
+    }
+    int rc = 0;
+    off_t out = 0;
+    for (size_t i = 0; i < w->num_extents && rc == 0; ++i)
+    {
+        rc = copy_extent(fd, &w->extents[i], out, w->path);
+        out += (off_t)w->extents[i].len;
+    }
+    if (rc == 0)
+        rc = write_at(fd, w->buf, w->len, out, w->path);
+    if (close(fd) != 0)
+    {
+        perror("Error closing CSV file");
+        fprintf(stderr, "Failed to close: %s\n", w->path);
+    }
+    w->created = 1;
+    w->flushed += w->len;
+    w->len = 0;
+    w->num_extents = 0;
+    return rc;
+}
+
+// Maps the next window of w's file with room for n more bytes, growing the file to cover it
+// (the first window takes over the bytes in the heap buffer). Returns -1 if the file cannot be
+// mapped; w is unchanged then.
+static int map_window(CsvWriter *w, size_t n)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t end = w->flushed + w->len; // Logical size of the file so far
+    size_t start = (w->map_base ? end : w->flushed) & ~(page - 1);
+    size_t window = w->map_base ? w->map_len * 2 : CSV_WRITER_MAP_MIN;
+    if (window > CSV_WRITER_MAP_MAX)
+        window = CSV_WRITER_MAP_MAX;
+    while (window < end - start + n)
+        window *= 2;
+
+    int fd = open(w->path, O_RDWR | O_CREAT | (w->created ? 0 : O_TRUNC), 0666);
+    if (fd < 0)
+        return -1;
+    w->created = 1;
+    int rc = fallocate(fd, 0, (off_t)start, (off_t)window); // Reserves the extent's blocks up front
+    if (rc != 0 && (errno == EOPNOTSUPP || errno == ENOSYS))
+    {
+        struct stat st;
+        rc = fstat(fd, &st);
+        if (rc == 0 && (size_t)st.st_size < start + window)
+            rc = ftruncate(fd, (off_t)(start + window));
+    }
+    char *map = rc == 0 ? (char *)mmap(NULL, window, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)start) : (char *)MAP_FAILED;
+    close(fd); // The mapping keeps the file; no descriptor stays open
+    if (map == MAP_FAILED)
+        return -1;
+
+    if (w->map_base)
+        munmap(w->map_base, w->map_len);
+    else
+    {
+        memcpy(map + (w->flushed - start), w->buf, w->len);
+        free(w->buf);
+    }
+    w->map_base = map;
+    w->map_len = window;
+    w->buf = map + (end - start);
+    w->cap = window - (end - start);
+    w->flushed = end;
+    w->len = 0;
+    return 0;
+}
+
+// Unmaps w's file and cuts it to the bytes written (the last extent is only partly used)
+static void unmap_file(CsvWriter *w)
+{
+    size_t end = w->flushed + w->len;
+    munmap(w->map_base, w->map_len);
+    w->map_base = NULL;
+    w->buf = NULL;
+    w->len = w->cap = 0;
+    w->flushed = end;
+    if (truncate(w->path, (off_t)end) != 0)
+    {
+        perror("Error truncating CSV file");
+        fprintf(stderr, "Failed to truncate: %s\n", w->path);
+    }
+}
+
+// Compresses one block on a pool thread and passes it back to the converter thread
+static void compress_block(const WriteJob *job)
+{
+    if (T_compressor)
+        csv_compressor_reset(T_compressor);
+    else
+        T_compressor = csv_compressor_create(G_compression, G_compress_level);
+    CompressedBlock *b = (CompressedBlock *)safe_writer_realloc(NULL, sizeof(CompressedBlock));
+    b->w = job->w;
+    b->seq = job->seq;
+    b->data = NULL;
+    b->len = 0;
+    const char *out;
+    size_t out_len;
+    if (!T_compressor || csv_compressor_run(T_compressor, job->buf, job->len, 1, &out, &out_len) != 0)
+    {
+        fprintf(stderr, "Failed to compress: %s\n", job->w->path);
+        atomic_store(&G_write_failed, 1);
+    }
+    else
+    {
+        b->data = (char *)safe_writer_realloc(NULL, out_len ? out_len : 1);
+        memcpy(b->data, out, out_len);
+        b->len = out_len;
+    }
+    free(job->buf);
+    pthread_mutex_lock(&G_done_lock);
+    b->next = G_done_blocks;
+    G_done_blocks = b;
+    atomic_fetch_add(&G_jobs_done, 1);
+    pthread_cond_broadcast(&G_done_cond);
+    pthread_mutex_unlock(&G_done_lock);
+}
+
+static void *writer_thread(void *arg)
+{
+    (void)arg;
+    for (;;)
+    {
+        WriteJob job;
+        dequeue_job(&job);
+        CsvWriter *w = job.w;
+        if (!w)
+        {
+            csv_compressor_free(T_compressor);
+            T_compressor = NULL;
+            return NULL;
+        }
+        if (job.is_block)
+        {
+            compress_block(&job);
+            continue;
+        }
+        if (job.len > 0 && write_at(job.fd, job.buf, job.len, job.offset, w->path) != 0)
+            atomic_store(&G_write_failed, 1);
+        free(job.buf);
+        // The last job of a closed writer closes its file
+        if (atomic_fetch_sub(&w->pending, 1) == 1 && atomic_load(&w->closing))
+        {
+            if (w->fd >= 0)
+            {
+                if (close(w->fd) != 0)
+                {
+                    perror("Error closing CSV file");
+                    fprintf(stderr, "Failed to close: %s\n", w->path);
+                }
+                atomic_fetch_sub(&G_num_open, 1);
+            }
+            free_writer(w);
+        }
+        atomic_fetch_add(&G_jobs_done, 1);
+        pthread_mutex_lock(&G_done_lock);
+        pthread_cond_broadcast(&G_done_cond);
+        pthread_mutex_unlock(&G_done_lock);
+    }
+}
+
+// Waits until the threads have written everything handed over so far
+static void wait_for_writes(void)
+{
+    pthread_mutex_lock(&G_done_lock);
+    while (atomic_load(&G_jobs_done) != G_queue_tail)
+        pthread_cond_wait(&G_done_cond, &G_done_lock);
+    pthread_mutex_unlock(&G_done_lock);
+}
+
+// Closes the least recently used file that no thread is writing to; returns 0 if there is none
+static int evict_idle_fd(void)
+{
+    for (CsvWriter *w = G_lru_tail; w; w = w->lru_prev)
+        if (atomic_load(&w->pending) == 0)
+        {
+            close_fd(w);
+            return 1;
+        }
+    return 0;
+}
+
+// Makes room in the descriptor pool; returns 0 if nothing can be closed
+static int release_fd(void)
+{
+    if (G_batching && csv_batch_closing() > 0)
+    { // Closed files still hold descriptors until their queued writes are done
+        if (csv_batch_submit() != 0 && !G_in_exit_flush)
+            exit(EXIT_FAILURE);
+        return 1;
+    }
+    if (evict_idle_fd())
+        return 1;
+    if (G_num_threads == 0 || G_jobs_done == G_queue_tail)
+        return 0;
+    wait_for_writes(); // Every open file has writes in flight (or is being closed)
+    return 1;
+}
+
+// Opens w's file if needed (closing the least recently used one when the pool is full)
+static int acquire_fd(CsvWriter *w)
+{
+    if (w->fd >= 0)
+    {
+        if (G_lru_head != w)
+        {
+            lru_unlink(w);
+            lru_push_front(w);
+        }
+        return 0;
+    }
+    while (atomic_load(&G_num_open) + (G_batching ? csv_batch_closing() : 0) >= max_open() && release_fd())
+        ;
+    int flags = O_WRONLY | O_CREAT | (w->created ? 0 : O_TRUNC);
+    w->fd = open(w->path, flags, 0666);
+    while (w->fd < 0 && (errno == EMFILE || errno == ENFILE) && release_fd())
+    { // Fewer descriptors than expected: shrink the pool
+        w->fd = open(w->path, flags, 0666);
+    }
+    if (w->fd < 0)
+    {
+        perror("Error opening CSV file for writing");
+        fprintf(stderr, "Failed to open: %s\n", w->path);
+        return -1;
+    }
+    w->created = 1;
+    if (G_batching)
+        w->file_slot = csv_batch_open_file(w->fd, w->path);
+    lru_push_front(w);
+    atomic_fetch_add(&G_num_open, 1);
+    return 0;
+}
+
+// Passes w's buffer (and, when closing, w itself) to the writer threads
+static void hand_off(CsvWriter *w, int closing)
+{
+    WriteJob job = {w, w->fd, w->buf, w->len, (off_t)w->flushed, 0, 0};
+    w->flushed += w->len;
+    w->len = 0;
+    w->buf = closing ? NULL : (char *)safe_writer_realloc(NULL, w->cap);
+    atomic_fetch_add(&w->pending, 1);
+    if (closing)
+        atomic_store(&w->closing, 1); // From here on w belongs to the threads
+    enqueue_job(&job);
+}
+
+// Writes w's compressed blocks that are next in sequence; a closed table whose blocks are all
+// written is closed and freed. Failures are left in G_write_failed so every block is accounted for.
+static void write_ready_blocks(CsvWriter *w)
+{
+    while (w->ready_blocks && w->ready_blocks->seq == w->blocks_written)
+    {
+        CompressedBlock *b = w->ready_blocks;
+        w->ready_blocks = b->next;
+        if (!atomic_load(&G_write_failed) &&
+            (acquire_fd(w) != 0 || write_at(w->fd, b->data, b->len, (off_t)w->file_len, w->path) != 0))
+            atomic_store(&G_write_failed, 1);
+        w->file_len += b->len;
+        w->blocks_written++;
+        G_blocks_outstanding--;
+        free(b->data);
+        free(b);
+    }
+    if (atomic_load(&w->closing) && w->blocks_written == w->blocks_issued)
+    {
+        close_fd(w);
+        free_writer(w);
+    }
+}
+
+// Takes the blocks the threads have finished (waiting for one with wait) and writes what it can
+static void collect_blocks(int wait)
+{
+    pthread_mutex_lock(&G_done_lock);
+    while (wait && !G_done_blocks)
+        pthread_cond_wait(&G_done_cond, &G_done_lock);
+    CompressedBlock *b = G_done_blocks;
+    G_done_blocks = NULL;
+    pthread_mutex_unlock(&G_done_lock);
+    while (b)
+    {
+        CompressedBlock *next = b->next;
+        CompressedBlock **at = &b->w->ready_blocks; // Kept sorted by seq
+        while (*at && (*at)->seq < b->seq)
+            at = &(*at)->next;
+        b->next = *at;
+        *at = b;
+        if (b->seq == b->w->blocks_written)
+            write_ready_blocks(b->w);
+        b = next;
+    }
+    if (atomic_load(&G_write_failed) && !G_in_exit_flush)
+        exit(EXIT_FAILURE);
+}
+
+static void wait_for_blocks(void)
+{
+    while (G_blocks_outstanding > 0)
+        collect_blocks(1);
+}
+
+// Hands w's buffer to the compression pool as its next block
+static void hand_off_block(CsvWriter *w)
+{
+    WriteJob job = {w, -1, w->buf, w->len, 0, 1, w->blocks_issued++};
+    w->flushed += w->len;
+    w->len = 0;
+    w->buf = (char *)safe_writer_realloc(NULL, w->cap);
+    G_blocks_outstanding++;
+    enqueue_job(&job);
+    collect_blocks(0);
+}
+
+static void flush_all_at_exit(void)
+{
+    G_in_exit_flush = 1;
+    for (size_t i = 0; i < G_num_writers; ++i)
+    {
+        CsvWriter *w = G_writers[i];
+        if (w->map_base)
+            unmap_file(w);
+        else if (G_spill_output)
+        {
+            if (!is_empty_table(w))
+                scatter_spilled(w);
+        }
+        else if (G_block_compression)
+        {
+            if (w->len > 0 && !is_empty_table(w))
+                hand_off_block(w);
+        }
+        else if (G_compression)
+        {
+            if (!is_empty_table(w))
+                finish_compressed(w);
+        }
+        else if (w->len > 0 && !is_empty_table(w))
+            csv_writer_flush(w);
+    }
+    if (G_block_compression)
+        wait_for_blocks();
+    if (G_num_threads > 0)
+        wait_for_writes();
+    if (G_batching)
+        csv_batch_submit();
+}
+
+CsvWriter *csv_writer_create(const char *path)
+{
+    CsvWriter *w = (CsvWriter *)safe_writer_realloc(NULL, sizeof(CsvWriter));
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->file_slot = -1;
+    w->cap = CSV_WRITER_BUFFER_MIN;
+    w->buf = (char *)safe_writer_realloc(NULL, w->cap);
+    const char *suffix = csv_compress_suffix(G_compression);
+    size_t path_len = strlen(path), suffix_len = strlen(suffix);
+    w->path = (char *)safe_writer_realloc(NULL, path_len + suffix_len + 1);
+    memcpy(w->path, path, path_len);
+    memcpy(w->path + path_len, suffix, suffix_len + 1);
+
+    if (G_num_writers == G_writers_cap)
+    {
+        G_writers_cap = G_writers_cap ? G_writers_cap * 2 : 64;
+        G_writers = (CsvWriter **)safe_writer_realloc(G_writers, G_writers_cap * sizeof(CsvWriter *));
+    }
+    w->registry_index = G_num_writers;
+    G_writers[G_num_writers++] = w;
+    if (!G_exit_flush_registered)
+    {
+        atexit(flush_all_at_exit); // An error exit keeps the rows written so far, as stdio did
+        G_exit_flush_registered = 1;
+    }
+    return w;
+}
+
+void csv_writer_end_header(CsvWriter *w)
+{
+    w->header_len = w->flushed + w->len;
+}
+
+void csv_writer_flush(CsvWriter *w)
+{
+    if ((w->len == 0 && w->created) || w->map_base)
+        return; // A mapped file is written as its pages are
+    if (atomic_load(&G_write_failed) && !G_in_exit_flush)
+        exit(EXIT_FAILURE); // A writer thread has reported it
+    if (G_spill_output)
+    {
+        if (w->len > 0 && spill_buffer(w) != 0 && !G_in_exit_flush)
+            exit(EXIT_FAILURE);
+        return;
+    }
+    if (G_block_compression)
+    {
+        hand_off_block(w);
+        return;
+    }
+    if (acquire_fd(w) != 0)
+    {
+        if (G_in_exit_flush)
+            return;
+        exit(EXIT_FAILURE);
+    }
+    if (G_num_threads > 0)
+    {
+        hand_off(w, 0);
+        return;
+    }
+    if (G_batching)
+    {
+        if (csv_batch_add(w->file_slot, &w->buf, w->len, w->cap, (off_t)w->flushed) != 0 && !G_in_exit_flush)
+            exit(EXIT_FAILURE);
+        w->flushed += w->len;
+        w->len = 0;
+        return;
+    }
+    if (G_compression ? write_compressed(w, 0) != 0 : write_at(w->fd, w->buf, w->len, (off_t)w->flushed, w->path) != 0)
+    {
+        if (G_in_exit_flush)
+            return;
+        exit(EXIT_FAILURE);
+    }
+    w->flushed += w->len;
+    w->len = 0;
+}
+
+void csv_writer_reserve(CsvWriter *w, size_t n)
+{
+    if (w->cap - w->len >= n)
+        return;
+    if (w->map_base)
+    {
+        if (map_window(w, n) == 0)
+            return;
+        // The next window could not be mapped: the rest of the file is written normally
+        unmap_file(w);
+        w->map_failed = 1;
+        w->cap = CSV_WRITER_BUFFER_MAX;
+        w->buf = (char *)safe_writer_realloc(NULL, w->cap);
+    }
+    if (w->len + n <= CSV_WRITER_BUFFER_MAX)
+    {
+        size_t cap = w->cap;
+        while (cap < w->len + n)
+            cap *= 2;
+        w->cap = cap < CSV_WRITER_BUFFER_MAX ? cap : CSV_WRITER_BUFFER_MAX;
+        w->buf = (char *)safe_writer_realloc(w->buf, w->cap);
+        return;
+    }
+    if (G_mapped_output && !w->map_failed)
+    { // The table outgrew its buffer: from now on it is written through a mapping
+        if (map_window(w, n) == 0)
+            return;
+        w->map_failed = 1;
+    }
+    csv_writer_flush(w);
+    if (n > w->cap)
+    { // A single field larger than the buffer
+        w->cap = n;
+        w->buf = (char *)safe_writer_realloc(w->buf, w->cap);
+    }
+}
+
+void csv_writer_printf(CsvWriter *w, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    size_t room = w->cap - w->len;
+    int n = vsnprintf(w->buf + w->len, room, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if ((size_t)n >= room)
+    {
+        csv_writer_reserve(w, (size_t)n + 1);
+        va_start(ap, fmt);
+        vsnprintf(w->buf + w->len, (size_t)n + 1, fmt, ap);
+        va_end(ap);
+    }
+    w->len += (size_t)n;
+}
+
+void csv_writer_close(CsvWriter *w)
+{
+    if (!w)
+        return;
+    int write_file = !is_empty_table(w);
+    G_writers[w->registry_index] = G_writers[--G_num_writers];
+    G_writers[w->registry_index]->registry_index = w->registry_index;
+    if (G_num_writers == 0)
+    {
+        free(G_writers);
+        G_writers = NULL;
+        G_writers_cap = 0;
+    }
+    if (G_block_compression && write_file)
+    { // Closed and freed once its last block is written
+        if (w->len > 0 || w->blocks_issued == 0)
+            hand_off_block(w);
+        atomic_store(&w->closing, 1);
+        write_ready_blocks(w);
+        return;
+    }
+    if (G_num_threads > 0 && write_file)
+    { // The thread that finishes its last write closes the file and frees w
+        if (atomic_load(&G_write_failed))
+            exit(EXIT_FAILURE);
+        if ((w->len > 0 || !w->created) && acquire_fd(w) != 0)
+            exit(EXIT_FAILURE);
+        if (w->fd >= 0)
+            lru_unlink(w);
+        hand_off(w, 1);
+        return;
+    }
+    if (w->map_base)
+        unmap_file(w);
+    if (G_spill_output)
+    {
+        if (write_file && scatter_spilled(w) != 0)
+            exit(EXIT_FAILURE);
+    }
+    else if (G_compression)
+    {
+        if (write_file && finish_compressed(w) != 0)
+            exit(EXIT_FAILURE);
+    }
+    else if (write_file)
+        csv_writer_flush(w);
+    close_fd(w);
+    free_writer(w);
+}
+
+int csv_writers_finish(void)
+{
+    int rc = 0;
+    if (G_spill_fd >= 0)
+    {
+        close(G_spill_fd);
+        G_spill_fd = -1;
+        G_spill_end = 0;
+    }
+    free(G_spill_bounce);
+    G_spill_bounce = NULL;
+    if (G_batching)
+    {
+        rc = csv_batch_submit();
+        csv_batch_shutdown();
+        G_batching = 0;
+    }
+    if (G_block_compression)
+    {
+        wait_for_blocks();
+        G_block_compression = 0;
+    }
+    if (G_num_threads > 0)
+    {
+        WriteJob stop = {NULL, -1, NULL, 0, 0, 0, 0};
+        for (int i = 0; i < G_num_threads; ++i)
+            enqueue_job(&stop);
+        for (int i = 0; i < G_num_threads; ++i)
+            pthread_join(G_threads[i], NULL);
+        free(G_threads);
+        G_threads = NULL;
+        G_num_threads = 0;
+        sem_destroy(&G_queue_jobs);
+        sem_destroy(&G_queue_free);
+    }
+    return atomic_load(&G_write_failed) ? -1 : rc;
+}
@@ -0,0 +1,118 @@
+// csv_writer.h
+#ifndef CSV_WRITER_H
+#define CSV_WRITER_H
+
+#include <stddef.h> // For size_t
+#include <string.h> // For memcpy
+#include <stdatomic.h>
+#include <sys/types.h> // For off_t
+
+#include "csv_compress.h"
+
+// Buffered output files for the CSV tables.
+//
+// Each table writes into its own memory buffer; a full buffer is flushed with write(2). File
+// descriptors come from a pool of at most max_open_files: when it is full, the least recently
+// flushed file is closed and reopened in append mode the next time it needs one, so a document
+// may produce any number of tables. Buffers start small and grow up to CSV_WRITER_BUFFER_MAX,
+// so thousands of mostly idle tables stay cheap. Files are created by their first flush.
+// With writer threads, flushing hands the buffer to a thread and continues with a new one; at
+// most CSV_WRITER_QUEUE_LEN buffers wait to be written before the converter blocks. With a
+// batching I/O backend, flushes are queued and written many at a time (csv_batch.h). In mapped
+// mode, a table that outgrows its buffer continues straight into a shared mapping of its file,
+// which is grown in doubling extents and cut to its real size when the table is closed. In
+// spill mode, full buffers of every table are appended to one log file instead, and a table's
+// file is written in one go when it is closed: its extents of the log (copy_file_range), then
+// the rest of its buffer. With compression, flushed buffers go through the table's compressor
+// and the file gets the codec's suffix.
+
+#define CSV_WRITER_BUFFER_MIN 4096
+#define CSV_WRITER_BUFFER_MAX (256 * 1024)
+#define CSV_WRITER_QUEUE_LEN 64 // Buffers handed to the writer threads and not written yet
+#define CSV_WRITER_MAP_MIN (1024 * 1024)      // First extent of a mapped file
+#define CSV_WRITER_MAP_MAX (64 * 1024 * 1024) // Extents double up to this size
+
+typedef enum
+{
+    CSV_IO_WRITE,   // One pwrite per flush
+    CSV_IO_PWRITEV, // Batched, one pwritev per run of buffers of the same file
+    CSV_IO_URING,   // Batched, one io_uring submission per batch (pwritev if unavailable)
+    CSV_IO_MMAP,    // Tables larger than their buffer are formatted straight into a file mapping
+    CSV_IO_SPILL    // Flushes are appended to one spill log, scattered to the files on close
+} CsvIoBackend;
+
+typedef struct SpillExtent
+{
+    off_t offset; // In the spill log
+    size_t len;
+} SpillExtent;
+
+typedef struct CsvWriter
+{
+    char *buf;
+    size_t len, cap;
+    char *path;
+    int fd;               // -1 while the file is not open
+    int file_slot;        // Its csv_batch slot while open (batching backends)
+    char *map_base;       // Mapped window of the file (buf points into it), or NULL
+    size_t map_len;
+    int map_failed;       // Mapping did not work for this file: it is written normally
+    SpillExtent *extents; // Where its flushed bytes are in the spill log, in order
+    CsvCompressor *compressor; // Created by the first flush when compressing
+    size_t file_len;      // Compressed bytes written so far
+    size_t blocks_issued, blocks_written; // Parallel block compression
+    struct CompressedBlock *ready_blocks; // Compressed and waiting for earlier blocks, by seq
+    size_t num_extents, extents_cap;
+    int created;          // The file exists (later opens append to it)
+    size_t flushed;       // Bytes already written to the file
+    size_t header_len;    // Bytes of the header (csv_writer_end_header)
+    struct CsvWriter *lru_prev, *lru_next; // Open files, most recently used first
+    size_t registry_index; // Position in the list of live writers
+    atomic_int pending;    // Buffers handed to the writer threads and not written yet
+    atomic_int closing;    // Closed: the thread writing the last buffer closes the file and frees it
+} CsvWriter;
+
+// max_open_files: size of the descriptor pool (0: derived from RLIMIT_NOFILE).
+// skip_empty: tables that receive no row get no file at all (not even a header).
+// writer_threads: threads doing the writes (0: the caller writes synchronously).
+// io_backend: how the caller's writes reach the files (not combinable with writer_threads).
+void csv_writers_configure(int max_open_files, int skip_empty, int writer_threads, CsvIoBackend io_backend);
+// Compresses every file from now on (only with CSV_IO_WRITE and no writer threads). With
+// block_threads, each flushed buffer is compressed as an independent block on that many threads.
+void csv_writers_set_compression(CsvCompression c, int level, int block_threads);
+// Waits for the writer threads to finish and stops them. Returns -1 if a write failed.
+int csv_writers_finish(void);
+
+CsvWriter *csv_writer_create(const char *path); // Nothing is written to disk yet
+void csv_writer_end_header(CsvWriter *w);       // What was written so far is the header
+// Writes the buffer out, or hands it to a writer thread (creating or reopening the file first).
+// Exits on I/O errors like fopen failures did.
+void csv_writer_flush(CsvWriter *w);
+// Flushes, closes and frees w. A table with only a header gets a header-only file, or none
+// with skip_empty.
+void csv_writer_close(CsvWriter *w);
+
+// Makes room for at least n more bytes in the buffer
+void csv_writer_reserve(CsvWriter *w, size_t n);
+
+static inline void csv_writer_write(CsvWriter *w, const char *data, size_t n)
+{
+    if (w->cap - w->len < n)
+        csv_writer_reserve(w, n);
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+}
+
+static inline void csv_writer_putc(CsvWriter *w, char c)
+{
+    csv_writer_write(w, &c, 1);
+}
+
+static inline void csv_writer_puts(CsvWriter *w, const char *s)
+{
+    csv_writer_write(w, s, strlen(s));
+}
+
+void csv_writer_printf(CsvWriter *w, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif // CSV_WRITER_H
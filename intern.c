@@ -0,0 +1,125 @@
+// intern.c
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "intern.h"
+
+typedef struct InternEntry
+{
+    char *str;     // NULL: empty slot
+    uint64_t hash;
+    unsigned int id;
+} InternEntry;
+
+typedef struct InternShard
+{
+    pthread_mutex_t lock;
+    InternEntry *slots;
+    size_t cap, count; // cap is 0 or a power of two
+} InternShard;
+
+static InternShard G_shards[INTERN_SHARDS];
+static pthread_once_t G_shards_once = PTHREAD_ONCE_INIT;
+static atomic_uint G_next_id = 1;
+
+static void init_shards(void)
+{
+    for (int i = 0; i < INTERN_SHARDS; ++i)
+        pthread_mutex_init(&G_shards[i].lock, NULL);
+}
+
+// FNV-1a
+static uint64_t hash_string(const char *s)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; ++s)
+    {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Slot for hash/str: the entry holding str, or the empty slot where it belongs
+static InternEntry *find_slot(InternShard *shard, uint64_t hash, const char *str)
+{
+    size_t mask = shard->cap - 1;
+    size_t i = (size_t)(hash / INTERN_SHARDS) & mask; // The low bits picked the shard
+    while (shard->slots[i].str &&
+           (shard->slots[i].hash != hash || strcmp(shard->slots[i].str, str) != 0))
+        i = (i + 1) & mask;
+    return &shard->slots[i];
+}
+
+static void grow_shard(InternShard *shard)
+{
+    InternEntry *old_slots = shard->slots;
+    size_t old_cap = shard->cap;
+    shard->cap = old_cap ? old_cap * 2 : 256;
+    shard->slots = (InternEntry *)calloc(shard->cap, sizeof(InternEntry));
+    if (!shard->slots)
+    {
+        perror("Error: intern table calloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_cap; ++i)
+    {
+        if (old_slots[i].str)
+            *find_slot(shard, old_slots[i].hash, old_slots[i].str) = old_slots[i];
+    }
+    free(old_slots);
+}
+
+const char *intern_string(char *str, unsigned int *id_out)
+{
+    pthread_once(&G_shards_once, init_shards);
+    uint64_t hash = hash_string(str);
+    InternShard *shard = &G_shards[hash % INTERN_SHARDS];
+
+    pthread_mutex_lock(&shard->lock);
+    if ((shard->count + 1) * 4 > shard->cap * 3) // Keep the load factor under 3/4
+        grow_shard(shard);
+    InternEntry *slot = find_slot(shard, hash, str);
+    if (slot->str)
+    {
+        free(str);
+    }
+    else
+    {
+        slot->str = str;
+        slot->hash = hash;
+        slot->id = atomic_fetch_add(&G_next_id, 1);
+        shard->count++;
+    }
+    const char *shared = slot->str;
+    *id_out = slot->id;
+    pthread_mutex_unlock(&shard->lock);
+    return shared;
+}
+
+unsigned int intern_count(void)
+{
+    return atomic_load(&G_next_id) - 1;
+}
+
+void intern_clear(void)
+{
+    pthread_once(&G_shards_once, init_shards);
+    for (int s = 0; s < INTERN_SHARDS; ++s)
+    {
+        InternShard *shard = &G_shards[s];
+        pthread_mutex_lock(&shard->lock);
+        for (size_t i = 0; i < shard->cap; ++i)
+            free(shard->slots[i].str);
+        free(shard->slots);
+        shard->slots = NULL;
+        shard->cap = shard->count = 0;
+        pthread_mutex_unlock(&shard->lock);
+    }
+    atomic_store(&G_next_id, 1);
+}
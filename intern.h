@@ -0,0 +1,22 @@
+// intern.h
+#ifndef INTERN_H
+#define INTERN_H
+
+// Process-wide table of string values (--intern).
+//
+// Identical strings share one allocation and get a small dense ID (1, 2, 3...), which the CSV
+// writer uses to cache each value's escaped bytes. The table is split into INTERN_SHARDS
+// independently locked open-addressing tables (picked by hash), so the parallel parser threads
+// can intern concurrently without contending on a single lock.
+
+#define INTERN_SHARDS 64
+
+// Returns the shared copy of str and stores its ID in *id_out. Takes ownership of str (a heap
+// string): it either becomes the shared copy or is freed. Shared copies live until intern_clear.
+const char *intern_string(char *str, unsigned int *id_out);
+// Number of IDs handed out so far (every ID is <= this)
+unsigned int intern_count(void);
+// Frees every shared string. No interned string may be used afterwards.
+void intern_clear(void);
+
+#endif // INTERN_H
@@ -0,0 +1,679 @@
+// json_index.c
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_index.h"
+#include "json_source.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define JSON_INDEX_X86 1
+#include <immintrin.h>
+#endif
+
+// Bit masks describing one 64-byte block (bit i <=> byte i)
+typedef struct BlockMasks
+{
+    uint64_t quote;     // '"'
+    uint64_t backslash; // '\\'
+    uint64_t op;        // { } [ ] , :
+    uint64_t ws;        // space, \t, \r, \n
+} BlockMasks;
+
+typedef void (*ClassifyFn)(const unsigned char *block, BlockMasks *m);
+
+#ifndef JSON_INDEX_X86
+static void classify_portable(const unsigned char *block, BlockMasks *m)
+{
+    uint64_t quote = 0, backslash = 0, op = 0, ws = 0;
+    for (int i = 0; i < 64; ++i)
+    {
+        uint64_t bit = 1ULL << i;
+        switch (block[i])
+        {
+        case '"':
+            quote |= bit;
+            break;
+        case '\\':
+            backslash |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ',':
+        case ':':
+            op |= bit;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            ws |= bit;
+            break;
+        default:
+            break;
+        }
+    }
+    m->quote = quote;
+    m->backslash = backslash;
+    m->op = op;
+    m->ws = ws;
+}
+#endif
+
+#ifdef JSON_INDEX_X86
+static void classify_sse2(const unsigned char *block, BlockMasks *m)
+{
+    const __m128i q = _mm_set1_epi8('"');
+    const __m128i bs = _mm_set1_epi8('\\');
+    const __m128i lbrace = _mm_set1_epi8('{'), rbrace = _mm_set1_epi8('}');
+    const __m128i lbracket = _mm_set1_epi8('['), rbracket = _mm_set1_epi8(']');
+    const __m128i comma = _mm_set1_epi8(','), colon = _mm_set1_epi8(':');
+    const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r'), nl = _mm_set1_epi8('\n');
+    uint64_t quote = 0, backslash = 0, op = 0, ws = 0;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(block + 16 * i));
+        __m128i o = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lbrace), _mm_cmpeq_epi8(v, rbrace)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, lbracket), _mm_cmpeq_epi8(v, rbracket)));
+        o = _mm_or_si128(o, _mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, colon)));
+        __m128i w = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, nl)));
+        int shift = 16 * i;
+        quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, q)) << shift;
+        backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, bs)) << shift;
+        op |= (uint64_t)(uint16_t)_mm_movemask_epi8(o) << shift;
+        ws |= (uint64_t)(uint16_t)_mm_movemask_epi8(w) << shift;
+    }
+    m->quote = quote;
+    m->backslash = backslash;
+    m->op = op;
+    m->ws = ws;
+}
+
+__attribute__((target("avx2"))) static void classify_avx2(const unsigned char *block, BlockMasks *m)
+{
+    const __m256i q = _mm256_set1_epi8('"');
+    const __m256i bs = _mm256_set1_epi8('\\');
+    const __m256i lbrace = _mm256_set1_epi8('{'), rbrace = _mm256_set1_epi8('}');
+    const __m256i lbracket = _mm256_set1_epi8('['), rbracket = _mm256_set1_epi8(']');
+    const __m256i comma = _mm256_set1_epi8(','), colon = _mm256_set1_epi8(':');
+    const __m256i space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r'), nl = _mm256_set1_epi8('\n');
+    uint64_t quote = 0, backslash = 0, op = 0, ws = 0;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(block + 32 * i));
+        __m256i o = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, lbrace), _mm256_cmpeq_epi8(v, rbrace)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, lbracket), _mm256_cmpeq_epi8(v, rbracket)));
+        o = _mm256_or_si256(o, _mm256_or_si256(_mm256_cmpeq_epi8(v, comma), _mm256_cmpeq_epi8(v, colon)));
+        __m256i w = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, nl)));
+        int shift = 32 * i;
+        quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, q)) << shift;
+        backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, bs)) << shift;
+        op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(o) << shift;
+        ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(w) << shift;
+    }
+    m->quote = quote;
+    m->backslash = backslash;
+    m->op = op;
+    m->ws = ws;
+}
+#endif
+
+static ClassifyFn pick_classifier(const char **name)
+{
+#ifdef JSON_INDEX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        *name = "avx2";
+        return classify_avx2;
+    }
+    *name = "sse2";
+    return classify_sse2;
+#else
+    *name = "portable";
+    return classify_portable;
+#endif
+}
+
+const char *json_index_kernel_name(void)
+{
+    const char *name;
+    pick_classifier(&name);
+    return name;
+}
+
+// Carried between blocks
+typedef struct Stage1State
+{
+    uint64_t prev_odd_backslash; // 1 if the previous block ended in an odd run of backslashes
+    uint64_t prev_in_string;     // All ones if the previous block ended inside a string
+    uint64_t prev_scalar;        // 1 if the previous block ended in the middle of a scalar
+} Stage1State;
+
+// Bits of characters that are escaped by an odd-length run of backslashes.
+static uint64_t find_escaped(uint64_t backslash, uint64_t *prev_odd_backslash)
+{
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    const uint64_t odd_bits = ~even_bits;
+
+    uint64_t start_edges = backslash & ~(backslash << 1);
+    uint64_t even_start_mask = even_bits ^ *prev_odd_backslash;
+    uint64_t even_starts = start_edges & even_start_mask;
+    uint64_t odd_starts = start_edges & ~even_start_mask;
+    uint64_t even_carries = backslash + even_starts;
+    uint64_t odd_carries = backslash + odd_starts;
+    int ends_odd_backslash = odd_carries < backslash; // Carry out of bit 63
+    odd_carries |= *prev_odd_backslash;
+    *prev_odd_backslash = ends_odd_backslash ? 1ULL : 0ULL;
+
+    uint64_t even_carry_ends = even_carries & ~backslash;
+    uint64_t odd_carry_ends = odd_carries & ~backslash;
+    uint64_t even_start_odd_end = even_carry_ends & odd_bits;
+    uint64_t odd_start_even_end = odd_carry_ends & even_bits;
+    return even_start_odd_end | odd_start_even_end;
+}
+
+// Bit i of the result is the XOR of bits 0..i of x (marks everything between quote pairs).
+static uint64_t prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static uint64_t block_structurals(Stage1State *st, const BlockMasks *m)
+{
+    uint64_t quote_bits = m->quote & ~find_escaped(m->backslash, &st->prev_odd_backslash);
+    uint64_t in_string = prefix_xor(quote_bits) ^ st->prev_in_string;
+    st->prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+    // First byte of each run of non-structural, non-whitespace bytes (numbers and literals)
+    uint64_t scalar = ~(m->op | m->ws | quote_bits);
+    uint64_t follows_scalar = (scalar << 1) | st->prev_scalar;
+    st->prev_scalar = scalar >> 63;
+    uint64_t scalar_starts = scalar & ~follows_scalar;
+
+    return ((m->op | scalar_starts) & ~in_string) | quote_bits;
+}
+
+static size_t flatten_bits(uint64_t bits, uint32_t base, uint32_t *out)
+{
+    size_t n = 0;
+    while (bits)
+    {
+        out[n++] = base + (uint32_t)__builtin_ctzll(bits);
+        bits &= bits - 1;
+    }
+    return n;
+}
+
+int json_index_build(JsonIndex *idx, const char *data, size_t len)
+{
+    memset(idx, 0, sizeof(*idx));
+    if (len >= JSON_INDEX_MAX_INPUT)
+        return -1;
+    idx->data = data;
+    idx->len = len;
+    // At most one entry per input byte, plus the padding of the last block
+    idx->positions = (uint32_t *)malloc((len + 64) * sizeof(uint32_t));
+    if (!idx->positions)
+        return -1;
+
+    const char *kernel_name;
+    ClassifyFn classify = pick_classifier(&kernel_name);
+    Stage1State st = {0, 0, 0};
+    BlockMasks m;
+    size_t count = 0;
+    size_t off = 0;
+
+    for (; off + 64 <= len; off += 64)
+    {
+        classify((const unsigned char *)data + off, &m);
+        count += flatten_bits(block_structurals(&st, &m), (uint32_t)off, idx->positions + count);
+    }
+    if (off < len)
+    {
+        // Pad the tail with whitespace so it classifies like the end of the document
+        unsigned char tail[64];
+        memset(tail, ' ', sizeof(tail));
+        memcpy(tail, data + off, len - off);
+        classify(tail, &m);
+        count += flatten_bits(block_structurals(&st, &m), (uint32_t)off, idx->positions + count);
+    }
+    idx->count = count;
+    return 0;
+}
+
+void json_index_free(JsonIndex *idx)
+{
+    if (!idx)
+        return;
+    free(idx->positions);
+    memset(idx, 0, sizeof(*idx));
+}
+
+static int is_scalar_delimiter(char c)
+{
+    switch (c)
+    {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ',':
+    case ':':
+    case '"':
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+enum
+{
+    CONTAINER_OBJECT,
+    CONTAINER_ARRAY
+};
+
+size_t json_index_matching_close(const JsonIndex *idx, size_t open_entry)
+{
+    const char *buf = idx->data;
+    const uint32_t *pos = idx->positions;
+    size_t depth = 0;
+    for (size_t j = open_entry; j < idx->count; ++j)
+    {
+        switch (buf[pos[j]])
+        {
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            if (--depth == 0)
+                return j;
+            break;
+        default:
+            break;
+        }
+    }
+    return idx->count;
+}
+
+int json_index_walk(const JsonIndex *idx, JsonEventHandler handler, void *ctx)
+{
+    return json_index_walk_value(idx, 0, handler, ctx, NULL);
+}
+
+int json_index_walk_value(const JsonIndex *idx, size_t first_entry, JsonEventHandler handler, void *ctx, size_t *next_entry)
+{
+    const char *buf = idx->data;
+    const char *end = idx->data + idx->len;
+    const uint32_t *pos = idx->positions;
+    size_t n = idx->count;
+    size_t i = first_entry;
+    int rc;
+
+    unsigned char *stack = NULL; // Kinds of the open containers
+    size_t depth = 0, stack_cap = 0;
+    size_t err_offset = 0;
+    JsonEvent ev;
+
+#define EMIT(t, txt, l, at)                 \
+    do                                      \
+    {                                       \
+        ev.type = (t);                      \
+        ev.text = (txt);                    \
+        ev.len = (l);                       \
+        ev.index_pos = (at);                \
+        rc = handler(ctx, &ev);             \
+        if (rc < 0)                         \
+            goto aborted;                   \
+    } while (0)
+
+#define PUSH(kind)                                                                       \
+    do                                                                                   \
+    {                                                                                    \
+        if (depth == stack_cap)                                                          \
+        {                                                                                \
+            stack_cap = stack_cap ? stack_cap * 2 : 64;                                  \
+            unsigned char *grown = (unsigned char *)realloc(stack, stack_cap);           \
+            if (!grown)                                                                  \
+            {                                                                            \
+                perror("Error: json_index stack realloc failed");                       \
+                exit(EXIT_FAILURE);                                                      \
+            }                                                                            \
+            stack = grown;                                                               \
+        }                                                                                \
+        stack[depth++] = (kind);                                                         \
+    } while (0)
+
+value:
+    if (i >= n)
+        goto unexpected_end;
+    {
+        size_t off = pos[i];
+        const char *p = buf + off;
+        switch (*p)
+        {
+        case '{':
+            EMIT(JSON_EVENT_BEGIN_OBJECT, p, 1, i);
+            if (rc == JSON_WALK_SKIP)
+                goto skip_container;
+            i++;
+            if (i < n && buf[pos[i]] == '}')
+            {
+                EMIT(JSON_EVENT_END_OBJECT, buf + pos[i], 1, i);
+                i++;
+                goto after_value;
+            }
+            PUSH(CONTAINER_OBJECT);
+            goto object_key;
+        case '[':
+            EMIT(JSON_EVENT_BEGIN_ARRAY, p, 1, i);
+            if (rc == JSON_WALK_SKIP)
+                goto skip_container;
+            i++;
+            if (i < n && buf[pos[i]] == ']')
+            {
+                EMIT(JSON_EVENT_END_ARRAY, buf + pos[i], 1, i);
+                i++;
+                goto after_value;
+            }
+            PUSH(CONTAINER_ARRAY);
+            goto value;
+        case '"':
+            if (i + 1 >= n)
+            { // Unterminated string: flex rejects the opening quote
+                json_report_lexical_error(buf, idx->len, off);
+                goto failed;
+            }
+            EMIT(JSON_EVENT_STRING, p, pos[i + 1] - off + 1, i);
+            i += 2;
+            goto after_value;
+        case '}':
+        case ']':
+        case ',':
+        case ':':
+            err_offset = off;
+            goto unexpected;
+        default:
+        {
+            size_t tok_len = json_scan_literal(p, end);
+            JsonEventType t;
+            if (tok_len > 0)
+                t = (*p == 't') ? JSON_EVENT_TRUE : (*p == 'f') ? JSON_EVENT_FALSE : JSON_EVENT_NULL;
+            else
+            {
+                tok_len = json_scan_number(p, end);
+                t = JSON_EVENT_NUMBER;
+            }
+            if (tok_len == 0)
+            {
+                err_offset = off;
+                goto unexpected;
+            }
+            EMIT(t, p, tok_len, i);
+            if (p + tok_len < end && !is_scalar_delimiter(p[tok_len]))
+            { // Rest of the scalar run is another lexeme (e.g. the ".56" in 12.34.56)
+                err_offset = off + tok_len;
+                goto unexpected;
+            }
+            i++;
+            goto after_value;
+        }
+        }
+    }
+
+skip_container:
+{
+    // Leave the whole subtree unparsed: jump to the matching bracket
+    size_t close = json_index_matching_close(idx, i);
+    if (close >= n)
+        goto unexpected_end;
+    EMIT(JSON_EVENT_SKIPPED, buf + pos[close], 1, close);
+    i = close + 1;
+    goto after_value;
+}
+
+object_key:
+    if (i >= n)
+        goto unexpected_end;
+    if (buf[pos[i]] != '"')
+    {
+        err_offset = pos[i];
+        goto unexpected;
+    }
+    if (i + 1 >= n)
+    {
+        json_report_lexical_error(buf, idx->len, pos[i]);
+        goto failed;
+    }
+    EMIT(JSON_EVENT_KEY, buf + pos[i], pos[i + 1] - pos[i] + 1, i);
+    i += 2;
+    if (i >= n)
+        goto unexpected_end;
+    if (buf[pos[i]] != ':')
+    {
+        err_offset = pos[i];
+        goto unexpected;
+    }
+    i++;
+    goto value;
+
+after_value:
+    if (depth == 0)
+    {
+        if (next_entry)
+        { // Caller parses one value and handles whatever follows
+            *next_entry = i;
+            free(stack);
+            return 0;
+        }
+        if (i < n)
+        {
+            err_offset = pos[i];
+            goto unexpected;
+        }
+        free(stack);
+        return 0;
+    }
+    if (i >= n)
+        goto unexpected_end;
+    {
+        char c = buf[pos[i]];
+        if (c == ',')
+        {
+            i++;
+            if (stack[depth - 1] == CONTAINER_OBJECT)
+                goto object_key;
+            goto value;
+        }
+        if (stack[depth - 1] == CONTAINER_OBJECT && c == '}')
+        {
+            EMIT(JSON_EVENT_END_OBJECT, buf + pos[i], 1, i);
+            depth--;
+            i++;
+            goto after_value;
+        }
+        if (stack[depth - 1] == CONTAINER_ARRAY && c == ']')
+        {
+            EMIT(JSON_EVENT_END_ARRAY, buf + pos[i], 1, i);
+            depth--;
+            i++;
+            goto after_value;
+        }
+        err_offset = pos[i];
+        goto unexpected;
+    }
+
+unexpected_end:
+    json_report_syntax_error_at_end(buf, idx->len, n > 0 ? pos[n - 1] : 0);
+    goto failed;
+
+unexpected:
+    json_report_unexpected(buf, idx->len, err_offset);
+    goto failed;
+
+aborted:
+failed:
+    free(stack);
+    return -1;
+
+#undef EMIT
+#undef PUSH
+}
+
+// --- Stage 2 consumer that builds the pointer AST ---
+
+typedef struct AstBuilder
+{
+    JsonValue **stack; // Open containers
+    size_t depth, cap;
+    JsonValue *root;
+    char *pending_key; // Key waiting for its value
+    const JsonIndex *lazy_index; // If set, containers below the first one become JSON_LAZY_TYPE nodes
+} AstBuilder;
+
+static void builder_attach(AstBuilder *b, JsonValue *v)
+{
+    if (b->depth == 0)
+    {
+        b->root = v;
+        return;
+    }
+    JsonValue *parent = b->stack[b->depth - 1];
+    if (parent->type == JSON_ARRAY_TYPE)
+    {
+        ast_array_append(parent, v);
+    }
+    else
+    {
+        ast_object_add_member(parent, b->pending_key, v);
+        b->pending_key = NULL;
+    }
+}
+
+static void builder_push(AstBuilder *b, JsonValue *container)
+{
+    if (b->depth == b->cap)
+    {
+        b->cap = b->cap ? b->cap * 2 : 64;
+        JsonValue **grown = (JsonValue **)realloc(b->stack, b->cap * sizeof(JsonValue *));
+        if (!grown)
+        {
+            perror("Error: AST builder realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        b->stack = grown;
+    }
+    b->stack[b->depth++] = container;
+}
+
+static int ast_builder_event(void *ctx, const JsonEvent *ev)
+{
+    AstBuilder *b = (AstBuilder *)ctx;
+    switch (ev->type)
+    {
+    case JSON_EVENT_NULL:
+        builder_attach(b, ast_create_null());
+        break;
+    case JSON_EVENT_TRUE:
+        builder_attach(b, ast_create_boolean(1));
+        break;
+    case JSON_EVENT_FALSE:
+        builder_attach(b, ast_create_boolean(0));
+        break;
+    case JSON_EVENT_NUMBER:
+        builder_attach(b, ast_create_number(json_lexeme_to_double(ev->text, ev->len)));
+        break;
+    case JSON_EVENT_STRING:
+        builder_attach(b, ast_create_string_from_lexeme(ev->text, (int)ev->len));
+        break;
+    case JSON_EVENT_KEY:
+        b->pending_key = unescape_json_string(ev->text, (int)ev->len);
+        break;
+    case JSON_EVENT_BEGIN_OBJECT:
+    case JSON_EVENT_BEGIN_ARRAY:
+    {
+        if (b->lazy_index && b->depth > 0)
+        { // Record the span only; the walker skips to the matching bracket
+            builder_attach(b, ast_create_lazy(b->lazy_index, ev->index_pos,
+                                              ev->type == JSON_EVENT_BEGIN_OBJECT ? JSON_OBJECT_TYPE : JSON_ARRAY_TYPE));
+            return JSON_WALK_SKIP;
+        }
+        // Attach containers when they open so a failed parse can free everything from the root
+        JsonValue *container = ev->type == JSON_EVENT_BEGIN_OBJECT ? ast_create_object() : ast_create_array();
+        builder_attach(b, container);
+        builder_push(b, container);
+        break;
+    }
+    case JSON_EVENT_END_OBJECT:
+    case JSON_EVENT_END_ARRAY:
+        b->depth--;
+        break;
+    case JSON_EVENT_SKIPPED:
+        break;
+    }
+    return 0;
+}
+
+static JsonValue *parse_with_builder(const JsonIndex *idx, const JsonIndex *lazy_index, size_t first_entry, size_t *next_entry)
+{
+    AstBuilder b;
+    memset(&b, 0, sizeof(b));
+    b.lazy_index = lazy_index;
+    int rc = json_index_walk_value(idx, first_entry, ast_builder_event, &b, next_entry);
+    free(b.stack);
+    free(b.pending_key);
+    if (rc != 0)
+    {
+        ast_free_value(b.root);
+        return NULL;
+    }
+    return b.root;
+}
+
+JsonValue *json_index_parse_ast(const JsonIndex *idx)
+{
+    return parse_with_builder(idx, NULL, 0, NULL);
+}
+
+JsonValue *json_index_parse_lazy(const JsonIndex *idx)
+{
+    return parse_with_builder(idx, idx, 0, NULL);
+}
+
+int json_lazy_resolve(JsonValue *val)
+{
+    if (!val || val->type != JSON_LAZY_TYPE)
+        return 0;
+    JsonLazy *lazy = val->data.lazy_val;
+    size_t next_entry;
+    JsonValue *parsed = parse_with_builder(lazy->index, lazy->index, lazy->begin, &next_entry);
+    if (!parsed)
+        return -1;
+    // Take over the parsed container in place so every reference to val sees it
+    free(lazy);
+    val->type = parsed->type;
+    val->data = parsed->data;
+    free(parsed);
+    return 0;
+}
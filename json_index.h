@@ -0,0 +1,86 @@
+// json_index.h
+#ifndef JSON_INDEX_H
+#define JSON_INDEX_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For uint32_t
+
+#include "ast.h"
+
+// Two-stage structural indexer (simdjson-style front end, alternative to scanner.l + parser.y).
+//
+// Stage 1 classifies the input 64 bytes at a time with SIMD compares and records the offset of
+// every structural character ({ } [ ] , :), every unescaped quote (opening and closing) and the
+// first byte of every number/literal outside strings.
+// Stage 2 walks those offsets with a small explicit-stack state machine and reports the document
+// as a stream of events, which the AST builder turns into nodes through the ast_create_* API.
+
+#define JSON_INDEX_MAX_INPUT 0xFFFFFFFFu // Offsets are stored as uint32_t
+
+typedef struct JsonIndex
+{
+    const char *data;    // Input bytes (borrowed, must outlive the index)
+    size_t len;          // Input length
+    uint32_t *positions; // Offsets of structural characters, in input order
+    size_t count;        // Number of entries in positions
+} JsonIndex;
+
+typedef enum
+{
+    JSON_EVENT_NULL,
+    JSON_EVENT_TRUE,
+    JSON_EVENT_FALSE,
+    JSON_EVENT_NUMBER,       // text/len: the number lexeme
+    JSON_EVENT_STRING,       // text/len: the string lexeme including both quotes
+    JSON_EVENT_KEY,          // text/len: the key lexeme including both quotes
+    JSON_EVENT_BEGIN_OBJECT, // text: the '{'
+    JSON_EVENT_END_OBJECT,
+    JSON_EVENT_BEGIN_ARRAY,  // text: the '['
+    JSON_EVENT_END_ARRAY,
+    JSON_EVENT_SKIPPED       // A container left unparsed; text/index_pos: its closing bracket
+} JsonEventType;
+
+typedef struct JsonEvent
+{
+    JsonEventType type;
+    const char *text;
+    size_t len;
+    size_t index_pos; // Entry in JsonIndex.positions that produced this event
+} JsonEvent;
+
+// Event callback for stage 2. Return 0 to continue, or a negative value to abort the walk.
+// For BEGIN_OBJECT/BEGIN_ARRAY, JSON_WALK_SKIP leaves the container unparsed: the walker jumps to
+// the matching bracket and reports JSON_EVENT_SKIPPED instead of the container's contents.
+typedef int (*JsonEventHandler)(void *ctx, const JsonEvent *ev);
+#define JSON_WALK_SKIP 1
+
+// Stage 1. Returns 0 on success, -1 if the input is too large or memory runs out.
+int json_index_build(JsonIndex *idx, const char *data, size_t len);
+void json_index_free(JsonIndex *idx);
+
+// Stage 2. Reports lexical/syntax errors like the flex/bison front end and returns -1 on error
+// (or when the handler aborts), 0 on success.
+int json_index_walk(const JsonIndex *idx, JsonEventHandler handler, void *ctx);
+// Walks the single value that starts at index entry first_entry. If next_entry is NULL the value
+// must be the whole rest of the input; otherwise the entry after the value is stored there.
+int json_index_walk_value(const JsonIndex *idx, size_t first_entry, JsonEventHandler handler, void *ctx, size_t *next_entry);
+// Entry of the bracket that closes the container opened at open_entry (bracket-matching scan over
+// the index; string contents never appear in it). Returns idx->count if it is unbalanced.
+size_t json_index_matching_close(const JsonIndex *idx, size_t open_entry);
+
+// Stage 2 into an AST. Returns NULL on error (the error has already been reported).
+JsonValue *json_index_parse_ast(const JsonIndex *idx);
+
+// On-demand parsing (--lazy). Only the root container is parsed; nested objects and arrays
+// become JSON_LAZY_TYPE nodes that remember where they start, and the walker skips their bytes
+// by bracket matching over the index. idx must outlive the returned AST.
+// Syntax errors inside a nested container are only found when it is resolved.
+JsonValue *json_index_parse_lazy(const JsonIndex *idx);
+// Parses one level of a JSON_LAZY_TYPE node in place (its own nested containers stay lazy).
+// No-op for other nodes. Returns -1 on a syntax error (already reported), 0 otherwise.
+int json_lazy_resolve(JsonValue *val);
+
+// Name of the stage 1 kernel picked for this CPU ("avx2", "sse2" or "portable").
+const char *json_index_kernel_name(void);
+
+#endif // JSON_INDEX_H
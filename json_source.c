@@ -0,0 +1,290 @@
+// json_source.c
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>    // For open
+#include <unistd.h>   // For read, close
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For fstat
+
+#include "json_source.h"
+
+int json_source_open(JsonSource *src, const char *path)
+{
+    memset(src, 0, sizeof(*src));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            close(fd);
+            src->data = (const char *)map;
+            src->len = (size_t)st.st_size;
+            src->map_base = map;
+            src->map_len = (size_t)st.st_size;
+            return 0;
+        }
+    }
+
+    // Fallback for pipes, empty files, or filesystems that cannot be mapped
+    size_t cap = 65536, len = 0;
+    char *buf = (char *)malloc(cap);
+    if (!buf)
+    {
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (;;)
+    {
+        if (len == cap)
+        {
+            char *grown = (char *)realloc(buf, cap * 2);
+            if (!grown)
+            {
+                free(buf);
+                close(fd);
+                errno = ENOMEM;
+                return -1;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            int saved_errno = errno;
+            free(buf);
+            close(fd);
+            errno = saved_errno;
+            return -1;
+        }
+        if (n == 0)
+            break;
+        len += (size_t)n;
+    }
+    close(fd);
+    src->data = buf;
+    src->len = len;
+    return 0;
+}
+
+void json_source_close(JsonSource *src)
+{
+    if (!src)
+        return;
+    if (src->map_base)
+        munmap(src->map_base, src->map_len);
+    else
+        free((void *)src->data);
+    memset(src, 0, sizeof(*src));
+}
+
+void json_source_location(const char *data, size_t len, size_t offset, int *line, int *column)
+{
+    int l = 1, c = 1;
+    if (offset > len)
+        offset = len;
+    for (size_t i = 0; i < offset; ++i)
+    {
+        if (data[i] == '\n')
+        {
+            l++;
+            c = 1;
+        }
+        else
+        {
+            c++;
+        }
+    }
+    *line = l;
+    *column = c;
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// INTEGER ("0"|([1-9]{DIGIT}*)) from scanner.l
+static size_t scan_integer(const char *p, const char *end)
+{
+    if (p >= end || !is_digit(*p))
+        return 0;
+    if (*p == '0')
+        return 1;
+    const char *q = p + 1;
+    while (q < end && is_digit(*q))
+        q++;
+    return (size_t)(q - p);
+}
+
+// NUMBER (-?{INTEGER}(\.{DIGIT}+)?([eE][+-]?{INTEGER})?) with flex's longest-match backtracking
+size_t json_scan_number(const char *p, const char *end)
+{
+    const char *q = p;
+    if (q < end && *q == '-')
+        q++;
+    size_t n = scan_integer(q, end);
+    if (n == 0)
+        return 0;
+    q += n;
+
+    if (q + 1 < end && *q == '.' && is_digit(q[1]))
+    {
+        q += 2;
+        while (q < end && is_digit(*q))
+            q++;
+    }
+
+    if (q < end && (*q == 'e' || *q == 'E'))
+    {
+        const char *e = q + 1;
+        if (e < end && (*e == '+' || *e == '-'))
+            e++;
+        size_t exp_len = scan_integer(e, end);
+        if (exp_len > 0)
+            q = e + exp_len;
+    }
+    return (size_t)(q - p);
+}
+
+size_t json_scan_literal(const char *p, const char *end)
+{
+    size_t avail = (size_t)(end - p);
+    if (avail >= 4 && memcmp(p, "true", 4) == 0)
+        return 4;
+    if (avail >= 5 && memcmp(p, "false", 5) == 0)
+        return 5;
+    if (avail >= 4 && memcmp(p, "null", 4) == 0)
+        return 4;
+    return 0;
+}
+
+double json_lexeme_to_double(const char *text, size_t len)
+{
+    char small[64];
+    if (len < sizeof(small))
+    {
+        memcpy(small, text, len);
+        small[len] = '\0';
+        return atof(small);
+    }
+    char *big = (char *)malloc(len + 1);
+    if (!big)
+    {
+        perror("Error: malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(big, text, len);
+    big[len] = '\0';
+    double d = atof(big);
+    free(big);
+    return d;
+}
+
+// Mirrors STRING \"([^\"\\]|\\.)*\" -- '.' does not match a newline after a backslash.
+static int has_string_token(const char *p, const char *end)
+{
+    for (const char *q = p + 1; q < end; ++q)
+    {
+        if (*q == '"')
+            return 1;
+        if (*q == '\\')
+        {
+            if (q + 1 >= end || q[1] == '\n')
+                return 0;
+            q++;
+        }
+    }
+    return 0;
+}
+
+int json_starts_token(const char *p, const char *end)
+{
+    if (p >= end)
+        return 0;
+    switch (*p)
+    {
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ',':
+    case ':':
+        return 1;
+    case '"':
+        return has_string_token(p, end);
+    default:
+        return json_scan_number(p, end) > 0 || json_scan_literal(p, end) > 0;
+    }
+}
+
+void json_report_lexical_error(const char *data, size_t len, size_t offset)
+{
+    int line, column;
+    json_source_location(data, len, offset, &line, &column);
+    fprintf(stderr, "Lexical Error: Unexpected character '%c' at line %d, column %d\n",
+            offset < len ? data[offset] : ' ', line, column);
+}
+
+void json_report_syntax_error(const char *data, size_t len, size_t offset)
+{
+    int line, column;
+    json_source_location(data, len, offset, &line, &column);
+    fprintf(stderr, "Syntax Error: syntax error at line %d, column %d.\n", line, column);
+}
+
+void json_report_syntax_error_at_end(const char *data, size_t len, size_t last_token_offset)
+{
+    // Flex runs no user action at end of input, so bison reports the location of the last match,
+    // which is trailing whitespace if there is any
+    size_t token_end = len;
+    while (token_end > 0 && (data[token_end - 1] == ' ' || data[token_end - 1] == '\t' ||
+                             data[token_end - 1] == '\r' || data[token_end - 1] == '\n'))
+        token_end--;
+    if (token_end == len)
+    {
+        json_report_syntax_error(data, len, last_token_offset);
+        return;
+    }
+    int line, column;
+    if (data[len - 1] == '\n')
+    { // "\n" rule: yylineno is already bumped, yycolumn not yet reset
+        json_source_location(data, len, len - 1, &line, &column);
+        line++;
+    }
+    else
+    { // Start of the final WHITESPACE run
+        size_t run = len - 1;
+        while (run > token_end && data[run - 1] != '\n')
+            run--;
+        json_source_location(data, len, run, &line, &column);
+    }
+    fprintf(stderr, "Syntax Error: syntax error at line %d, column %d.\n", line, column);
+}
+
+void json_report_unexpected(const char *data, size_t len, size_t offset)
+{
+    if (json_starts_token(data + offset, data + len))
+        json_report_syntax_error(data, len, offset);
+    else
+        json_report_lexical_error(data, len, offset);
+}
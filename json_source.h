@@ -0,0 +1,42 @@
+// json_source.h
+#ifndef JSON_SOURCE_H
+#define JSON_SOURCE_H
+
+#include <stddef.h> // For size_t
+
+// A whole JSON input held in memory (mmap'd when possible).
+// Used by the parser back ends that work on a byte buffer instead of a FILE* stream.
+typedef struct JsonSource
+{
+    const char *data; // Input bytes (not NUL-terminated)
+    size_t len;       // Number of bytes in data
+    void *map_base;   // Base of the mmap'd region (NULL if data was read into a malloc'd buffer)
+    size_t map_len;   // Length of the mmap'd region
+} JsonSource;
+
+// Maps (or reads) the whole file at path. Returns 0 on success, -1 on failure (errno is set).
+int json_source_open(JsonSource *src, const char *path);
+void json_source_close(JsonSource *src);
+
+// Converts a byte offset into the 1-based line/column numbers the flex scanner reports.
+void json_source_location(const char *data, size_t len, size_t offset, int *line, int *column);
+
+// Token helpers shared by the hand-written back ends. They mirror the rules in scanner.l.
+// Length of the longest NUMBER match at p (0 if none).
+size_t json_scan_number(const char *p, const char *end);
+// Length of the true/false/null literal at p (0 if none).
+size_t json_scan_literal(const char *p, const char *end);
+// Converts a NUMBER lexeme to a double exactly like ast_create_number_from_string (atof).
+double json_lexeme_to_double(const char *text, size_t len);
+// Nonzero if a flex token could start at p (used to pick lexical vs. syntax errors).
+int json_starts_token(const char *p, const char *end);
+
+// Error reporting with the same wording as scanner.l / parser.y.
+void json_report_lexical_error(const char *data, size_t len, size_t offset);
+void json_report_syntax_error(const char *data, size_t len, size_t offset);
+// Syntax error for a premature end of input (last_token_offset: start of the last token).
+void json_report_syntax_error_at_end(const char *data, size_t len, size_t last_token_offset);
+// Reports the right kind of error for an unexpected token starting at offset.
+void json_report_unexpected(const char *data, size_t len, size_t offset);
+
+#endif // JSON_SOURCE_H
@@ -7,6 +7,12 @@
 
 #include "ast.h"
 #include "schema_csv.h" // For processing the AST
+#include "json_source.h" // For the buffer-based parser back ends
+#include "json_index.h"  // SIMD structural indexer (--parser simd)
+#include "tape.h"        // Flat tape document (--tape)
+#include "rd_parser.h"   // Hand-written recursive-descent parser (--parser rd)
+#include "tape_cache.h"  // Persistent parsed-document cache (--cache-dir)
+#include "schema_codegen.h" // Schema compiler (--compile-schema)
 #include "parser.h"     // <--- ***** ADD THIS LINE ***** (For YYLTYPE, token definitions, etc.)
 
 // External from parser.y (yyparse, ast_root are already effectively covered by including parser.h if it declares them,
@@ -21,17 +27,120 @@ extern YYLTYPE yylloc; // Defined in parser.h when %locations is used
 // External from scanner.l
 extern int yycolumn; // To be reset for each file. Defined in scanner.l.
 
+#ifndef DEFAULT_PARSER
+#define DEFAULT_PARSER "flex" // Front end used without --parser (make DEFAULT_PARSER=rd to change)
+#endif
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s <input.json> [--print-ast] [-out-dir DIR] [--parser flex|simd|rd] [--tape] [--lazy] [--select KEY[,KEY...]] [--threads N] [--release-early] [--intern] [--cache-dir DIR] [--single-pass] [--infer-from N] [--on-mismatch widen|side-table|fail] [--schema-out FILE] [--schema-in FILE] [--max-open-files N] [--skip-empty-tables] [--writer-threads N] [--io-backend write|pwritev|uring|mmap|spill] [--compress gzip|zstd] [--compress-level N] [--compress-threads N] [--format csv|arrow|parquet|pgcopy] [--batch-rows N]\n", prog);
+    fprintf(stderr, "       %s --compile-schema <schema-file> <converter.c>\n", prog);
+}
+
+// Parses the input with the recursive-descent parser (a root array on num_threads threads).
+// Returns 0, or -1 on failure (error already reported).
+static int parse_with_rd(const char *input_filepath, int num_threads, JsonValue **root_out)
+{
+    JsonSource src;
+    if (json_source_open(&src, input_filepath) != 0)
+    {
+        perror(input_filepath);
+        return -1;
+    }
+    *root_out = rd_parse_ast_parallel(src.data, src.len, num_threads);
+    json_source_close(&src);
+    return *root_out ? 0 : -1;
+}
+
+// Parses the input with the two-stage SIMD indexer, into *root_out or (if tape_out is given)
+// straight into a tape without building AST nodes. Returns 0, or -1 on failure (error already reported).
+// With lazy set, *root_out only has its root level parsed and src/idx are left open for the
+// converter to parse the rest on demand; the caller closes them once the AST is freed.
+static int parse_with_simd_index(const char *input_filepath, JsonSource *src, JsonIndex *idx, int lazy,
+                                 JsonValue **root_out, JsonTape *tape_out)
+{
+    if (json_source_open(src, input_filepath) != 0)
+    {
+        perror(input_filepath);
+        return -1;
+    }
+    if (json_index_build(idx, src->data, src->len) != 0)
+    {
+        fprintf(stderr, "Error: Could not index %s (input too large for --parser simd or out of memory).\n", input_filepath);
+        json_source_close(src);
+        return -1;
+    }
+    int rc = 0;
+    if (tape_out)
+    {
+        rc = tape_from_index(tape_out, idx);
+    }
+    else
+    {
+        *root_out = lazy ? json_index_parse_lazy(idx) : json_index_parse_ast(idx);
+        rc = *root_out ? 0 : -1;
+    }
+    if (!lazy || rc != 0)
+    {
+        json_index_free(idx);
+        json_source_close(src);
+    }
+    return rc;
+}
+
 int main(int argc, char *argv[])
 {
     char *input_filepath = NULL;
     char *output_dir = "."; // Default to current directory
     int print_ast_flag = 0;
+    const char *parser_name = DEFAULT_PARSER; // Front end: flex/bison, simd or rd
+    int use_tape = 0;                 // Convert from the flat tape instead of the pointer AST
+    int use_lazy = 0;                 // Parse nested containers only when the converter reaches them
+    const char *selected_keys = NULL; // --select list
+    int num_threads = 1;              // Parser threads for a root array (--parser rd)
+    int release_early = 0;            // Free AST subtrees as soon as they are converted
+    int intern_strings = 0;           // Share identical string values (and their escaped CSV bytes)
+    const char *cache_dir = NULL;     // Reuse/store the parsed tape here (--cache-dir)
+    int single_pass = 0;              // Discover tables while writing rows (one walk)
+    long infer_from = 0;              // Discover from the first N elements of each array (0: all)
+    const char *on_mismatch = NULL;   // What to do with records outside the sampled schema
+    const char *schema_out = NULL;    // Save the table registry here after converting
+    const char *schema_in = NULL;     // Convert into this saved registry instead of discovering
+    int max_open_files = 0;           // Output descriptors kept open at once (0: from RLIMIT_NOFILE)
+    int skip_empty_tables = 0;        // Create no file for tables without rows
+    int writer_threads = 0;           // Threads writing the CSV buffers (0: written inline)
+    const char *io_backend = "write"; // How flushed buffers are written: write, pwritev, uring, mmap or spill
+    const char *compress = NULL;      // Output compression: gzip or zstd
+    int compress_level = 0;           // 0: the codec's default
+    int compress_threads = 0;         // Threads compressing blocks of the tables (0: one stream per table)
+    const char *format = "csv";       // Table file format: csv, arrow, parquet or pgcopy
+    long batch_rows = 0;              // Rows per record batch or row group (0: ROW_BATCH_DEFAULT_ROWS)
+    TapeCacheKey cache_key;
+    int cache_hit = 0;
+    memset(&cache_key, 0, sizeof(cache_key));
+    JsonTape tape;
+    tape_init(&tape);
+    JsonSource src; // Input and index kept alive for --lazy
+    JsonIndex idx;
+    memset(&src, 0, sizeof(src));
+    memset(&idx, 0, sizeof(idx));
 
     if (argc < 2)
     {
-        fprintf(stderr, "Usage: %s <input.json> [--print-ast] [-out-dir DIR]\n", argv[0]);
+        print_usage(argv[0]);
         return EXIT_FAILURE;
     }
+    if (strcmp(argv[1], "--compile-schema") == 0)
+    { // Emit a specialized converter for a --schema-out file; nothing is converted
+        if (argc != 4)
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        int status = load_schemas(argv[2]) == 0 && emit_schema_converter(argv[3]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        cleanup_schemas();
+        return status;
+    }
     input_filepath = argv[1];
 
     for (int i = 2; i < argc; i++)
@@ -52,53 +161,385 @@ int main(int argc, char *argv[])
                 return EXIT_FAILURE;
             }
         }
+        else if (strcmp(argv[i], "--parser") == 0)
+        {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "flex") == 0 || strcmp(argv[i + 1], "simd") == 0 ||
+                                 strcmp(argv[i + 1], "rd") == 0))
+            {
+                parser_name = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: --parser requires 'flex', 'simd' or 'rd'.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--tape") == 0)
+        {
+            use_tape = 1;
+        }
+        else if (strcmp(argv[i], "--lazy") == 0)
+        {
+            use_lazy = 1;
+        }
+        else if (strcmp(argv[i], "--release-early") == 0)
+        {
+            release_early = 1;
+        }
+        else if (strcmp(argv[i], "--cache-dir") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                cache_dir = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: --cache-dir requires a directory argument.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--infer-from") == 0)
+        {
+            infer_from = i + 1 < argc ? atol(argv[++i]) : 0;
+            if (infer_from < 1)
+            {
+                fprintf(stderr, "Error: --infer-from requires a positive number of records.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--on-mismatch") == 0)
+        {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "widen") == 0 || strcmp(argv[i + 1], "side-table") == 0 ||
+                                 strcmp(argv[i + 1], "fail") == 0))
+            {
+                on_mismatch = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: --on-mismatch requires 'widen', 'side-table' or 'fail'.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--schema-out") == 0 || strcmp(argv[i], "--schema-in") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Error: %s requires a file argument.\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            if (strcmp(argv[i], "--schema-out") == 0)
+                schema_out = argv[++i];
+            else
+                schema_in = argv[++i];
+        }
+        else if (strcmp(argv[i], "--max-open-files") == 0)
+        {
+            max_open_files = i + 1 < argc ? atoi(argv[++i]) : 0;
+            if (max_open_files < 1)
+            {
+                fprintf(stderr, "Error: --max-open-files requires a positive number.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--writer-threads") == 0)
+        {
+            writer_threads = i + 1 < argc ? atoi(argv[++i]) : 0;
+            if (writer_threads < 1)
+            {
+                fprintf(stderr, "Error: --writer-threads requires a positive number.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--io-backend") == 0)
+        {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "write") == 0 || strcmp(argv[i + 1], "pwritev") == 0 ||
+                                 strcmp(argv[i + 1], "uring") == 0 || strcmp(argv[i + 1], "mmap") == 0 ||
+                                 strcmp(argv[i + 1], "spill") == 0))
+            {
+                io_backend = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: --io-backend requires 'write', 'pwritev', 'uring', 'mmap' or 'spill'.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--format") == 0)
+        {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "csv") == 0 || strcmp(argv[i + 1], "arrow") == 0 ||
+                                 strcmp(argv[i + 1], "parquet") == 0 || strcmp(argv[i + 1], "pgcopy") == 0))
+            {
+                format = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: --format requires 'csv', 'arrow', 'parquet' or 'pgcopy'.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--batch-rows") == 0)
+        {
+            batch_rows = i + 1 < argc ? atol(argv[++i]) : 0;
+            if (batch_rows < 1)
+            {
+                fprintf(stderr, "Error: --batch-rows requires a positive number.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--compress") == 0)
+        {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "gzip") == 0 || strcmp(argv[i + 1], "zstd") == 0))
+            {
+                compress = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: --compress requires 'gzip' or 'zstd'.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--compress-level") == 0)
+        {
+            compress_level = i + 1 < argc ? atoi(argv[++i]) : 0;
+            if (compress_level < 1)
+            {
+                fprintf(stderr, "Error: --compress-level requires a positive number.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--compress-threads") == 0)
+        {
+            compress_threads = i + 1 < argc ? atoi(argv[++i]) : 0;
+            if (compress_threads < 1)
+            {
+                fprintf(stderr, "Error: --compress-threads requires a positive number.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--skip-empty-tables") == 0)
+        {
+            skip_empty_tables = 1;
+        }
+        else if (strcmp(argv[i], "--single-pass") == 0)
+        {
+            single_pass = 1;
+        }
+        else if (strcmp(argv[i], "--intern") == 0)
+        {
+            intern_strings = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0)
+        {
+            num_threads = i + 1 < argc ? atoi(argv[++i]) : 0;
+            if (num_threads < 1)
+            {
+                fprintf(stderr, "Error: --threads requires a positive number.\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--select") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                selected_keys = argv[++i];
+            }
+            else
+            {
+                fprintf(stderr, "Error: --select requires a comma-separated list of keys.\n");
+                return EXIT_FAILURE;
+            }
+        }
         else
         {
             fprintf(stderr, "Error: Unknown argument '%s'\n", argv[i]);
-            fprintf(stderr, "Usage: %s <input.json> [--print-ast] [-out-dir DIR]\n", argv[0]);
+            print_usage(argv[0]);
             return EXIT_FAILURE;
         }
     }
 
-    yyin = fopen(input_filepath, "r");
-    if (!yyin)
+    if (cache_dir && (use_lazy || release_early))
     {
-        perror(input_filepath);
+        fprintf(stderr, "Error: --cache-dir converts from a cached tape and cannot be combined with --lazy or --release-early.\n");
         return EXIT_FAILURE;
     }
+    if (cache_dir)
+        use_tape = 1; // The cache holds tapes
+    if (use_lazy && (strcmp(parser_name, "simd") != 0 || use_tape))
+    {
+        fprintf(stderr, "Error: --lazy requires --parser simd and cannot be combined with --tape.\n");
+        return EXIT_FAILURE;
+    }
+    if (num_threads > 1 && strcmp(parser_name, "rd") != 0)
+    {
+        fprintf(stderr, "Error: --threads requires --parser rd.\n");
+        return EXIT_FAILURE;
+    }
+    if (release_early && use_tape)
+    {
+        fprintf(stderr, "Error: --release-early frees AST subtrees and cannot be combined with --tape.\n");
+        return EXIT_FAILURE;
+    }
+    set_selected_keys(selected_keys);
+    set_release_early(release_early);
+    if (on_mismatch && !infer_from && !schema_in)
+    {
+        fprintf(stderr, "Error: --on-mismatch requires --infer-from or --schema-in.\n");
+        return EXIT_FAILURE;
+    }
+    if (schema_in && (infer_from || single_pass))
+    {
+        fprintf(stderr, "Error: --schema-in replaces discovery and cannot be combined with --infer-from or --single-pass.\n");
+        return EXIT_FAILURE;
+    }
+    if (infer_from && single_pass)
+    {
+        fprintf(stderr, "Error: --infer-from needs a separate discovery pass and cannot be combined with --single-pass.\n");
+        return EXIT_FAILURE;
+    }
+    if (writer_threads && strcmp(io_backend, "write") != 0)
+    {
+        fprintf(stderr, "Error: --io-backend %s writes on the converter thread and cannot be combined with --writer-threads.\n", io_backend);
+        return EXIT_FAILURE;
+    }
+    CsvCompression codec = !compress                      ? CSV_COMPRESS_NONE
+                           : strcmp(compress, "gzip") == 0 ? CSV_COMPRESS_GZIP
+                                                           : CSV_COMPRESS_ZSTD;
+    if ((compress_level || compress_threads) && !compress)
+    {
+        fprintf(stderr, "Error: %s requires --compress.\n", compress_level ? "--compress-level" : "--compress-threads");
+        return EXIT_FAILURE;
+    }
+    if (compress && !csv_compress_available(codec))
+    {
+        fprintf(stderr, "Error: --compress %s is not available: this build has no %s.\n", compress,
+                codec == CSV_COMPRESS_GZIP ? "zlib" : "libzstd");
+        return EXIT_FAILURE;
+    }
+    if (compress && (writer_threads || strcmp(io_backend, "write") != 0))
+    {
+        fprintf(stderr, "Error: --compress streams each table through its compressor and cannot be combined with --writer-threads or --io-backend.\n");
+        return EXIT_FAILURE;
+    }
+    if (compress_level > csv_compress_max_level(codec))
+    {
+        fprintf(stderr, "Error: --compress-level for %s must be between 1 and %d.\n", compress, csv_compress_max_level(codec));
+        return EXIT_FAILURE;
+    }
+    if (batch_rows && strcmp(format, "csv") == 0)
+    {
+        fprintf(stderr, "Error: --batch-rows requires a binary --format.\n");
+        return EXIT_FAILURE;
+    }
+    set_single_pass(single_pass);
+    set_track_column_types(schema_out != NULL);
+    set_schema_inference(infer_from, !on_mismatch || strcmp(on_mismatch, "widen") == 0 ? MISMATCH_WIDEN
+                                     : strcmp(on_mismatch, "side-table") == 0       ? MISMATCH_SIDE_TABLE
+                                                                                    : MISMATCH_FAIL);
+    ast_set_string_interning(intern_strings);
+    row_batches_configure(strcmp(format, "arrow") == 0     ? OUTPUT_ARROW
+                          : strcmp(format, "parquet") == 0 ? OUTPUT_PARQUET
+                          : strcmp(format, "pgcopy") == 0  ? OUTPUT_PGCOPY
+                                                           : OUTPUT_CSV,
+                          (size_t)batch_rows);
+    csv_writers_set_compression(codec, compress_level ? compress_level : csv_compress_default_level(codec),
+                                compress_threads);
+    csv_writers_configure(max_open_files, skip_empty_tables, writer_threads,
+                          strcmp(io_backend, "uring") == 0     ? CSV_IO_URING
+                          : strcmp(io_backend, "pwritev") == 0 ? CSV_IO_PWRITEV
+                          : strcmp(io_backend, "mmap") == 0    ? CSV_IO_MMAP
+                          : strcmp(io_backend, "spill") == 0   ? CSV_IO_SPILL
+                                                               : CSV_IO_WRITE);
+    if (schema_in && load_schemas(schema_in) != 0)
+        return EXIT_FAILURE; // Checked before parsing
 
-    // Initialize lexer location tracking
-    yylineno = 1;
-    yycolumn = 1; // From scanner.l global, reset for new input
-
-    // ast_root is defined in parser.y (which becomes parser.c)
-    // No need to redeclare here if it's properly externed from parser.h or directly from parser.c
-    // If parser.h (from bison -d) declares `extern JsonValue* ast_root;`, it's fine.
-    // If not, the `extern JsonValue* ast_root;` above is needed.
-    // Our parser.y has `JsonValue* ast_root = NULL;` in the C declarations part, so it's global in parser.c.
+    if (cache_dir)
+    {
+        // The key is taken before parsing, so an input that changes meanwhile is never cached under its new identity
+        if (tape_cache_key(&cache_key, cache_dir, input_filepath) != 0)
+        {
+            perror(input_filepath);
+            cleanup_schemas();
+            return EXIT_FAILURE;
+        }
+        cache_hit = tape_cache_load(&tape, &cache_key) == 0;
+    }
 
-    if (yyparse() != 0)
+    if (cache_hit)
+    {
+        // Nothing to parse
+    }
+    else if (strcmp(parser_name, "simd") == 0)
+    {
+        if (parse_with_simd_index(input_filepath, &src, &idx, use_lazy, &ast_root, use_tape ? &tape : NULL) != 0)
+        {
+            tape_free(&tape);
+            cleanup_schemas();
+            return EXIT_FAILURE;
+        }
+    }
+    else if (strcmp(parser_name, "rd") == 0)
     {
-        fprintf(stderr, "Parsing failed. Exiting.\n");
+        if (parse_with_rd(input_filepath, num_threads, &ast_root) != 0)
+        {
+            cleanup_schemas();
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        yyin = fopen(input_filepath, "r");
+        if (!yyin)
+        {
+            perror(input_filepath);
+            return EXIT_FAILURE;
+        }
+
+        // Initialize lexer location tracking
+        yylineno = 1;
+        yycolumn = 1; // From scanner.l global, reset for new input
+
+        // ast_root is defined in parser.y (which becomes parser.c)
+        // No need to redeclare here if it's properly externed from parser.h or directly from parser.c
+        // If parser.h (from bison -d) declares `extern JsonValue* ast_root;`, it's fine.
+        // If not, the `extern JsonValue* ast_root;` above is needed.
+        // Our parser.y has `JsonValue* ast_root = NULL;` in the C declarations part, so it's global in parser.c.
+
+        if (yyparse() != 0)
+        {
+            fprintf(stderr, "Parsing failed. Exiting.\n");
+            fclose(yyin);
+            if (ast_root)
+                ast_free_value(ast_root);
+            cleanup_schemas();
+            return EXIT_FAILURE;
+        }
         fclose(yyin);
-        if (ast_root)
-            ast_free_value(ast_root);
-        cleanup_schemas();
-        return EXIT_FAILURE;
     }
-    fclose(yyin);
 
-    if (!ast_root)
+    if (!ast_root && tape.num_words == 0)
     {
         fprintf(stderr, "Error: AST root is null after successful parsing (should not happen).\n");
         cleanup_schemas();
         return EXIT_FAILURE;
     }
 
+    if (use_tape && ast_root)
+    { // The flex/bison front end always builds the AST; flatten it and drop the tree
+        tape_from_ast(&tape, ast_root);
+        ast_free_value(ast_root);
+        ast_root = NULL;
+    }
+    if (cache_dir && !cache_hit)
+        tape_cache_store(&tape, &cache_key); // A failed store only costs the next run a parse
+    tape_cache_key_free(&cache_key);
+
     if (print_ast_flag)
     {
         printf("--- Abstract Syntax Tree ---\n");
-        ast_print_value(ast_root, 0);
+        if (use_tape)
+            tape_print_value(&tape, 0, 0);
+        else
+            ast_print_value(ast_root, 0);
         printf("--------------------------\n\n");
     }
 
@@ -107,6 +548,7 @@ int main(int argc, char *argv[])
     {
         perror("strdup for filename failed");
         ast_free_value(ast_root);
+        tape_free(&tape);
         cleanup_schemas();
         return EXIT_FAILURE;
     }
@@ -123,14 +565,32 @@ int main(int argc, char *argv[])
     }
 
     printf("Processing JSON and generating CSVs into directory: %s\n", output_dir);
-    process_json_to_csv(ast_root, output_dir, input_filename_base);
+    if (use_tape)
+        process_tape_to_csv(&tape, output_dir, input_filename_base);
+    else
+    {
+        ast_set_node_recycling(release_early); // Parsing is over; freed nodes feed lazy re-parses
+        process_json_to_csv(ast_root, output_dir, input_filename_base);
+    }
 
     printf("CSV generation process finished.\n");
+    int exit_status = EXIT_SUCCESS;
+    if (schema_out && save_schemas(schema_out) != 0)
+        exit_status = EXIT_FAILURE;
 
     ast_free_value(ast_root);
     ast_root = NULL;
+    ast_set_node_recycling(0);
+    ast_set_string_interning(0);
+    tape_free(&tape);
+    json_index_free(&idx);
+    json_source_close(&src);
     cleanup_schemas();
+    if (csv_writers_finish() != 0)
+        exit_status = EXIT_FAILURE;
 
+    if (exit_status != EXIT_SUCCESS)
+        return exit_status;
     printf("Program finished successfully.\n");
     return EXIT_SUCCESS;
 }
\ No newline at end of file
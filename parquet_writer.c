@@ -0,0 +1,608 @@
+// parquet_writer.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "parquet_writer.h"
+
+#define PARQUET_FORMAT_VERSION 2
+#define PARQUET_STATS_MAX_LEN 4096 // Longer text min/max values are left out of the statistics
+#define THRIFT_MAX_DEPTH 8
+
+typedef struct ByteBuf
+{
+    unsigned char *data;
+    size_t len, cap;
+} ByteBuf;
+
+// Thrift compact protocol writer. A field header holds the difference to the previous field id
+// of its struct, so each open struct keeps its last one.
+typedef struct ThriftWriter
+{
+    ByteBuf out;
+    int last_field[THRIFT_MAX_DEPTH];
+    int depth; // 0: the root struct
+} ThriftWriter;
+
+typedef struct ParquetFile
+{
+    uint64_t offset;         // Bytes written so far
+    ThriftWriter row_groups; // The footer's RowGroup structs, one after another
+    size_t num_row_groups;
+    int64_t num_rows;
+} ParquetFile;
+
+// Dictionary of a column chunk: entry e holds the value of row first[e], row r (not null) uses
+// entry index[r]
+typedef struct ChunkDictionary
+{
+    uint32_t *slots; // Open addressing hash table of entry + 1 (0: empty)
+    size_t mask;
+    uint32_t *first;
+    size_t num_entries;
+    uint32_t *index;
+    size_t page_len; // Size of the PLAIN dictionary page
+} ChunkDictionary;
+
+static void *safe_parquet_realloc(void *ptr, size_t size)
+{
+    void *grown = realloc(ptr, size);
+    if (!grown)
+    {
+        perror("Error: parquet_writer realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+static void buf_put(ByteBuf *b, const void *data, size_t n)
+{
+    if (n == 0)
+        return; // data may be NULL (an empty batch's text)
+    if (b->cap - b->len < n)
+    {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap - b->len < n)
+            cap *= 2;
+        b->data = (unsigned char *)safe_parquet_realloc(b->data, cap);
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+static void buf_byte(ByteBuf *b, unsigned v)
+{
+    unsigned char byte = (unsigned char)v;
+    buf_put(b, &byte, 1);
+}
+
+static void buf_le(ByteBuf *b, uint64_t v, size_t n)
+{
+    unsigned char le[8];
+    for (size_t i = 0; i < n; ++i)
+        le[i] = (unsigned char)(v >> (8 * i));
+    buf_put(b, le, n);
+}
+
+static void buf_varint(ByteBuf *b, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        buf_byte(b, (unsigned)(v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    buf_byte(b, (unsigned)v);
+}
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+// --- Thrift compact protocol ---
+
+static void tw_field(ThriftWriter *t, int id, int type)
+{
+    int delta = id - t->last_field[t->depth];
+    if (delta > 0 && delta <= 15)
+        buf_byte(&t->out, (unsigned)(delta << 4 | type));
+    else
+    {
+        buf_byte(&t->out, (unsigned)type);
+        buf_varint(&t->out, zigzag(id));
+    }
+    t->last_field[t->depth] = id;
+}
+
+static void tw_int(ThriftWriter *t, int id, int type, int64_t v)
+{
+    tw_field(t, id, type);
+    buf_varint(&t->out, zigzag(v));
+}
+
+static void tw_binary(ThriftWriter *t, int id, const void *data, size_t len)
+{
+    tw_field(t, id, THRIFT_BINARY);
+    buf_varint(&t->out, len);
+    buf_put(&t->out, data, len);
+}
+
+// Opens a struct whose field or list header is already written
+static void tw_begin(ThriftWriter *t)
+{
+    t->last_field[++t->depth] = 0;
+}
+
+static void tw_struct(ThriftWriter *t, int id)
+{
+    tw_field(t, id, THRIFT_STRUCT);
+    tw_begin(t);
+}
+
+// Closes the innermost struct (the root one too)
+static void tw_end(ThriftWriter *t)
+{
+    buf_byte(&t->out, THRIFT_STOP);
+    if (t->depth > 0)
+        t->depth--;
+}
+
+// List header; the n elements follow (structs opened with tw_begin)
+static void tw_list(ThriftWriter *t, int id, int elem_type, size_t n)
+{
+    tw_field(t, id, THRIFT_LIST);
+    if (n < 15)
+        buf_byte(&t->out, (unsigned)(n << 4 | elem_type));
+    else
+    {
+        buf_byte(&t->out, 0xF0u | (unsigned)elem_type);
+        buf_varint(&t->out, n);
+    }
+}
+
+// --- Encodings ---
+
+static size_t run_length(const uint32_t *v, size_t i, size_t n, size_t limit)
+{
+    size_t j = i + 1;
+    while (j < n && j - i < limit && v[j] == v[i])
+        ++j;
+    return j - i;
+}
+
+// RLE/bit-packed hybrid: a run of 8 or more equal values is an RLE run, the values in between
+// are bit-packed in groups of 8 (the last group padded with zeros)
+static void put_hybrid(ByteBuf *out, const uint32_t *v, size_t n, int width)
+{
+    size_t i = 0;
+    while (i < n)
+    {
+        size_t run = run_length(v, i, n, SIZE_MAX);
+        if (run >= 8)
+        {
+            buf_varint(out, (uint64_t)run << 1);
+            buf_le(out, v[i], (size_t)(width + 7) / 8);
+            i += run;
+            continue;
+        }
+        size_t end = i; // Bit-packs up to a group boundary where a run starts
+        do
+            end += 8;
+        while (end < n && run_length(v, end, n, 8) < 8);
+        buf_varint(out, (uint64_t)(end - i) / 8 << 1 | 1);
+        uint64_t acc = 0;
+        int bits = 0;
+        for (size_t k = i; k < end; ++k)
+        {
+            acc |= (uint64_t)(k < n ? v[k] : 0) << bits;
+            for (bits += width; bits >= 8; bits -= 8)
+            {
+                buf_byte(out, (unsigned)(acc & 0xFF));
+                acc >>= 8;
+            }
+        }
+        i = end;
+    }
+}
+
+static int bit_width(size_t max_value)
+{
+    int width = 1;
+    while (width < 32 && max_value >> width)
+        width++;
+    return width;
+}
+
+// The bytes a value is hashed and compared by (the 8 bytes of an int64 or double)
+static const void *value_bytes(const RowBatch *b, const BatchColumn *col, size_t r, size_t *len)
+{
+    if (col->type == COLUMN_TEXT)
+    {
+        *len = col->values[r].s.len;
+        return row_batch_text(b, &col->values[r]);
+    }
+    *len = 8;
+    return &col->values[r];
+}
+
+static void put_plain(ByteBuf *out, const RowBatch *b, const BatchColumn *col, size_t r)
+{
+    switch (col->type)
+    {
+    case COLUMN_INT:
+        buf_le(out, (uint64_t)col->values[r].i, 8);
+        break;
+    case COLUMN_FLOAT:
+    {
+        uint64_t bits;
+        memcpy(&bits, &col->values[r].d, 8);
+        buf_le(out, bits, 8);
+        break;
+    }
+    default:
+        buf_le(out, col->values[r].s.len, 4);
+        buf_put(out, row_batch_text(b, &col->values[r]), col->values[r].s.len);
+        break;
+    }
+}
+
+static void free_dictionary(ChunkDictionary *d)
+{
+    free(d->slots);
+    free(d->first);
+    free(d->index);
+    memset(d, 0, sizeof(*d));
+}
+
+// Dictionary encodes the chunk when it pays: at most one entry per two values and a dictionary
+// page within PARQUET_DICT_MAX_BYTES. Returns 0 (PLAIN) otherwise.
+static int build_dictionary(const RowBatch *b, const BatchColumn *col, ChunkDictionary *d)
+{
+    memset(d, 0, sizeof(*d));
+    size_t n = b->num_rows, present = 0;
+    for (size_t r = 0; r < n; ++r)
+        present += col->kinds[r] != COLUMN_NULL;
+    if (col->type == COLUMN_BOOL || present < 2)
+        return 0;
+    size_t max_entries = present / 2;
+    if (max_entries > PARQUET_DICT_MAX_BYTES / 4)
+        max_entries = PARQUET_DICT_MAX_BYTES / 4;
+    size_t num_slots = 16;
+    while (num_slots < 2 * max_entries)
+        num_slots *= 2;
+    d->slots = (uint32_t *)safe_parquet_realloc(NULL, num_slots * sizeof(uint32_t));
+    memset(d->slots, 0, num_slots * sizeof(uint32_t));
+    d->mask = num_slots - 1;
+    d->first = (uint32_t *)safe_parquet_realloc(NULL, max_entries * sizeof(uint32_t));
+    d->index = (uint32_t *)safe_parquet_realloc(NULL, n * sizeof(uint32_t));
+
+    for (size_t r = 0; r < n; ++r)
+    {
+        if (col->kinds[r] == COLUMN_NULL)
+            continue;
+        size_t len;
+        const unsigned char *p = (const unsigned char *)value_bytes(b, col, r, &len);
+        uint64_t h = 14695981039346656037ULL; // FNV-1a
+        for (size_t i = 0; i < len; ++i)
+            h = (h ^ p[i]) * 1099511628211ULL;
+        for (size_t slot = (size_t)h & d->mask;; slot = (slot + 1) & d->mask)
+        {
+            if (!d->slots[slot])
+            {
+                size_t entry_len = col->type == COLUMN_TEXT ? 4 + len : 8;
+                if (d->num_entries == max_entries || d->page_len + entry_len > PARQUET_DICT_MAX_BYTES)
+                {
+                    free_dictionary(d);
+                    return 0;
+                }
+                d->first[d->num_entries] = (uint32_t)r;
+                d->index[r] = (uint32_t)d->num_entries++;
+                d->slots[slot] = (uint32_t)d->num_entries;
+                d->page_len += entry_len;
+                break;
+            }
+            size_t other_len;
+            const void *other = value_bytes(b, col, d->first[d->slots[slot] - 1], &other_len);
+            if (other_len == len && memcmp(other, p, len) == 0)
+            {
+                d->index[r] = d->slots[slot] - 1;
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
+// Orders two values of a column the way Parquet's statistics do (text as unsigned bytes)
+static int compare_values(const RowBatch *b, const BatchColumn *col, size_t r1, size_t r2)
+{
+    const RowValue *x = &col->values[r1], *y = &col->values[r2];
+    switch (col->type)
+    {
+    case COLUMN_INT:
+        return (x->i > y->i) - (x->i < y->i);
+    case COLUMN_FLOAT:
+        return (x->d > y->d) - (x->d < y->d);
+    case COLUMN_BOOL:
+        return x->b - y->b;
+    default:
+    {
+        size_t len = x->s.len < y->s.len ? x->s.len : y->s.len;
+        int c = memcmp(row_batch_text(b, x), row_batch_text(b, y), len);
+        return c ? c : (x->s.len > y->s.len) - (x->s.len < y->s.len);
+    }
+    }
+}
+
+// Statistics value: the PLAIN encoding without a length prefix. A zero is -0.0 as a minimum and
+// +0.0 as a maximum, as the format asks.
+static void put_stat_value(ThriftWriter *t, int id, const RowBatch *b, const BatchColumn *col, size_t r, int is_max)
+{
+    ByteBuf v = {0};
+    if (col->type == COLUMN_BOOL)
+        buf_byte(&v, (unsigned)col->values[r].b);
+    else if (col->type == COLUMN_FLOAT && col->values[r].d == 0)
+        buf_le(&v, is_max ? 0 : 1ULL << 63, 8);
+    else if (col->type == COLUMN_TEXT)
+        buf_put(&v, row_batch_text(b, &col->values[r]), col->values[r].s.len);
+    else
+        put_plain(&v, b, col, r);
+    tw_binary(t, id, v.data, v.len);
+    free(v.data);
+}
+
+static void put_bytes(ParquetFile *p, CsvWriter *w, const void *data, size_t n)
+{
+    csv_writer_write(w, (const char *)data, n);
+    p->offset += n;
+}
+
+// Page header and page (uncompressed, so both sizes are the page's)
+static void put_page(ParquetFile *p, CsvWriter *w, int page_type, const ByteBuf *page, size_t num_values, int encoding)
+{
+    ThriftWriter h = {0};
+    tw_int(&h, 1, THRIFT_I32, page_type);
+    tw_int(&h, 2, THRIFT_I32, (int64_t)page->len);
+    tw_int(&h, 3, THRIFT_I32, (int64_t)page->len);
+    tw_struct(&h, page_type == PARQUET_PAGE_DICTIONARY ? 7 : 5);
+    tw_int(&h, 1, THRIFT_I32, (int64_t)num_values);
+    tw_int(&h, 2, THRIFT_I32, encoding);
+    if (page_type == PARQUET_PAGE_DATA)
+    {
+        tw_int(&h, 3, THRIFT_I32, PARQUET_ENCODING_RLE); // Definition levels
+        tw_int(&h, 4, THRIFT_I32, PARQUET_ENCODING_RLE); // Repetition levels (none)
+    }
+    tw_end(&h);
+    tw_end(&h);
+    put_bytes(p, w, h.out.data, h.out.len);
+    put_bytes(p, w, page->data, page->len);
+    free(h.out.data);
+}
+
+static int physical_type(ColumnType type)
+{
+    switch (type)
+    {
+    case COLUMN_INT:
+        return PARQUET_TYPE_INT64;
+    case COLUMN_FLOAT:
+        return PARQUET_TYPE_DOUBLE;
+    case COLUMN_BOOL:
+        return PARQUET_TYPE_BOOLEAN;
+    default:
+        return PARQUET_TYPE_BYTE_ARRAY;
+    }
+}
+
+// Writes column c's chunk of the batch and appends its ColumnChunk struct to rg
+static void write_column_chunk(ParquetFile *p, RowBatch *b, int c, ThriftWriter *rg)
+{
+    const BatchColumn *col = &b->columns[c];
+    CsvWriter *w = b->out;
+    size_t n = b->num_rows;
+    size_t nulls = 0, min_row = 0, max_row = 0, present = 0;
+    for (size_t r = 0; r < n; ++r)
+    {
+        if (col->kinds[r] == COLUMN_NULL)
+        {
+            nulls++;
+            continue;
+        }
+        if (!present++)
+            min_row = max_row = r;
+        else if (compare_values(b, col, r, min_row) < 0)
+            min_row = r;
+        else if (compare_values(b, col, r, max_row) > 0)
+            max_row = r;
+    }
+
+    ChunkDictionary dict;
+    int use_dict = build_dictionary(b, col, &dict);
+    uint64_t chunk_start = p->offset;
+    ByteBuf page = {0};
+    if (use_dict)
+    {
+        for (size_t e = 0; e < dict.num_entries; ++e)
+            put_plain(&page, b, col, dict.first[e]);
+        put_page(p, w, PARQUET_PAGE_DICTIONARY, &page, dict.num_entries, PARQUET_ENCODING_PLAIN);
+    }
+    uint64_t data_start = p->offset;
+    int index_width = use_dict ? bit_width(dict.num_entries - 1) : 0;
+    uint32_t *levels = (uint32_t *)safe_parquet_realloc(NULL, PARQUET_PAGE_ROWS * sizeof(uint32_t));
+    for (size_t start = 0; start < n; start += PARQUET_PAGE_ROWS)
+    {
+        size_t end = n - start < PARQUET_PAGE_ROWS ? n : start + PARQUET_PAGE_ROWS;
+        page.len = 0;
+        buf_le(&page, 0, 4); // Length of the definition levels, set below
+        for (size_t r = start; r < end; ++r)
+            levels[r - start] = col->kinds[r] != COLUMN_NULL;
+        put_hybrid(&page, levels, end - start, 1);
+        uint32_t levels_len = (uint32_t)(page.len - 4);
+        for (int i = 0; i < 4; ++i)
+            page.data[i] = (unsigned char)(levels_len >> (8 * i));
+
+        if (use_dict)
+        {
+            size_t k = 0;
+            for (size_t r = start; r < end; ++r)
+            {
+                if (col->kinds[r] != COLUMN_NULL)
+                    levels[k++] = dict.index[r];
+            }
+            buf_byte(&page, (unsigned)index_width);
+            put_hybrid(&page, levels, k, index_width);
+        }
+        else if (col->type == COLUMN_BOOL)
+        {
+            unsigned byte = 0, bits = 0;
+            for (size_t r = start; r < end; ++r)
+            {
+                if (col->kinds[r] == COLUMN_NULL)
+                    continue;
+                byte |= (unsigned)(col->values[r].b != 0) << bits;
+                if (++bits == 8)
+                {
+                    buf_byte(&page, byte);
+                    byte = bits = 0;
+                }
+            }
+            if (bits)
+                buf_byte(&page, byte);
+        }
+        else
+        {
+            for (size_t r = start; r < end; ++r)
+            {
+                if (col->kinds[r] != COLUMN_NULL)
+                    put_plain(&page, b, col, r);
+            }
+        }
+        put_page(p, w, PARQUET_PAGE_DATA, &page, end - start, use_dict ? PARQUET_ENCODING_RLE_DICTIONARY : PARQUET_ENCODING_PLAIN);
+    }
+    free(levels);
+    free(page.data);
+    free_dictionary(&dict);
+
+    int64_t chunk_len = (int64_t)(p->offset - chunk_start);
+    tw_begin(rg);
+    tw_int(rg, 2, THRIFT_I64, (int64_t)chunk_start);
+    tw_struct(rg, 3); // ColumnMetaData
+    tw_int(rg, 1, THRIFT_I32, physical_type(col->type));
+    tw_list(rg, 2, THRIFT_I32, use_dict ? 3 : 2);
+    buf_varint(&rg->out, zigzag(PARQUET_ENCODING_PLAIN));
+    buf_varint(&rg->out, zigzag(PARQUET_ENCODING_RLE));
+    if (use_dict)
+        buf_varint(&rg->out, zigzag(PARQUET_ENCODING_RLE_DICTIONARY));
+    tw_list(rg, 3, THRIFT_BINARY, 1);
+    buf_varint(&rg->out, strlen(col->name));
+    buf_put(&rg->out, col->name, strlen(col->name));
+    tw_int(rg, 4, THRIFT_I32, PARQUET_CODEC_UNCOMPRESSED);
+    tw_int(rg, 5, THRIFT_I64, (int64_t)n);
+    tw_int(rg, 6, THRIFT_I64, chunk_len);
+    tw_int(rg, 7, THRIFT_I64, chunk_len);
+    tw_int(rg, 9, THRIFT_I64, (int64_t)data_start);
+    if (use_dict)
+        tw_int(rg, 11, THRIFT_I64, (int64_t)chunk_start);
+    tw_struct(rg, 12); // Statistics
+    tw_int(rg, 3, THRIFT_I64, (int64_t)nulls);
+    if (present && (col->type != COLUMN_TEXT || (col->values[min_row].s.len <= PARQUET_STATS_MAX_LEN &&
+                                                 col->values[max_row].s.len <= PARQUET_STATS_MAX_LEN)))
+    {
+        put_stat_value(rg, 5, b, col, max_row, 1);
+        put_stat_value(rg, 6, b, col, min_row, 0);
+    }
+    tw_end(rg);
+    tw_end(rg);
+    tw_end(rg);
+}
+
+static ParquetFile *start_file(RowBatch *b)
+{
+    if (b->encoder)
+        return (ParquetFile *)b->encoder;
+    ParquetFile *p = (ParquetFile *)safe_parquet_realloc(NULL, sizeof(ParquetFile));
+    memset(p, 0, sizeof(*p));
+    b->encoder = p;
+    put_bytes(p, b->out, PARQUET_MAGIC, 4);
+    return p;
+}
+
+void parquet_write_batch(RowBatch *b)
+{
+    ParquetFile *p = start_file(b);
+    uint64_t group_start = p->offset;
+    ThriftWriter *rg = &p->row_groups;
+    tw_begin(rg);
+    tw_list(rg, 1, THRIFT_STRUCT, (size_t)b->num_columns);
+    for (int c = 0; c < b->num_columns; ++c)
+        write_column_chunk(p, b, c, rg);
+    int64_t group_len = (int64_t)(p->offset - group_start);
+    tw_int(rg, 2, THRIFT_I64, group_len);
+    tw_int(rg, 3, THRIFT_I64, (int64_t)b->num_rows);
+    tw_int(rg, 5, THRIFT_I64, (int64_t)group_start);
+    tw_int(rg, 6, THRIFT_I64, group_len);
+    if (p->num_row_groups <= INT16_MAX)
+        tw_int(rg, 7, THRIFT_I16, (int64_t)p->num_row_groups);
+    tw_end(rg);
+    p->num_row_groups++;
+    p->num_rows += (int64_t)b->num_rows;
+}
+
+void parquet_finish(RowBatch *b)
+{
+    int empty = !b->encoder;
+    ParquetFile *p = start_file(b);
+    ThriftWriter meta = {0}; // FileMetaData
+    tw_int(&meta, 1, THRIFT_I32, PARQUET_FORMAT_VERSION);
+    tw_list(&meta, 2, THRIFT_STRUCT, (size_t)b->num_columns + 1);
+    tw_begin(&meta); // The root of the schema tree, with the columns as its children
+    tw_binary(&meta, 4, "schema", 6);
+    tw_int(&meta, 5, THRIFT_I32, b->num_columns);
+    tw_end(&meta);
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        const BatchColumn *col = &b->columns[c];
+        tw_begin(&meta);
+        tw_int(&meta, 1, THRIFT_I32, physical_type(col->type));
+        tw_int(&meta, 3, THRIFT_I32, PARQUET_OPTIONAL);
+        tw_binary(&meta, 4, col->name, strlen(col->name));
+        if (col->type == COLUMN_TEXT)
+        {
+            tw_int(&meta, 6, THRIFT_I32, PARQUET_CONVERTED_UTF8);
+            tw_struct(&meta, 10); // LogicalType: STRING
+            tw_struct(&meta, 1);
+            tw_end(&meta);
+            tw_end(&meta);
+        }
+        tw_end(&meta);
+    }
+    tw_int(&meta, 3, THRIFT_I64, p->num_rows);
+    tw_list(&meta, 4, THRIFT_STRUCT, p->num_row_groups);
+    buf_put(&meta.out, p->row_groups.out.data, p->row_groups.out.len);
+    tw_binary(&meta, 6, "json2relcsv", strlen("json2relcsv"));
+    tw_list(&meta, 7, THRIFT_STRUCT, (size_t)b->num_columns); // Column orders: the types' own
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        tw_begin(&meta);
+        tw_struct(&meta, 1);
+        tw_end(&meta);
+        tw_end(&meta);
+    }
+    tw_end(&meta);
+
+    CsvWriter *w = b->out;
+    put_bytes(p, w, meta.out.data, meta.out.len);
+    unsigned char footer_len[4];
+    for (int i = 0; i < 4; ++i)
+        footer_len[i] = (unsigned char)(meta.out.len >> (8 * i));
+    put_bytes(p, w, footer_len, 4);
+    put_bytes(p, w, PARQUET_MAGIC, 4);
+    free(meta.out.data);
+    if (empty)
+        csv_writer_end_header(w); // No rows: --skip-empty-tables leaves the file out
+    free(p->row_groups.out.data);
+    free(p);
+    b->encoder = NULL;
+}
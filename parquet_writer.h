@@ -0,0 +1,54 @@
+// parquet_writer.h
+#ifndef PARQUET_WRITER_H
+#define PARQUET_WRITER_H
+
+#include "row_batch.h"
+
+// Parquet output (--format parquet), written without a Parquet library.
+//
+// Each table becomes <name>.parquet: the "PAR1" magic, one row group per row batch (so
+// --batch-rows is the row group size), then the footer: the file metadata in the Thrift compact
+// protocol, its length and the magic again. Columns are optional INT64, DOUBLE, BOOLEAN or
+// BYTE_ARRAY (UTF8) columns, uncompressed, in data pages (version 1) of at most
+// PARQUET_PAGE_ROWS rows with RLE/bit-packed definition levels. A column chunk whose values
+// repeat enough is dictionary encoded (a PLAIN dictionary page, then RLE/bit-packed indices),
+// the others are PLAIN. Every chunk carries its null count and min/max statistics.
+
+#define PARQUET_MAGIC "PAR1"
+#define PARQUET_PAGE_ROWS 20000
+#define PARQUET_DICT_MAX_BYTES (1024 * 1024) // A chunk with a larger dictionary is PLAIN
+
+// Values from parquet.thrift and the Thrift compact protocol, shared with the reader (table_dump.c)
+#define PARQUET_TYPE_BOOLEAN 0
+#define PARQUET_TYPE_INT64 2
+#define PARQUET_TYPE_DOUBLE 5
+#define PARQUET_TYPE_BYTE_ARRAY 6
+#define PARQUET_OPTIONAL 1
+#define PARQUET_CONVERTED_UTF8 0
+#define PARQUET_ENCODING_PLAIN 0
+#define PARQUET_ENCODING_PLAIN_DICTIONARY 2
+#define PARQUET_ENCODING_RLE 3
+#define PARQUET_ENCODING_RLE_DICTIONARY 8
+#define PARQUET_PAGE_DATA 0
+#define PARQUET_PAGE_DICTIONARY 2
+#define PARQUET_PAGE_DATA_V2 3
+#define PARQUET_CODEC_UNCOMPRESSED 0
+
+#define THRIFT_STOP 0
+#define THRIFT_TRUE 1
+#define THRIFT_FALSE 2
+#define THRIFT_BYTE 3
+#define THRIFT_I16 4
+#define THRIFT_I32 5
+#define THRIFT_I64 6
+#define THRIFT_DOUBLE 7
+#define THRIFT_BINARY 8
+#define THRIFT_LIST 9
+#define THRIFT_SET 10
+#define THRIFT_MAP 11
+#define THRIFT_STRUCT 12
+
+void parquet_write_batch(RowBatch *b); // Writes b's rows (types fixed) as one row group
+void parquet_finish(RowBatch *b);      // Writes the footer and frees b->encoder
+
+#endif // PARQUET_WRITER_H
@@ -0,0 +1,156 @@
+// pgcopy_writer.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pgcopy_writer.h"
+
+static void put_be(CsvWriter *w, uint64_t v, size_t n)
+{
+    char be[8];
+    for (size_t i = 0; i < n; ++i)
+        be[i] = (char)(v >> (8 * (n - 1 - i)));
+    csv_writer_write(w, be, n);
+}
+
+static void put_header(CsvWriter *w)
+{
+    csv_writer_write(w, PGCOPY_SIGNATURE, PGCOPY_SIGNATURE_LEN);
+    put_be(w, 0, 4); // Flags: no OIDs
+    put_be(w, 0, 4); // Header extension length
+}
+
+void pgcopy_write_batch(RowBatch *b)
+{
+    CsvWriter *w = b->out;
+    if (b->rows_written == 0)
+        put_header(w);
+    for (size_t r = 0; r < b->num_rows; ++r)
+    {
+        put_be(w, (uint64_t)b->num_columns, 2);
+        for (int c = 0; c < b->num_columns; ++c)
+        {
+            const BatchColumn *col = &b->columns[c];
+            const RowValue *v = &col->values[r];
+            if (col->kinds[r] == COLUMN_NULL)
+            {
+                put_be(w, UINT32_MAX, 4); // -1
+                continue;
+            }
+            switch (col->type)
+            {
+            case COLUMN_INT:
+                put_be(w, 8, 4);
+                put_be(w, (uint64_t)v->i, 8);
+                break;
+            case COLUMN_FLOAT:
+            {
+                uint64_t bits;
+                memcpy(&bits, &v->d, 8);
+                put_be(w, 8, 4);
+                put_be(w, bits, 8);
+                break;
+            }
+            case COLUMN_BOOL:
+                put_be(w, 1, 4);
+                csv_writer_putc(w, (char)(v->b != 0));
+                break;
+            default:
+                put_be(w, v->s.len, 4);
+                csv_writer_write(w, row_batch_text(b, v), v->s.len);
+                break;
+            }
+        }
+    }
+}
+
+static void write_identifier(CsvWriter *w, const char *name)
+{
+    csv_writer_putc(w, '"');
+    for (const char *p = name; *p; ++p)
+    {
+        if (*p == '"')
+            csv_writer_putc(w, '"');
+        csv_writer_putc(w, *p);
+    }
+    csv_writer_putc(w, '"');
+}
+
+static const char *sql_type(ColumnType type)
+{
+    switch (type)
+    {
+    case COLUMN_INT:
+        return "bigint";
+    case COLUMN_FLOAT:
+        return "double precision";
+    case COLUMN_BOOL:
+        return "boolean";
+    default:
+        return "text";
+    }
+}
+
+// <name>.sql next to <name>.pgcopy: the table the tuples fit, and how to load them
+static void write_ddl(RowBatch *b)
+{
+    const char *path = b->out->path;
+    const char *suffix = NULL;
+    for (const char *p = strstr(path, ".pgcopy"); p; p = strstr(p + 1, ".pgcopy"))
+        suffix = p;
+    if (!suffix)
+        return;
+    const char *table = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    size_t dir_len = (size_t)(table - path), table_len = (size_t)(suffix - table);
+    char *ddl_path = (char *)malloc(dir_len + table_len + 5);
+    char *name = (char *)malloc(table_len + 1);
+    if (!ddl_path || !name)
+    {
+        perror("Error: pgcopy_writer malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(ddl_path, path, dir_len + table_len);
+    memcpy(ddl_path + dir_len + table_len, ".sql", 5);
+    memcpy(name, table, table_len);
+    name[table_len] = '\0';
+
+    CsvWriter *w = csv_writer_create(ddl_path);
+    csv_writer_puts(w, "CREATE TABLE ");
+    write_identifier(w, name);
+    csv_writer_puts(w, " (\n");
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        csv_writer_puts(w, "    ");
+        write_identifier(w, b->columns[c].name);
+        csv_writer_putc(w, ' ');
+        csv_writer_puts(w, sql_type(b->columns[c].type));
+        csv_writer_puts(w, c < b->num_columns - 1 ? ",\n" : "\n");
+    }
+    csv_writer_puts(w, ");\n-- \\copy ");
+    write_identifier(w, name);
+    csv_writer_puts(w, " FROM '");
+    for (const char *p = name; *p; ++p)
+    {
+        if (*p == '\'')
+            csv_writer_putc(w, '\'');
+        csv_writer_putc(w, *p);
+    }
+    csv_writer_puts(w, ".pgcopy' WITH (FORMAT binary)\n");
+    if (b->rows_written == 0)
+        csv_writer_end_header(w); // Left out with the data file by --skip-empty-tables
+    csv_writer_close(w);
+    free(ddl_path);
+    free(name);
+}
+
+void pgcopy_finish(RowBatch *b)
+{
+    CsvWriter *w = b->out;
+    if (b->rows_written == 0)
+        put_header(w);
+    put_be(w, UINT16_MAX, 2); // Trailer: a field count of -1
+    if (b->rows_written == 0)
+        csv_writer_end_header(w); // No rows: --skip-empty-tables leaves the file out
+    write_ddl(b);
+}
@@ -0,0 +1,22 @@
+// pgcopy_writer.h
+#ifndef PGCOPY_WRITER_H
+#define PGCOPY_WRITER_H
+
+#include "row_batch.h"
+
+// PostgreSQL binary COPY output (--format pgcopy).
+//
+// Each table becomes <name>.pgcopy, loadable with COPY ... FROM ... WITH (FORMAT binary): the
+// signature, flags and header extension length, one tuple per row (field count, then each
+// field's byte length, -1 for a null, and its value in network byte order) and the -1 trailer.
+// The binary format carries no types, so <name>.sql next to it holds the CREATE TABLE the data
+// matches: bigint for integers (the keys included), double precision for other numbers,
+// boolean and text.
+
+#define PGCOPY_SIGNATURE "PGCOPY\n\377\r\n" // And a NUL: 11 bytes
+#define PGCOPY_SIGNATURE_LEN 11
+
+void pgcopy_write_batch(RowBatch *b); // Writes b's rows (types fixed) as tuples
+void pgcopy_finish(RowBatch *b);      // Writes the trailer and the table's .sql
+
+#endif // PGCOPY_WRITER_H
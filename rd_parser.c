@@ -0,0 +1,641 @@
+// rd_parser.c
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h> // For the parallel root-array mode
+
+#include "rd_parser.h"
+#include "json_source.h" // Shared NUMBER/literal scanners
+
+typedef enum
+{
+    RD_EOF,
+    RD_LBRACE,
+    RD_RBRACE,
+    RD_LBRACKET,
+    RD_RBRACKET,
+    RD_COMMA,
+    RD_COLON,
+    RD_STRING,
+    RD_NUMBER,
+    RD_TRUE,
+    RD_FALSE,
+    RD_NULL,
+    RD_ERROR // Lexical error (already reported)
+} RdToken;
+
+typedef struct RdParser
+{
+    const char *data; // Start of the whole input (for offsets)
+    const char *p, *end;
+    int quiet; // Speculative chunk parses fail silently; the sequential fallback reports
+    int line, column; // Flex's yylineno / yycolumn
+
+    int ws_line, ws_column; // Location of the last whitespace match since the previous token (0: none)
+
+    // Current lookahead token and its location (bison's yylloc.first_line/first_column)
+    RdToken tok;
+    const char *tok_text;
+    size_t tok_len;
+    int tok_line, tok_column;
+} RdParser;
+
+// STRING \"([^\"\\]|\\.)*\" -- returns the token length, or 0 if the string is not terminated.
+// Newlines inside the string are counted in *newlines (flex's yylineno sees them too).
+static size_t scan_string(const char *p, const char *end, int *newlines)
+{
+    int nl = 0;
+    for (const char *q = p + 1; q < end; ++q)
+    {
+        if (*q == '"')
+        {
+            *newlines = nl;
+            return (size_t)(q + 1 - p);
+        }
+        if (*q == '\\')
+        {
+            if (q + 1 >= end || q[1] == '\n')
+                return 0;
+            q++;
+        }
+        else if (*q == '\n')
+        {
+            nl++;
+        }
+    }
+    return 0;
+}
+
+static void rd_advance(RdParser *P)
+{
+    for (;;)
+    {
+        if (P->p >= P->end)
+        {
+            // Flex runs no user action at end of input, so yylloc keeps the location of the last
+            // match, which may be whitespace
+            P->tok = RD_EOF;
+            P->tok_text = P->p;
+            P->tok_len = 0;
+            if (P->ws_line)
+            {
+                P->tok_line = P->ws_line;
+                P->tok_column = P->ws_column;
+            }
+            return;
+        }
+        char c = *P->p;
+        if (c == ' ' || c == '\t' || c == '\r')
+        { // WHITESPACE [ \t\r]+ is one match
+            P->ws_line = P->line;
+            P->ws_column = P->column;
+            while (P->p < P->end && (*P->p == ' ' || *P->p == '\t' || *P->p == '\r'))
+            {
+                P->p++;
+                P->column++;
+            }
+            continue;
+        }
+        if (c == '\n')
+        {
+            P->p++;
+            P->line++;
+            P->ws_line = P->line; // yylineno is already bumped when YY_USER_ACTION runs
+            P->ws_column = P->column;
+            P->column = 1;
+            continue;
+        }
+        break;
+    }
+    P->ws_line = 0;
+
+    const char *start = P->p;
+    size_t len = 1;
+    int newlines = 0;
+    RdToken tok;
+    switch (*start)
+    {
+    case '{':
+        tok = RD_LBRACE;
+        break;
+    case '}':
+        tok = RD_RBRACE;
+        break;
+    case '[':
+        tok = RD_LBRACKET;
+        break;
+    case ']':
+        tok = RD_RBRACKET;
+        break;
+    case ',':
+        tok = RD_COMMA;
+        break;
+    case ':':
+        tok = RD_COLON;
+        break;
+    case '"':
+        len = scan_string(start, P->end, &newlines);
+        tok = RD_STRING;
+        break;
+    case 't':
+    case 'f':
+    case 'n':
+        len = json_scan_literal(start, P->end);
+        tok = *start == 't' ? RD_TRUE : (*start == 'f' ? RD_FALSE : RD_NULL);
+        break;
+    default:
+        len = json_scan_number(start, P->end);
+        tok = RD_NUMBER;
+        break;
+    }
+
+    if (len == 0)
+    { // Flex's catch-all '.' rule
+        if (!P->quiet)
+            fprintf(stderr, "Lexical Error: Unexpected character '%c' at line %d, column %d\n", *start, P->line, P->column);
+        P->tok = RD_ERROR;
+        return;
+    }
+
+    P->line += newlines;
+    P->tok = tok;
+    P->tok_text = start;
+    P->tok_len = len;
+    P->tok_line = P->line;
+    P->tok_column = P->column;
+    P->column += (int)len;
+    P->p = start + len;
+}
+
+static void rd_syntax_error(RdParser *P, const char *msg)
+{
+    if (P->tok == RD_ERROR || P->quiet)
+        return; // The lexer already reported it
+    fprintf(stderr, "Syntax Error: %s at line %d, column %d.\n", msg, P->tok_line, P->tok_column);
+}
+
+// Consumes the lookahead token. stack_size is the number of entries bison's state stack would
+// hold after shifting it; bison gives up with "memory exhausted" once that reaches YYMAXDEPTH,
+// before it reads the next token.
+static int rd_shift(RdParser *P, int stack_size)
+{
+    if (stack_size >= RD_MAX_STACK)
+    {
+        rd_syntax_error(P, "memory exhausted");
+        return -1;
+    }
+    rd_advance(P);
+    return 0;
+}
+
+static JsonValue *rd_parse_value(RdParser *P, int stack_size);
+
+// object: "{" "}" | "{" members "}" -- entered with '{' as the lookahead.
+// stack_size counts the bison states below the object; members/pairs are reduced as they complete,
+// so the stack holds '{' members ',' STRING ':' at most.
+static JsonValue *rd_parse_object(RdParser *P, int stack_size)
+{
+    JsonValue *obj = ast_create_object();
+    if (rd_shift(P, stack_size + 1) != 0)
+        goto failed;
+    if (P->tok == RD_RBRACE)
+    {
+        if (rd_shift(P, stack_size + 2) != 0)
+            goto failed;
+        return obj;
+    }
+    int base = stack_size + 1; // '{', then '{' members ','
+    for (;;)
+    {
+        if (P->tok != RD_STRING)
+            goto syntax_error;
+        char *key = unescape_json_string(P->tok_text, (int)P->tok_len);
+        if (rd_shift(P, base + 1) != 0)
+        {
+            free(key);
+            goto failed;
+        }
+        if (P->tok != RD_COLON)
+        {
+            free(key);
+            goto syntax_error;
+        }
+        if (rd_shift(P, base + 2) != 0)
+        {
+            free(key);
+            goto failed;
+        }
+        JsonValue *member = rd_parse_value(P, base + 2);
+        if (!member)
+        {
+            free(key);
+            goto failed;
+        }
+        ast_object_add_member(obj, key, member);
+
+        if (P->tok == RD_COMMA)
+        {
+            if (rd_shift(P, stack_size + 3) != 0)
+                goto failed;
+            base = stack_size + 3;
+            continue;
+        }
+        if (P->tok == RD_RBRACE)
+        {
+            if (rd_shift(P, stack_size + 3) != 0)
+                goto failed;
+            return obj;
+        }
+        goto syntax_error;
+    }
+
+syntax_error:
+    rd_syntax_error(P, "syntax error");
+failed:
+    ast_free_value(obj);
+    return NULL;
+}
+
+// array: "[" "]" | "[" elements "]" -- entered with '[' as the lookahead
+static JsonValue *rd_parse_array(RdParser *P, int stack_size)
+{
+    JsonValue *arr = ast_create_array();
+    if (rd_shift(P, stack_size + 1) != 0)
+        goto failed;
+    if (P->tok == RD_RBRACKET)
+    {
+        if (rd_shift(P, stack_size + 2) != 0)
+            goto failed;
+        return arr;
+    }
+    int base = stack_size + 1; // '[', then '[' elements ','
+    for (;;)
+    {
+        JsonValue *element = rd_parse_value(P, base);
+        if (!element)
+            goto failed;
+        ast_array_append(arr, element);
+
+        if (P->tok == RD_COMMA)
+        {
+            if (rd_shift(P, stack_size + 3) != 0)
+                goto failed;
+            base = stack_size + 3;
+            continue;
+        }
+        if (P->tok == RD_RBRACKET)
+        {
+            if (rd_shift(P, stack_size + 3) != 0)
+                goto failed;
+            return arr;
+        }
+        rd_syntax_error(P, "syntax error");
+        goto failed;
+    }
+
+failed:
+    ast_free_value(arr);
+    return NULL;
+}
+
+// stack_size: bison states on the stack before the value's first token is shifted
+static JsonValue *rd_parse_value(RdParser *P, int stack_size)
+{
+    JsonValue *v;
+    switch (P->tok)
+    {
+    case RD_LBRACE:
+        return rd_parse_object(P, stack_size);
+    case RD_LBRACKET:
+        return rd_parse_array(P, stack_size);
+    case RD_STRING:
+        v = ast_create_string_from_lexeme(P->tok_text, (int)P->tok_len);
+        break;
+    case RD_NUMBER:
+        v = ast_create_number(json_lexeme_to_double(P->tok_text, P->tok_len));
+        break;
+    case RD_TRUE:
+        v = ast_create_boolean(1);
+        break;
+    case RD_FALSE:
+        v = ast_create_boolean(0);
+        break;
+    case RD_NULL:
+        v = ast_create_null();
+        break;
+    default:
+        rd_syntax_error(P, "syntax error");
+        return NULL;
+    }
+    if (rd_shift(P, stack_size + 1) != 0)
+    {
+        ast_free_value(v);
+        return NULL;
+    }
+    return v;
+}
+
+static void rd_init(RdParser *P, const char *data, size_t len, size_t start)
+{
+    memset(P, 0, sizeof(*P));
+    P->data = data;
+    P->p = data + start;
+    P->end = data + len;
+    P->line = 1;
+    P->column = 1;
+    P->tok_line = 1; // Bison's initial yylloc
+    P->tok_column = 1;
+}
+
+JsonValue *rd_parse_ast(const char *data, size_t len)
+{
+    RdParser P;
+    rd_init(&P, data, len, 0);
+
+    rd_advance(&P);
+    JsonValue *root = rd_parse_value(&P, 1); // Bison's stack starts with state 0
+    if (!root)
+        return NULL;
+    if (P.tok != RD_EOF)
+    { // json_document: value -- anything after the value is an error
+        rd_syntax_error(&P, "syntax error");
+        ast_free_value(root);
+        return NULL;
+    }
+    return root;
+}
+
+// --- Parallel parsing of a root array ---
+
+static int rd_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int rd_quote_is_escaped(const char *data, size_t i)
+{
+    size_t backslashes = 0;
+    while (i > backslashes && data[i - 1 - backslashes] == '\\')
+        backslashes++;
+    return backslashes & 1;
+}
+
+// Guesses an element start at or after from: a '{' that follows a ',' outside any string.
+// Unless from is known to be outside a string, it first synchronizes on a key's closing quote
+// (an unescaped '"' followed by ':'), then tracks quote parity from there.
+// Returns len if nothing plausible is found. The guess may still be inside a nested array.
+static size_t rd_find_element_start(const char *data, size_t len, size_t from, int outside_string)
+{
+    size_t i = from;
+    if (!outside_string)
+    {
+        for (; i < len; ++i)
+        {
+            if (data[i] != '"' || rd_quote_is_escaped(data, i))
+                continue;
+            size_t j = i + 1;
+            while (j < len && rd_is_space(data[j]))
+                j++;
+            if (j < len && data[j] == ':')
+                break;
+        }
+        i++; // Just past the key's closing quote
+    }
+    int in_string = 0;
+    for (; i < len; ++i)
+    {
+        char c = data[i];
+        if (in_string)
+        {
+            if (c == '\\')
+                i++;
+            else if (c == '"')
+                in_string = 0;
+        }
+        else if (c == '"')
+        {
+            in_string = 1;
+        }
+        else if (c == ',')
+        {
+            size_t j = i + 1;
+            while (j < len && rd_is_space(data[j]))
+                j++;
+            if (j < len && data[j] == '{')
+                return j;
+        }
+    }
+    return len;
+}
+
+// A byte range of the root array's elements, parsed on its own thread
+typedef struct RdChunk
+{
+    const char *data;
+    size_t len;
+    size_t begin;        // Offset of the chunk's first element (a guess until stitched)
+    size_t limit;        // Stop before the first element that starts at or after this offset
+    int speculative;     // begin is a guess: on a mismatch, guess again further on
+    JsonValue *elements; // Parsed elements, in order
+    size_t end;          // Offset of the element after the last one parsed, or of the closing ']'
+    int closed;          // Stopped at the root array's ']'
+    int ok;
+} RdChunk;
+
+// Parses "value (',' value)*" from chunk->begin up to chunk->limit. Returns 1 on success, or 0 and
+// the offset reached in *fail_at.
+static int rd_parse_chunk_from(RdChunk *chunk, size_t *fail_at)
+{
+    RdParser P;
+    rd_init(&P, chunk->data, chunk->len, chunk->begin);
+    P.quiet = 1;
+
+    rd_advance(&P);
+    for (;;)
+    {
+        JsonValue *element = rd_parse_value(&P, 3); // State 0, '[', elements ',' below each element
+        if (!element)
+            break;
+        ast_array_append(chunk->elements, element);
+
+        if (P.tok == RD_RBRACKET)
+        {
+            // The root array's ']' is followed by nothing but whitespace; any other ']' means the
+            // guessed start was inside a nested array
+            const char *q = P.tok_text + 1;
+            while (q < P.end && rd_is_space(*q))
+                q++;
+            if (q != P.end)
+                break;
+            chunk->end = (size_t)(P.tok_text - P.data);
+            chunk->closed = 1;
+            return 1;
+        }
+        if (P.tok != RD_COMMA)
+            break;
+        rd_advance(&P);
+        if (P.tok == RD_EOF || P.tok == RD_ERROR)
+            break;
+        size_t next = (size_t)(P.tok_text - P.data);
+        if (next >= chunk->limit)
+        {
+            chunk->end = next;
+            return 1;
+        }
+    }
+    *fail_at = (size_t)(P.p - P.data);
+    return 0;
+}
+
+// Only valid if begin really is an element start, which the caller checks when stitching.
+// A speculative chunk that hits something unexpected guesses a new start past that point.
+static void rd_parse_chunk(RdChunk *chunk)
+{
+    chunk->ok = 0;
+    chunk->closed = 0;
+    for (;;)
+    {
+        size_t fail_at;
+        chunk->elements = ast_create_array();
+        if (rd_parse_chunk_from(chunk, &fail_at))
+        {
+            chunk->ok = 1;
+            return;
+        }
+        ast_free_value(chunk->elements);
+        chunk->elements = NULL;
+        if (!chunk->speculative)
+            return;
+        // The parser stopped between tokens, so the retry scan starts outside any string
+        size_t retry = rd_find_element_start(chunk->data, chunk->len, fail_at, 1);
+        if (retry >= chunk->limit)
+            return;
+        chunk->begin = retry;
+    }
+}
+
+static void *rd_chunk_thread(void *arg)
+{
+    rd_parse_chunk((RdChunk *)arg);
+    return NULL;
+}
+
+JsonValue *rd_parse_ast_parallel(const char *data, size_t len, int num_threads)
+{
+    size_t first = 0;
+    while (first < len && rd_is_space(data[first]))
+        first++;
+    if (num_threads <= 1 || len < RD_PARALLEL_MIN_BYTES || first >= len || data[first] != '[')
+        return rd_parse_ast(data, len);
+    size_t elements_begin = first + 1;
+    while (elements_begin < len && rd_is_space(data[elements_begin]))
+        elements_begin++;
+    if (elements_begin >= len || data[elements_begin] == ']')
+        return rd_parse_ast(data, len);
+
+    // Speculative chunk starts, roughly len / num_threads apart
+    RdChunk *chunks = (RdChunk *)calloc((size_t)num_threads, sizeof(RdChunk));
+    pthread_t *threads = (pthread_t *)calloc((size_t)num_threads, sizeof(pthread_t));
+    if (!chunks || !threads)
+    {
+        perror("Error: rd_parser calloc failed");
+        exit(EXIT_FAILURE);
+    }
+    int num_chunks = 0;
+    chunks[num_chunks++].begin = elements_begin;
+    for (int i = 1; i < num_threads; ++i)
+    {
+        size_t guess = elements_begin + (len - elements_begin) / (size_t)num_threads * (size_t)i;
+        if (guess <= chunks[num_chunks - 1].begin)
+            continue;
+        size_t start = rd_find_element_start(data, len, guess, 0);
+        if (start < len)
+            chunks[num_chunks++].begin = start;
+    }
+    for (int i = 0; i < num_chunks; ++i)
+    {
+        chunks[i].data = data;
+        chunks[i].len = len;
+        chunks[i].limit = i + 1 < num_chunks ? chunks[i + 1].begin : len;
+        chunks[i].speculative = i > 0;
+    }
+
+    int *started = (int *)calloc((size_t)num_chunks, sizeof(int));
+    if (!started)
+    {
+        perror("Error: rd_parser calloc failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 1; i < num_chunks; ++i)
+        started[i] = pthread_create(&threads[i], NULL, rd_chunk_thread, &chunks[i]) == 0;
+    rd_parse_chunk(&chunks[0]);
+    for (int i = 1; i < num_chunks; ++i)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            rd_parse_chunk(&chunks[i]); // Could not start a thread: parse it here
+    }
+
+    // Stitch in order. pos is where the verified prefix ends; a chunk is only used if it starts
+    // exactly there, after parsing any gap left by a chunk that moved its guess forward.
+    // Otherwise its range is re-parsed from pos.
+    JsonValue *root = ast_create_array();
+    size_t pos = elements_begin;
+    int closed = 0, failed = 0;
+    for (int i = 0; i < num_chunks && !closed && !failed; ++i)
+    {
+        RdChunk *c = &chunks[i];
+        if (pos >= c->limit)
+            continue; // The previous chunk already covered this range
+        if (c->ok && pos < c->begin)
+        {
+            RdChunk gap = *c;
+            gap.begin = pos;
+            gap.limit = c->begin;
+            gap.speculative = 0;
+            rd_parse_chunk(&gap);
+            if (gap.ok)
+            {
+                ast_array_splice(root, gap.elements);
+                pos = gap.end;
+                closed = gap.closed;
+            }
+            ast_free_value(gap.elements);
+            if (!gap.ok || closed)
+            {
+                failed = !gap.ok;
+                break;
+            }
+        }
+        if (!c->ok || c->begin != pos)
+        {
+            ast_free_value(c->elements);
+            c->begin = pos;
+            c->speculative = 0;
+            rd_parse_chunk(c);
+            if (!c->ok)
+            {
+                failed = 1;
+                break;
+            }
+        }
+        ast_array_splice(root, c->elements);
+        pos = c->end;
+        closed = c->closed;
+    }
+
+    for (int i = 0; i < num_chunks; ++i)
+        ast_free_value(chunks[i].elements);
+    free(started);
+    free(threads);
+    free(chunks);
+
+    if (!closed || failed)
+    { // Not a well-formed array: the sequential parser reports the error exactly like flex/bison
+        ast_free_value(root);
+        return rd_parse_ast(data, len);
+    }
+    return root;
+}
@@ -0,0 +1,31 @@
+// rd_parser.h
+#ifndef RD_PARSER_H
+#define RD_PARSER_H
+
+#include <stddef.h> // For size_t
+
+#include "ast.h"
+
+// Hand-written recursive-descent parser (alternative to scanner.l + parser.y, --parser rd).
+//
+// Accepts exactly the grammar of parser.y with the tokens of scanner.l and builds the AST through
+// the same ast_create_* / ast_*_append calls. Line/column tracking follows flex (yylineno counts
+// every newline, yycolumn is only reset by a newline token), so lexical and syntax errors are
+// reported with the same messages and positions. Unlike yyerror, errors do not exit.
+// Nesting depth is limited the way bison's state stack limits it.
+
+#define RD_MAX_STACK 10000 // Bison's YYMAXDEPTH: deeper nesting is reported as "memory exhausted"
+
+// Parses data[0..len). Returns the root, or NULL on error (the error has already been reported
+// and any partial tree freed).
+JsonValue *rd_parse_ast(const char *data, size_t len);
+
+// Same result, but if the document is one large root array its elements are parsed on
+// num_threads threads. The byte range is split into chunks that start at a guessed element
+// boundary (found with quote-parity tracking); chunk results are stitched back in document order,
+// and any chunk whose guess turns out wrong is re-parsed from the true boundary. Invalid input
+// falls back to the sequential parser, so errors are reported exactly as by rd_parse_ast.
+#define RD_PARALLEL_MIN_BYTES (1 << 20) // Smaller inputs are parsed sequentially
+JsonValue *rd_parse_ast_parallel(const char *data, size_t len, int num_threads);
+
+#endif // RD_PARSER_H
@@ -0,0 +1,504 @@
+// row_batch.c
+#define _POSIX_C_SOURCE 200809L // For pwrite, pread
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>   // For signbit
+#include <errno.h>
+#include <fcntl.h>  // For open
+#include <unistd.h> // For pwrite, pread
+
+#include "row_batch.h"
+#include "arrow_writer.h"
+#include "parquet_writer.h"
+#include "pgcopy_writer.h"
+
+static OutputFormat G_format = OUTPUT_CSV;
+static size_t G_rows_per_batch = ROW_BATCH_DEFAULT_ROWS;
+static RowBatch **G_batches = NULL; // Open batches, ended by the exit handler on an error exit
+static size_t G_num_batches = 0, G_batches_cap = 0;
+static int G_exit_registered = 0;
+static int G_at_exit = 0;      // Inside the exit handler, where a failed batch can only be dropped
+static int G_spool_fd = -1;    // Batches of tables whose types are not final (unlinked right away)
+static off_t G_spool_end = 0;
+
+static void *safe_batch_realloc(void *ptr, size_t size)
+{
+    void *grown = realloc(ptr, size);
+    if (!grown)
+    {
+        perror("Error: row_batch realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+void row_batches_configure(OutputFormat format, size_t rows_per_batch)
+{
+    G_format = format;
+    G_rows_per_batch = rows_per_batch ? rows_per_batch : ROW_BATCH_DEFAULT_ROWS;
+}
+
+OutputFormat row_batch_format(void)
+{
+    return G_format;
+}
+
+const char *output_format_suffix(OutputFormat format)
+{
+    switch (format)
+    {
+    case OUTPUT_ARROW:
+        return ".arrow";
+    case OUTPUT_PARQUET:
+        return ".parquet";
+    case OUTPUT_PGCOPY:
+        return ".pgcopy";
+    case OUTPUT_CSV:
+    default:
+        return ".csv";
+    }
+}
+
+ColumnType column_type_merge(ColumnType a, ColumnType b)
+{
+    if (a == b || b == COLUMN_NULL)
+        return a;
+    if (a == COLUMN_NULL)
+        return b;
+    if ((a == COLUMN_INT && b == COLUMN_FLOAT) || (a == COLUMN_FLOAT && b == COLUMN_INT))
+        return COLUMN_FLOAT;
+    return COLUMN_TEXT;
+}
+
+ColumnType column_type_of_number(double d)
+{
+    // Whole numbers up to 2^53 are exact in the parsed double; -0 stays a float
+    if (d >= -9007199254740992.0 && d <= 9007199254740992.0 && d == (double)(int64_t)d && !(d == 0 && signbit(d)))
+        return COLUMN_INT;
+    return COLUMN_FLOAT;
+}
+
+// Appends len bytes to the batch's text and returns where they start
+static size_t append_text(RowBatch *b, const char *s, size_t len)
+{
+    if (b->text_cap - b->text_len < len + 1)
+    {
+        size_t cap = b->text_cap ? b->text_cap : 4096;
+        while (cap - b->text_len < len + 1)
+            cap *= 2;
+        b->text = (char *)safe_batch_realloc(b->text, cap);
+        b->text_cap = cap;
+    }
+    size_t off = b->text_len;
+    memcpy(b->text + off, s, len);
+    b->text[off + len] = '\0';
+    b->text_len += len + 1;
+    return off;
+}
+
+// Widens each column's declared type by the values of the first batch. A column without values
+// so far is text, except in a table that spools, where its later values decide.
+static void fix_types(RowBatch *b)
+{
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        BatchColumn *col = &b->columns[c];
+        for (size_t r = 0; r < b->num_rows; ++r)
+            col->type = column_type_merge(col->type, (ColumnType)col->kinds[r]);
+        if (col->type == COLUMN_NULL && b->types_final)
+            col->type = COLUMN_TEXT;
+    }
+    b->types_fixed = 1;
+}
+
+static const char *column_type_name(ColumnType type)
+{
+    switch (type)
+    {
+    case COLUMN_BOOL:
+        return "boolean";
+    case COLUMN_INT:
+        return "integer";
+    case COLUMN_FLOAT:
+        return "float";
+    case COLUMN_TEXT:
+        return "text";
+    default:
+        return "null";
+    }
+}
+
+// Checks the batch's values against the column types. Text columns take any value (as CSV would
+// print it) and float columns integers. A table that spools has not encoded any batch yet, so its
+// types widen to take in every value, as discovery's would. In a table typed by full discovery a
+// value that does not fit is an error, and the file keeps the earlier batches.
+static void check_values(RowBatch *b)
+{
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        BatchColumn *col = &b->columns[c];
+        for (size_t r = 0; r < b->num_rows; ++r)
+        {
+            ColumnType kind = (ColumnType)col->kinds[r];
+            if (kind == COLUMN_NULL || kind == col->type || col->type == COLUMN_TEXT ||
+                (col->type == COLUMN_FLOAT && kind == COLUMN_INT))
+                continue;
+            if (!b->types_final)
+            {
+                col->type = column_type_merge(col->type, kind);
+                continue;
+            }
+            fprintf(stderr, "Error: %s: a %s value in the %s column \"%s\", whose type discovery fixed.\n",
+                    b->out->path, column_type_name(kind), column_type_name(col->type), col->name);
+            b->num_rows = 0;
+            b->text_len = 0;
+            if (!G_at_exit)
+                exit(EXIT_FAILURE);
+            return;
+        }
+    }
+}
+
+// Converts every value to its column's type (as CSV would print it, for text)
+static void convert_values(RowBatch *b)
+{
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        BatchColumn *col = &b->columns[c];
+        for (size_t r = 0; r < b->num_rows; ++r)
+        {
+            ColumnType kind = (ColumnType)col->kinds[r];
+            if (kind == COLUMN_NULL || kind == col->type)
+                continue;
+            RowValue *v = &col->values[r];
+            if (col->type == COLUMN_FLOAT && kind == COLUMN_INT)
+                v->d = (double)v->i;
+            else
+            {
+                char num[32];
+                const char *s = num;
+                if (kind == COLUMN_BOOL)
+                    s = v->b ? "true" : "false";
+                else
+                    snprintf(num, sizeof(num), "%g", kind == COLUMN_INT ? (double)v->i : v->d);
+                size_t len = strlen(s);
+                v->s.off = append_text(b, s, len);
+                v->s.len = len;
+            }
+            col->kinds[r] = (unsigned char)col->type;
+        }
+    }
+}
+
+static void encode_batch(RowBatch *b)
+{
+    convert_values(b);
+    b->encoding = 1;
+    switch (G_format)
+    {
+    case OUTPUT_ARROW:
+        arrow_write_batch(b);
+        break;
+    case OUTPUT_PARQUET:
+        parquet_write_batch(b);
+        break;
+    case OUTPUT_PGCOPY:
+        pgcopy_write_batch(b);
+        break;
+    case OUTPUT_CSV:
+    default:
+        break;
+    }
+    b->encoding = 0;
+    b->rows_written += b->num_rows;
+    b->num_rows = 0;
+    b->text_len = 0;
+}
+
+// --- Spool log: the batches of tables whose types are not final, until the tables are closed ---
+
+// Created next to the first table that spools, like the spill log of --io-backend spill
+static void open_spool_log(const char *table_path)
+{
+    const char *slash = strrchr(table_path, '/');
+    int dir_len = slash ? (int)(slash - table_path) + 1 : 0;
+    size_t path_len = (size_t)dir_len + 64;
+    char *path = (char *)safe_batch_realloc(NULL, path_len);
+    snprintf(path, path_len, "%.*s.json2relcsv-spool-%ld", dir_len, table_path, (long)getpid());
+    G_spool_fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (G_spool_fd < 0)
+    {
+        perror("Error creating spool log");
+        fprintf(stderr, "Failed to open: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    unlink(path); // Nothing to clean up however the program ends
+    free(path);
+}
+
+static void spool_write(const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    while (len > 0)
+    {
+        ssize_t n = pwrite(G_spool_fd, p, len, G_spool_end);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Error writing spool log");
+            exit(EXIT_FAILURE);
+        }
+        p += n;
+        len -= (size_t)n;
+        G_spool_end += n;
+    }
+}
+
+// Reads len bytes at *offset and moves past them; -1 after reporting an error
+static int spool_read(void *data, size_t len, off_t *offset)
+{
+    char *p = (char *)data;
+    while (len > 0)
+    {
+        ssize_t n = pread(G_spool_fd, p, len, *offset);
+        if (n <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+                continue;
+            perror("Error reading spool log");
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        *offset += n;
+    }
+    return 0;
+}
+
+// Appends the batch to the spool log as it is: its row and text counts, each column's kinds and
+// values, then the text
+static void spool_batch(RowBatch *b)
+{
+    if (G_spool_fd < 0)
+        open_spool_log(b->out->path);
+    if (b->num_spooled == b->spooled_cap)
+    {
+        b->spooled_cap = b->spooled_cap ? b->spooled_cap * 2 : 16;
+        b->spooled = (off_t *)safe_batch_realloc(b->spooled, b->spooled_cap * sizeof(off_t));
+    }
+    b->spooled[b->num_spooled++] = G_spool_end;
+    size_t counts[2] = {b->num_rows, b->text_len};
+    spool_write(counts, sizeof(counts));
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        spool_write(b->columns[c].kinds, b->num_rows);
+        spool_write(b->columns[c].values, b->num_rows * sizeof(RowValue));
+    }
+    spool_write(b->text, b->text_len);
+    b->num_rows = 0;
+    b->text_len = 0;
+}
+
+// Reads spooled batch i back into b (whose arrays held it once, so they are large enough)
+static int unspool_batch(RowBatch *b, size_t i)
+{
+    off_t offset = b->spooled[i];
+    size_t counts[2];
+    if (spool_read(counts, sizeof(counts), &offset) != 0)
+        return -1;
+    b->num_rows = counts[0];
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        if (spool_read(b->columns[c].kinds, b->num_rows, &offset) != 0 ||
+            spool_read(b->columns[c].values, b->num_rows * sizeof(RowValue), &offset) != 0)
+            return -1;
+    }
+    b->text_len = counts[1];
+    return spool_read(b->text, b->text_len, &offset);
+}
+
+// Ends the current batch: the first one fixes the types; then it is encoded, or spooled
+static void end_batch(RowBatch *b)
+{
+    if (!b->types_fixed)
+        fix_types(b);
+    check_values(b);
+    if (b->types_final)
+        encode_batch(b);
+    else if (b->num_rows > 0)
+        spool_batch(b);
+}
+
+// Encodes what is left (the spooled batches first) and ends the file
+static void finish_file(RowBatch *b)
+{
+    if (b->num_rows > 0)
+        end_batch(b);
+    if (!b->types_fixed)
+        fix_types(b);
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        if (b->columns[c].type == COLUMN_NULL)
+            b->columns[c].type = COLUMN_TEXT; // All null
+    }
+    for (size_t i = 0; i < b->num_spooled; ++i)
+    {
+        if (unspool_batch(b, i) != 0)
+        {
+            b->num_rows = 0;
+            break; // The file ends with the batches read back so far
+        }
+        encode_batch(b);
+    }
+    b->num_spooled = 0;
+    b->encoding = 1;
+    switch (G_format)
+    {
+    case OUTPUT_ARROW:
+        arrow_finish(b);
+        break;
+    case OUTPUT_PARQUET:
+        parquet_finish(b);
+        break;
+    case OUTPUT_PGCOPY:
+        pgcopy_finish(b);
+        break;
+    case OUTPUT_CSV:
+    default:
+        break;
+    }
+    b->encoding = 0;
+}
+
+static void finish_all_at_exit(void)
+{
+    G_at_exit = 1;
+    for (size_t i = 0; i < G_num_batches; ++i)
+    {
+        if (!G_batches[i]->encoding) // One that was being encoded is left as it is
+            finish_file(G_batches[i]);
+    }
+    G_num_batches = 0; // Their CsvWriters are flushed by their own exit handler, which runs next
+}
+
+RowBatch *row_batch_create(const char *path, int num_columns, const char *const *names, const ColumnType *types,
+                           int types_final)
+{
+    RowBatch *b = (RowBatch *)safe_batch_realloc(NULL, sizeof(RowBatch));
+    memset(b, 0, sizeof(*b));
+    b->out = csv_writer_create(path);
+    b->types_final = types_final;
+    b->num_columns = num_columns;
+    b->columns = (BatchColumn *)safe_batch_realloc(NULL, (num_columns ? num_columns : 1) * sizeof(BatchColumn));
+    memset(b->columns, 0, (num_columns ? num_columns : 1) * sizeof(BatchColumn));
+    for (int c = 0; c < num_columns; ++c)
+    {
+        size_t len = strlen(names[c]);
+        b->columns[c].name = (char *)safe_batch_realloc(NULL, len + 1);
+        memcpy(b->columns[c].name, names[c], len + 1);
+        b->columns[c].type = types ? types[c] : COLUMN_NULL;
+    }
+
+    if (G_num_batches == G_batches_cap)
+    {
+        G_batches_cap = G_batches_cap ? G_batches_cap * 2 : 64;
+        G_batches = (RowBatch **)safe_batch_realloc(G_batches, G_batches_cap * sizeof(RowBatch *));
+    }
+    b->registry_index = G_num_batches;
+    G_batches[G_num_batches++] = b;
+    if (!G_exit_registered)
+    {
+        // Registered after the first CsvWriter's handler, so it runs before it
+        atexit(finish_all_at_exit);
+        G_exit_registered = 1;
+    }
+    return b;
+}
+
+void row_batch_begin_row(RowBatch *b)
+{
+    if (b->num_rows == b->cap_rows)
+    { // Grows towards the batch size, so small tables stay small
+        size_t cap = b->cap_rows ? b->cap_rows * 2 : 64;
+        if (cap > G_rows_per_batch)
+            cap = G_rows_per_batch;
+        for (int c = 0; c < b->num_columns; ++c)
+        {
+            b->columns[c].kinds = (unsigned char *)safe_batch_realloc(b->columns[c].kinds, cap);
+            b->columns[c].values = (RowValue *)safe_batch_realloc(b->columns[c].values, cap * sizeof(RowValue));
+        }
+        b->cap_rows = cap;
+    }
+    for (int c = 0; c < b->num_columns; ++c)
+        b->columns[c].kinds[b->num_rows] = COLUMN_NULL;
+    b->num_rows++;
+}
+
+void row_batch_put_int(RowBatch *b, int col, int64_t v)
+{
+    size_t r = b->num_rows - 1;
+    b->columns[col].kinds[r] = COLUMN_INT;
+    b->columns[col].values[r].i = v;
+}
+
+void row_batch_put_number(RowBatch *b, int col, double v)
+{
+    if (column_type_of_number(v) == COLUMN_INT)
+    {
+        row_batch_put_int(b, col, (int64_t)v);
+        return;
+    }
+    size_t r = b->num_rows - 1;
+    b->columns[col].kinds[r] = COLUMN_FLOAT;
+    b->columns[col].values[r].d = v;
+}
+
+void row_batch_put_bool(RowBatch *b, int col, int v)
+{
+    size_t r = b->num_rows - 1;
+    b->columns[col].kinds[r] = COLUMN_BOOL;
+    b->columns[col].values[r].b = v != 0;
+}
+
+void row_batch_put_text(RowBatch *b, int col, const char *s, size_t len)
+{
+    size_t r = b->num_rows - 1;
+    b->columns[col].kinds[r] = COLUMN_TEXT;
+    b->columns[col].values[r].s.off = append_text(b, s, len);
+    b->columns[col].values[r].s.len = len;
+}
+
+void row_batch_end_row(RowBatch *b)
+{
+    // Text is also bounded, so a batch's utf8 offsets fit in 32 bits
+    if (b->num_rows >= G_rows_per_batch || b->text_len >= ROW_BATCH_MAX_TEXT)
+        end_batch(b);
+}
+
+void row_batch_close(RowBatch *b)
+{
+    if (!b)
+        return;
+    finish_file(b);
+    G_batches[b->registry_index] = G_batches[--G_num_batches]; // Ended: the exit handler skips it now
+    G_batches[b->registry_index]->registry_index = b->registry_index;
+    csv_writer_close(b->out);
+    for (int c = 0; c < b->num_columns; ++c)
+    {
+        free(b->columns[c].name);
+        free(b->columns[c].kinds);
+        free(b->columns[c].values);
+    }
+    free(b->columns);
+    free(b->text);
+    free(b->spooled);
+    free(b);
+    if (G_num_batches == 0)
+    {
+        free(G_batches);
+        G_batches = NULL;
+        G_batches_cap = 0;
+    }
+}
@@ -0,0 +1,104 @@
+// row_batch.h
+#ifndef ROW_BATCH_H
+#define ROW_BATCH_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For int64_t
+
+#include "csv_writer.h"
+
+// Typed rows for the binary output formats (--format).
+//
+// Instead of CSV text, each table buffers its rows column by column, up to --batch-rows of them,
+// and hands every full batch to the format's encoder, which writes it through the table's
+// CsvWriter (so the descriptor pool, I/O backends and compression apply as for CSV). A column's
+// type is the one declared when the table is opened (what discovery saw), widened by the values
+// of the first batch, and fixed from then on; a value it cannot hold is then an error. When the
+// declared types are not final (discovery did not see every value), the types keep widening as
+// discovery's would (column_type_merge): such a table's batches are spooled to a temporary log
+// and only encoded once it is closed. Numbers that are whole and within 2^53 are integers.
+
+#define ROW_BATCH_DEFAULT_ROWS 65536
+#define ROW_BATCH_MAX_TEXT (512 * 1024 * 1024) // A batch also ends once its text reaches this size
+
+typedef enum
+{
+    OUTPUT_CSV,
+    OUTPUT_ARROW,   // Arrow IPC file (arrow_writer.h)
+    OUTPUT_PARQUET, // Parquet file, one row group per batch (parquet_writer.h)
+    OUTPUT_PGCOPY   // PostgreSQL binary COPY file and its CREATE TABLE (pgcopy_writer.h)
+} OutputFormat;
+
+typedef enum
+{
+    COLUMN_NULL, // No value seen yet (a column that stays so is written as all-null text)
+    COLUMN_BOOL,
+    COLUMN_INT,
+    COLUMN_FLOAT,
+    COLUMN_TEXT
+} ColumnType;
+
+typedef union RowValue
+{
+    int64_t i;
+    double d;
+    int b;
+    struct
+    {
+        size_t off, len; // In the batch's text
+    } s;
+} RowValue;
+
+typedef struct BatchColumn
+{
+    char *name;
+    ColumnType type;      // Declared, then widened by the values
+    unsigned char *kinds; // Per row: the ColumnType of its value (COLUMN_NULL: null)
+    RowValue *values;
+} BatchColumn;
+
+typedef struct RowBatch
+{
+    CsvWriter *out;
+    int num_columns;
+    BatchColumn *columns;
+    size_t num_rows, cap_rows; // Rows in the current batch
+    size_t rows_written;       // Rows in the batches already encoded
+    char *text;                // Bytes of the batch's text values
+    size_t text_len, text_cap;
+    int types_fixed;
+    int types_final;     // Declared types hold every value; otherwise the batches are spooled
+    off_t *spooled;      // Where each spooled batch starts in the spool log
+    size_t num_spooled, spooled_cap;
+    void *encoder;     // The format's per-file state
+    size_t registry_index;
+    int encoding; // Inside an encoder call (the exit handler leaves such a batch alone)
+} RowBatch;
+
+void row_batches_configure(OutputFormat format, size_t rows_per_batch);
+OutputFormat row_batch_format(void);
+const char *output_format_suffix(OutputFormat format); // ".csv", ".arrow", ".parquet", ".pgcopy"
+
+ColumnType column_type_merge(ColumnType a, ColumnType b);
+ColumnType column_type_of_number(double d);
+
+// path includes the format's suffix. types may be NULL (nothing declared). types_final: the
+// declared types come from every value the table will get (full discovery).
+RowBatch *row_batch_create(const char *path, int num_columns, const char *const *names, const ColumnType *types,
+                           int types_final);
+// Starts a row of nulls; the put functions fill in its columns
+void row_batch_begin_row(RowBatch *b);
+void row_batch_put_int(RowBatch *b, int col, int64_t v);
+void row_batch_put_number(RowBatch *b, int col, double v); // An integer when it is one
+void row_batch_put_bool(RowBatch *b, int col, int v);
+void row_batch_put_text(RowBatch *b, int col, const char *s, size_t len);
+void row_batch_end_row(RowBatch *b); // Encodes (or spools) the batch once it is full
+// Encodes the rest, ends the file, closes its writer and frees b
+void row_batch_close(RowBatch *b);
+
+static inline const char *row_batch_text(const RowBatch *b, const RowValue *v)
+{
+    return b->text + v->s.off;
+}
+
+#endif // ROW_BATCH_H
@@ -0,0 +1,598 @@
+// schema_codegen.c
+#define _POSIX_C_SOURCE 200809L // For strtok_r
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "schema_codegen.h"
+#include "schema_csv.h"
+
+// One table of the registry as the generator sees it
+typedef struct CodegenTable
+{
+    const TableSchema *schema;
+    char *keys_buf;   // Shape signature split in place
+    const char **keys; // Its keys, deduplicated: slot i is keys[i]
+    int num_keys;
+    int fittable;     // 0 if no object can match the shape (too many keys to record one)
+} CodegenTable;
+
+// Runtime shared by every generated converter, before the per-table code
+static const char *G_prelude =
+    "#define _POSIX_C_SOURCE 200809L\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <errno.h>\n"
+    "#include <sys/stat.h> // For mkdir\n"
+    "\n"
+    "#include \"ast.h\"\n"
+    "#include \"json_source.h\"\n"
+    "#include \"rd_parser.h\"\n"
+    "\n"
+    "typedef struct Table\n"
+    "{\n"
+    "    const char *name;\n"
+    "    const char *header; // Preformatted CSV header line\n"
+    "    int is_r2, is_r3;\n"
+    "    int (*key_slot)(const char *key); // Slot of a member key (-1: not one of the table's keys)\n"
+    "    int (*fit)(const JsonValue *obj);  // Nonzero if obj has exactly the table's keys (fills G_vals)\n"
+    "    long (*write_row)(long parent_pk); // Writes a row from G_vals and returns its id\n"
+    "    const int *const *object_cands;    // Per slot: tables an object member can go to, in lookup order\n"
+    "    const int *array_tables;           // Per slot: table for an array member (-1: none)\n"
+    "    const int *element_cands;          // R2: tables an element object can go to\n"
+    "    int items_table;                   // R2: table for an element array (-1: none)\n"
+    "    FILE *f;\n"
+    "    long pk;\n"
+    "} Table;\n"
+    "\n"
+    "static Table TABLES[NUM_TABLES];\n"
+    "\n"
+    "static void write_escaped(FILE *f, const char *s)\n"
+    "{\n"
+    "    if (!s)\n"
+    "        return;\n"
+    "    if (!*s)\n"
+    "    {\n"
+    "        fputs(\"\\\"\\\"\", f);\n"
+    "        return;\n"
+    "    }\n"
+    "    if (!strpbrk(s, \"\\\",\\n\\r\"))\n"
+    "    {\n"
+    "        fputs(s, f);\n"
+    "        return;\n"
+    "    }\n"
+    "    fputc('\"', f);\n"
+    "    for (; *s; ++s)\n"
+    "    {\n"
+    "        if (*s == '\"')\n"
+    "            fputc('\"', f);\n"
+    "        fputc(*s, f);\n"
+    "    }\n"
+    "    fputc('\"', f);\n"
+    "}\n"
+    "\n"
+    "// Nulls, containers and missing members become empty fields\n"
+    "static void write_scalar(FILE *f, const JsonValue *v)\n"
+    "{\n"
+    "    if (!v)\n"
+    "        return;\n"
+    "    switch (v->type)\n"
+    "    {\n"
+    "    case JSON_STRING_TYPE:\n"
+    "        write_escaped(f, ast_string_value(v));\n"
+    "        break;\n"
+    "    case JSON_NUMBER_TYPE:\n"
+    "        fprintf(f, \"%g\", v->data.num_val);\n"
+    "        break;\n"
+    "    case JSON_BOOLEAN_TYPE:\n"
+    "        fputs(v->data.bool_val ? \"true\" : \"false\", f);\n"
+    "        break;\n"
+    "    default:\n"
+    "        break;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "static void does_not_fit(const char *key)\n"
+    "{\n"
+    "    fprintf(stderr, \"Error: Record with key '%s' does not fit the compiled schema.\\n\", key ? key : \"(array element)\");\n"
+    "    exit(EXIT_FAILURE);\n"
+    "}\n"
+    "\n";
+
+// Conversion, after the tables
+static const char *G_postlude =
+    "static void convert_array(const JsonValue *arr, int target, const char *parent, const char *key, long pk, int is_root);\n"
+    "\n"
+    "static void convert_object(const JsonValue *obj, const int *cands, const char *key, long parent_pk)\n"
+    "{\n"
+    "    for (; *cands >= 0; ++cands)\n"
+    "    {\n"
+    "        Table *t = &TABLES[*cands];\n"
+    "        if (!t->fit || !t->fit(obj))\n"
+    "            continue;\n"
+    "        long pk = t->write_row(parent_pk);\n"
+    "        for (const PairNode *m = obj->data.object_val.head; m; m = m->next)\n"
+    "        {\n"
+    "            const JsonValue *v = m->data.value;\n"
+    "            if (v->type == JSON_OBJECT_TYPE)\n"
+    "                convert_object(v, t->object_cands[t->key_slot(m->data.key)], m->data.key, pk);\n"
+    "            else if (v->type == JSON_ARRAY_TYPE)\n"
+    "                convert_array(v, t->array_tables[t->key_slot(m->data.key)], t->name, m->data.key, pk, 0);\n"
+    "        }\n"
+    "        return;\n"
+    "    }\n"
+    "    does_not_fit(key);\n"
+    "}\n"
+    "\n"
+    "// parent: name of the table the array's table is named after (with key, or \"items\")\n"
+    "static void convert_array(const JsonValue *arr, int target, const char *parent, const char *key, long pk, int is_root)\n"
+    "{\n"
+    "    const ValueNode *e = arr->data.array_val.head;\n"
+    "    if (!e)\n"
+    "        return;\n"
+    "    JsonValueType first_type = e->value->type;\n"
+    "    Table *t = target >= 0 ? &TABLES[target] : NULL;\n"
+    "    if (!t || !(first_type == JSON_OBJECT_TYPE ? t->is_r2 : first_type != JSON_ARRAY_TYPE && t->is_r3))\n"
+    "    {\n"
+    "        if (!is_root && first_type != JSON_ARRAY_TYPE) // No table takes a root array or an array of arrays\n"
+    "            does_not_fit(key);\n"
+    "        fprintf(stderr, \"Warning: populate_csv: Could not find schema for array elements of key '%s' (expected table name '%s_%s').\\n\",\n"
+    "                key ? key : \"(root_array)\", parent, key ? key : \"items\");\n"
+    "        return;\n"
+    "    }\n"
+    "    if (t->is_r2)\n"
+    "    {\n"
+    "        for (; e; e = e->next)\n"
+    "        {\n"
+    "            if (e->value->type == JSON_OBJECT_TYPE)\n"
+    "                convert_object(e->value, t->element_cands, NULL, pk);\n"
+    "            else if (e->value->type == JSON_ARRAY_TYPE)\n"
+    "                convert_array(e->value, t->items_table, t->name, NULL, pk, 0);\n"
+    "        }\n"
+    "        return;\n"
+    "    }\n"
+    "    for (int idx = 0; e; e = e->next, ++idx)\n"
+    "    {\n"
+    "        fprintf(t->f, \"%ld,%ld,%d,\", ++t->pk, pk, idx);\n"
+    "        write_scalar(t->f, e->value);\n"
+    "        fputc('\\n', t->f);\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "int main(int argc, char **argv)\n"
+    "{\n"
+    "    const char *output_dir = \".\";\n"
+    "    if (argc == 4 && strcmp(argv[2], \"-out-dir\") == 0)\n"
+    "        output_dir = argv[3];\n"
+    "    else if (argc != 2)\n"
+    "    {\n"
+    "        fprintf(stderr, \"Usage: %s <input.json> [-out-dir DIR]\\n\", argv[0]);\n"
+    "        return EXIT_FAILURE;\n"
+    "    }\n"
+    "\n"
+    "    JsonSource src;\n"
+    "    if (json_source_open(&src, argv[1]) != 0)\n"
+    "    {\n"
+    "        perror(argv[1]);\n"
+    "        return EXIT_FAILURE;\n"
+    "    }\n"
+    "    JsonValue *root = rd_parse_ast(src.data, src.len);\n"
+    "    json_source_close(&src);\n"
+    "    if (!root)\n"
+    "        return EXIT_FAILURE;\n"
+    "\n"
+    "    struct stat st;\n"
+    "    if (stat(output_dir, &st) == -1 && mkdir(output_dir, 0700) != 0 && errno != EEXIST)\n"
+    "    {\n"
+    "        perror(\"Error creating output directory\");\n"
+    "        return EXIT_FAILURE;\n"
+    "    }\n"
+    "    for (int i = 0; i < NUM_TABLES; ++i)\n"
+    "    {\n"
+    "        size_t len = strlen(output_dir) + strlen(TABLES[i].name) + 6;\n"
+    "        char *path = (char *)malloc(len);\n"
+    "        if (!path)\n"
+    "        {\n"
+    "            perror(\"Error: malloc failed\");\n"
+    "            return EXIT_FAILURE;\n"
+    "        }\n"
+    "        snprintf(path, len, \"%s/%s.csv\", output_dir, TABLES[i].name);\n"
+    "        TABLES[i].f = fopen(path, \"w\");\n"
+    "        if (!TABLES[i].f)\n"
+    "        {\n"
+    "            perror(path);\n"
+    "            return EXIT_FAILURE;\n"
+    "        }\n"
+    "        free(path);\n"
+    "        fputs(TABLES[i].header, TABLES[i].f);\n"
+    "    }\n"
+    "\n"
+    "    if (root->type == JSON_OBJECT_TYPE)\n"
+    "        convert_object(root, ROOT_OBJECT_CANDS, ROOT_NAME, 0);\n"
+    "    else if (root->type == JSON_ARRAY_TYPE)\n"
+    "        convert_array(root, ROOT_ARRAY_TABLE, ROOT_NAME, ROOT_NAME, 0, 1);\n"
+    "\n"
+    "    int status = EXIT_SUCCESS;\n"
+    "    for (int i = 0; i < NUM_TABLES; ++i)\n"
+    "    {\n"
+    "        if (fclose(TABLES[i].f) != 0)\n"
+    "        {\n"
+    "            perror(TABLES[i].name);\n"
+    "            status = EXIT_FAILURE;\n"
+    "        }\n"
+    "    }\n"
+    "    ast_free_value(root);\n"
+    "    return status;\n"
+    "}\n";
+
+static void *safe_codegen_malloc(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr)
+    {
+        perror("Error: schema_codegen malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Writes s as a C string literal (octal escapes, so no following character can extend one)
+static void emit_c_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++p)
+    {
+        if (*p == '"' || *p == '\\')
+            fprintf(f, "\\%c", *p);
+        else if (*p < 0x20 || *p >= 0x7F || *p == '?') // '?' avoids trigraphs
+            fprintf(f, "\\%03o", *p);
+        else
+            fputc(*p, f);
+    }
+    fputc('"', f);
+}
+
+// Appends the CSV field for s to buf (same bytes as the converter writes)
+static size_t csv_escape_into(char *buf, const char *s)
+{
+    size_t n = 0;
+    int needs_quoting = *s == '\0' || strpbrk(s, "\",\n\r") != NULL;
+    if (needs_quoting)
+        buf[n++] = '"';
+    for (; *s; ++s)
+    {
+        if (*s == '"')
+            buf[n++] = '"';
+        buf[n++] = *s;
+    }
+    if (needs_quoting)
+        buf[n++] = '"';
+    return n;
+}
+
+static void emit_header(FILE *f, const TableSchema *s)
+{
+    size_t cap = 2;
+    for (int i = 0; i < s->num_columns; ++i)
+        cap += strlen(s->columns[i].name) * 2 + 3;
+    char *buf = (char *)safe_codegen_malloc(cap);
+    size_t n = 0;
+    for (int i = 0; i < s->num_columns; ++i)
+    {
+        if (i > 0)
+            buf[n++] = ',';
+        n += csv_escape_into(buf + n, s->columns[i].name);
+    }
+    buf[n++] = '\n';
+    buf[n] = '\0';
+    emit_c_string(f, buf);
+    free(buf);
+}
+
+static int find_table(const CodegenTable *tables, int num_tables, const char *name)
+{
+    for (int i = 0; i < num_tables; ++i)
+    {
+        if (strcmp(tables[i].schema->name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Table for an array under key in table parent_name (the converter's "<parent>_<key>" lookup)
+static int find_array_table(const CodegenTable *tables, int num_tables, const char *parent_name, const char *key)
+{
+    size_t len = strlen(parent_name) + strlen(key) + 2;
+    char *name = (char *)safe_codegen_malloc(len);
+    snprintf(name, len, "%s_%s", parent_name, key);
+    int t = find_table(tables, num_tables, name);
+    free(name);
+    return t;
+}
+
+static int find_slot(const CodegenTable *t, const char *key)
+{
+    for (int i = 0; i < t->num_keys; ++i)
+    {
+        if (strcmp(t->keys[i], key) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Splits the shape signature of an R1/R2 table into its keys
+static void split_shape(CodegenTable *t)
+{
+    const char *sig = t->schema->shape_signature;
+    t->fittable = strcmp(sig, "{_too_many_keys_}") != 0;
+    size_t len = strlen(sig);
+    t->keys_buf = (char *)safe_codegen_malloc(len + 1);
+    memcpy(t->keys_buf, sig, len + 1);
+    t->keys = (const char **)safe_codegen_malloc((len / 2 + 1) * sizeof(const char *));
+    t->num_keys = 0;
+    if (!t->fittable || strcmp(sig, "{}") == 0)
+        return;
+    char *save = NULL;
+    for (char *key = strtok_r(t->keys_buf, ",", &save); key; key = strtok_r(NULL, ",", &save))
+    {
+        if (find_slot(t, key) < 0)
+            t->keys[t->num_keys++] = key;
+    }
+}
+
+// Candidate list name for an object whose parent table is self (if it is R2) and whose key names
+// table named; -1 for either means none. The lists are emitted once each.
+static void emit_cands_name(FILE *f, int self, int named)
+{
+    fprintf(f, "cands_%d_%d", self + 1, named + 1);
+}
+
+// Emits the candidate list: self, the table named after the key, then every R1 table in lookup order
+static void emit_cands(FILE *f, const CodegenTable *tables, int num_tables, int self, int named, char *emitted)
+{
+    char *seen = &emitted[(self + 1) * (num_tables + 1) + named + 1];
+    if (*seen)
+        return;
+    *seen = 1;
+    fprintf(f, "static const int ");
+    emit_cands_name(f, self, named);
+    fprintf(f, "[] = {");
+    if (self >= 0)
+        fprintf(f, "%d, ", self);
+    if (named >= 0)
+        fprintf(f, "%d, ", named);
+    for (int i = 0; i < num_tables; ++i)
+    {
+        const TableSchema *s = tables[i].schema;
+        if (i != named && !s->is_child_array_table && !s->is_junction_table)
+            fprintf(f, "%d, ", i);
+    }
+    fprintf(f, "-1};\n");
+}
+
+// Table an object under key goes to first: the R1 table of that name
+static int named_r1(const CodegenTable *tables, int num_tables, const char *key)
+{
+    int t = key ? find_table(tables, num_tables, key) : -1;
+    if (t >= 0 && (tables[t].schema->is_child_array_table || tables[t].schema->is_junction_table))
+        t = -1;
+    return t;
+}
+
+// Key dispatch: a switch on the key length, then one compare per key of that length
+static void emit_key_slot(FILE *f, int index, const CodegenTable *t)
+{
+    fprintf(f, "static int key_slot_%d(const char *key)\n{\n", index);
+    if (t->num_keys > 0)
+    {
+        fprintf(f, "    switch (strlen(key))\n    {\n");
+        char *done = (char *)safe_codegen_malloc((size_t)t->num_keys);
+        memset(done, 0, (size_t)t->num_keys);
+        for (int i = 0; i < t->num_keys; ++i)
+        {
+            if (done[i])
+                continue;
+            size_t len = strlen(t->keys[i]);
+            fprintf(f, "    case %zu:\n", len);
+            for (int j = i; j < t->num_keys; ++j)
+            {
+                if (done[j] || strlen(t->keys[j]) != len)
+                    continue;
+                done[j] = 1;
+                fprintf(f, "        if (memcmp(key, ");
+                emit_c_string(f, t->keys[j]);
+                fprintf(f, ", %zu) == 0)\n            return %d;\n", len, j);
+            }
+            fprintf(f, "        break;\n");
+        }
+        free(done);
+        fprintf(f, "    }\n");
+    }
+    fprintf(f, "    return -1;\n}\n\n");
+}
+
+static void emit_fit(FILE *f, int index, const CodegenTable *t)
+{
+    fprintf(f, "static int fit_%d(const JsonValue *obj)\n{\n", index);
+    if (!t->fittable)
+    {
+        fprintf(f, "    (void)obj;\n    return 0;\n}\n\n");
+        return;
+    }
+    fprintf(f, "    if (obj->data.object_val.num_members != %d)\n        return 0;\n", t->num_keys);
+    if (t->num_keys > 0)
+    {
+        // A loop rather than memset, which -Wmemset-elt-size flags when the count equals MAX_KEYS
+        fprintf(f, "    for (int i = 0; i < %d; ++i)\n        G_vals[i] = NULL;\n", t->num_keys);
+        fprintf(f, "    for (const PairNode *m = obj->data.object_val.head; m; m = m->next)\n    {\n");
+        fprintf(f, "        int slot = key_slot_%d(m->data.key);\n", index);
+        fprintf(f, "        if (slot < 0 || G_vals[slot])\n            return 0;\n");
+        fprintf(f, "        G_vals[slot] = m->data.value;\n    }\n");
+    }
+    fprintf(f, "    return 1;\n}\n\n");
+}
+
+// Row writer in the table's fixed column order. Returns -1 if a column is not one of the
+// table's keys (a key with a ',' in it, which the shape signature cannot represent).
+static int emit_row(FILE *f, int index, const CodegenTable *t)
+{
+    const TableSchema *s = t->schema;
+    fprintf(f, "static long row_%d(long parent_pk)\n{\n", index);
+    fprintf(f, "    FILE *f = TABLES[%d].f;\n    long pk = ++TABLES[%d].pk;\n    fprintf(f, \"%%ld\", pk);\n", index, index);
+    for (int i = 1; i < s->num_columns; ++i)
+    {
+        const char *col = s->columns[i].name;
+        if (s->parent_fk_column_name[0] && strcmp(col, s->parent_fk_column_name) == 0)
+        {
+            fprintf(f, "    fprintf(f, \",%%ld\", parent_pk);\n");
+            continue;
+        }
+        int slot = find_slot(t, col);
+        if (slot < 0)
+        {
+            fprintf(stderr, "Error: Column '%s' of table '%s' is not one of its shape keys; the schema cannot be compiled.\n",
+                    col, s->name);
+            return -1;
+        }
+        fprintf(f, "    fputc(',', f);\n    write_scalar(f, G_vals[%d]);\n", slot);
+    }
+    fprintf(f, "    fputc('\\n', f);\n    return pk;\n}\n\n");
+    return 0;
+}
+
+int emit_schema_converter(const char *out_path)
+{
+    int num_tables = 0;
+    for (const TableSchema *s = G_all_schemas_head; s; s = s->next_schema)
+        num_tables++;
+    if (num_tables == 0)
+    {
+        fprintf(stderr, "Error: The schema has no tables to compile.\n");
+        return -1;
+    }
+
+    CodegenTable *tables = (CodegenTable *)safe_codegen_malloc(num_tables * sizeof(CodegenTable));
+    memset(tables, 0, num_tables * sizeof(CodegenTable));
+    int max_keys = 1, any_keys = 0, i = 0;
+    for (const TableSchema *s = G_all_schemas_head; s; s = s->next_schema, ++i)
+    {
+        tables[i].schema = s;
+        if (!s->is_junction_table)
+            split_shape(&tables[i]);
+        if (tables[i].num_keys > max_keys)
+            max_keys = tables[i].num_keys;
+        if (tables[i].num_keys > 0)
+            any_keys = 1;
+    }
+
+    FILE *f = fopen(out_path, "w");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not write %s: %s\n", out_path, strerror(errno));
+        free(tables);
+        return -1;
+    }
+
+    const char *root_name = schema_source_name();
+    fprintf(f, "// Converter generated by json2relcsv --compile-schema. Do not edit.\n");
+    fprintf(f, "// Writes the same CSVs as json2relcsv --schema-in <schema> --on-mismatch fail.\n");
+    fprintf(f, "#define NUM_TABLES %d\n#define MAX_KEYS %d\n", num_tables, max_keys);
+    fprintf(f, "#define ROOT_NAME ");
+    emit_c_string(f, root_name);
+    fprintf(f, "\n");
+    fprintf(f, "#define ROOT_ARRAY_TABLE %d\n", find_array_table(tables, num_tables, root_name, root_name));
+    fprintf(f, "#define ROOT_OBJECT_CANDS ");
+    emit_cands_name(f, -1, named_r1(tables, num_tables, root_name));
+    fprintf(f, "\n\n");
+    fputs(G_prelude, f);
+    // Only fit and row code of a table with keys uses it (-Wunused-variable otherwise)
+    if (any_keys)
+        fprintf(f, "static const JsonValue *G_vals[MAX_KEYS]; // Member values of the object being written, by slot\n\n");
+
+    int rc = 0;
+    for (i = 0; i < num_tables && rc == 0; ++i)
+    {
+        if (tables[i].schema->is_junction_table)
+            continue;
+        emit_key_slot(f, i, &tables[i]);
+        emit_fit(f, i, &tables[i]);
+        if (tables[i].fittable)
+            rc = emit_row(f, i, &tables[i]);
+    }
+
+    // Where each table's object and array members go
+    char *emitted = (char *)safe_codegen_malloc((size_t)(num_tables + 1) * (num_tables + 1));
+    memset(emitted, 0, (size_t)(num_tables + 1) * (num_tables + 1));
+    emit_cands(f, tables, num_tables, -1, named_r1(tables, num_tables, root_name), emitted);
+    for (i = 0; i < num_tables && rc == 0; ++i)
+    {
+        const CodegenTable *t = &tables[i];
+        const TableSchema *s = t->schema;
+        if (s->is_child_array_table)
+            emit_cands(f, tables, num_tables, i, -1, emitted); // Its elements
+        if (s->is_junction_table || !t->fittable || t->num_keys == 0)
+            continue;
+        int self = s->is_child_array_table ? i : -1;
+        for (int k = 0; k < t->num_keys; ++k)
+            emit_cands(f, tables, num_tables, self, named_r1(tables, num_tables, t->keys[k]), emitted);
+        fprintf(f, "static const int *const object_cands_%d[] = {", i);
+        for (int k = 0; k < t->num_keys; ++k)
+        {
+            emit_cands_name(f, self, named_r1(tables, num_tables, t->keys[k]));
+            fprintf(f, k + 1 < t->num_keys ? ", " : "};\n");
+        }
+        fprintf(f, "static const int array_tables_%d[] = {", i);
+        for (int k = 0; k < t->num_keys; ++k)
+            fprintf(f, "%d%s", find_array_table(tables, num_tables, s->name, t->keys[k]), k + 1 < t->num_keys ? ", " : "};\n");
+    }
+    free(emitted);
+
+    fprintf(f, "\nstatic Table TABLES[NUM_TABLES] = {\n");
+    for (i = 0; i < num_tables && rc == 0; ++i)
+    {
+        const CodegenTable *t = &tables[i];
+        const TableSchema *s = t->schema;
+        fprintf(f, "    {");
+        emit_c_string(f, s->name);
+        fprintf(f, ", ");
+        emit_header(f, s);
+        fprintf(f, ", %d, %d, ", s->is_child_array_table, s->is_junction_table);
+        if (s->is_junction_table)
+            fprintf(f, "NULL, NULL, NULL, ");
+        else if (!t->fittable)
+            fprintf(f, "key_slot_%d, fit_%d, NULL, ", i, i);
+        else
+            fprintf(f, "key_slot_%d, fit_%d, row_%d, ", i, i, i);
+        if (!s->is_junction_table && t->fittable && t->num_keys > 0)
+            fprintf(f, "object_cands_%d, array_tables_%d, ", i, i);
+        else
+            fprintf(f, "NULL, NULL, ");
+        if (s->is_child_array_table)
+        {
+            emit_cands_name(f, i, -1);
+            fprintf(f, ", %d, ", find_array_table(tables, num_tables, s->name, "items"));
+        }
+        else
+            fprintf(f, "NULL, -1, ");
+        fprintf(f, "NULL, 0},\n");
+    }
+    fprintf(f, "};\n\n");
+    fputs(G_postlude, f);
+
+    if (fclose(f) != 0 && rc == 0)
+    {
+        fprintf(stderr, "Error: Could not write %s: %s\n", out_path, strerror(errno));
+        rc = -1;
+    }
+    if (rc != 0)
+        remove(out_path);
+    for (i = 0; i < num_tables; ++i)
+    {
+        free(tables[i].keys_buf);
+        free(tables[i].keys);
+    }
+    free(tables);
+    return rc;
+}
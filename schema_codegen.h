@@ -0,0 +1,20 @@
+// schema_codegen.h
+#ifndef SCHEMA_CODEGEN_H
+#define SCHEMA_CODEGEN_H
+
+// Schema compiler (--compile-schema, make converter).
+//
+// Turns the table registry (normally loaded from a --schema-out file) into the C source of a
+// stand-alone converter for documents of that shape. The generated program parses with the
+// recursive-descent parser and writes exactly the CSVs of `json2relcsv --schema-in FILE
+// --on-mismatch fail`, but every table is compiled in: member keys are dispatched through a
+// switch on their length to a fixed slot, rows are written in the table's fixed column order,
+// headers are preformatted, and an object's table is found by checking its keys against the
+// few candidate tables for its position instead of building and comparing shape signatures.
+// A record that fits no compiled table is reported and the program exits with status 1.
+
+// Writes the converter for the tables in G_all_schemas_head to out_path.
+// Returns 0, or -1 after reporting the error.
+int emit_schema_converter(const char *out_path);
+
+#endif // SCHEMA_CODEGEN_H
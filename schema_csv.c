@@ -7,11 +7,50 @@
 #include <sys/stat.h> // For mkdir
 #include <errno.h>    // For errno
 #include <assert.h>
+#include <stdint.h> // For uint64_t
 
 #include "schema_csv.h"
+#include "tape.h"
+#include "intern.h" // For intern_count (--intern)
+#include "csv_writer.h"
 
 TableSchema *G_all_schemas_head = NULL;
 static char G_output_dir[MAX_NAME_LEN * 2]; // Store the output directory path
+static char *G_selected_keys_buf = NULL;    // --select list (split in place)
+static const char **G_selected_keys = NULL;
+static int G_num_selected_keys = 0;
+static int G_release_early = 0; // --release-early: free each subtree once population is done with it
+static int G_single_pass = 0;   // --single-pass: discover and populate in one walk
+static int G_tables_open = 0;   // Files are open, so tables created from now on open theirs at once
+static int G_fusing = 0;        // Inside the --single-pass walk
+static long G_infer_from = 0;   // --infer-from: discovery only samples this many elements per array (0: all)
+static MismatchPolicy G_on_mismatch = MISMATCH_WIDEN;
+static TableSchema *G_side_table = NULL; // --on-mismatch side-table (created on first use)
+static int G_widening = 0;              // Retrying a node after --on-mismatch widen discovered it
+static int G_schema_loaded = 0;         // --schema-in: the registry was preloaded, discovery is skipped
+static char G_schema_source[MAX_NAME_LEN]; // Input base name the tables are named after (kept by --schema-in)
+static int G_track_column_types = 0;       // Discovery records column types for CSV output too (--schema-out)
+static int G_rows_misplaced = 0; // --single-pass: a table was created that the two walks would have given earlier rows
+static int G_subtrees_freed = 0; // --release-early freed a subtree for good (a second walk cannot see it)
+
+// Shapes (objects) and names (arrays) --single-pass looked up without finding a table: one created
+// later under them is a table the two walks would have found
+typedef struct MissedLookups
+{
+    char **keys;
+    size_t count, cap;
+} MissedLookups;
+static MissedLookups G_missed_shapes = {NULL, 0, 0};
+static MissedLookups G_missed_names = {NULL, 0, 0};
+
+// Escaped CSV bytes of interned strings, indexed by intern ID (built on first use)
+typedef struct EscapedString
+{
+    char *bytes;
+    size_t len;
+} EscapedString;
+static EscapedString *G_escaped_cache = NULL;
+static unsigned int G_escaped_cache_cap = 0;
 
 static void *safe_csv_malloc(size_t size)
 {
@@ -24,33 +63,206 @@ static void *safe_csv_malloc(size_t size)
     return ptr;
 }
 
+// Population can meet records the registry was not built from (--infer-from, --schema-in)
+static int schema_is_partial(void)
+{
+    return G_infer_from > 0 || G_schema_loaded;
+}
+
 static int compare_strings(const void *a, const void *b)
 {
     return strcmp(*(const char **)a, *(const char **)b);
 }
 
-static void generate_object_shape_signature(JsonObject *obj, char *signature_buffer, size_t buffer_len)
+// --- Document access ---
+// The converter walks either the pointer AST or a flat tape (tape.h) through these helpers.
+
+typedef struct NodeRef
+{
+    const JsonValue *ast;  // AST node (NULL when walking a tape)
+    const JsonTape *tape;  // Tape document (NULL when walking the AST)
+    size_t pos;            // Word index of the value on the tape
+} NodeRef;
+
+// Iterator over the members of an object or the elements of an array
+typedef struct ChildIter
+{
+    const PairNode *member;
+    const ValueNode *element;
+    const JsonTape *tape;
+    size_t pos, end;
+    int is_object;
+} ChildIter;
+
+static NodeRef node_from_ast(const JsonValue *v)
+{
+    NodeRef n = {v, NULL, 0};
+    return n;
+}
+
+static NodeRef node_from_tape(const JsonTape *tape, size_t pos)
+{
+    NodeRef n = {NULL, tape, pos};
+    return n;
+}
+
+static JsonValueType node_type(NodeRef n)
+{
+    if (n.tape)
+        return tape_value_type(n.tape, n.pos);
+    // Unparsed containers know their kind without being parsed
+    return n.ast->type == JSON_LAZY_TYPE ? n.ast->data.lazy_val->container_type : n.ast->type;
+}
+
+// AST node of a container, parsing it first if it is still lazy (the first descent into it)
+static const JsonValue *node_container(NodeRef n)
+{
+    if (n.ast->type == JSON_LAZY_TYPE && json_lazy_resolve((JsonValue *)n.ast) != 0)
+    {
+        fprintf(stderr, "Parsing failed. Exiting.\n");
+        exit(EXIT_FAILURE);
+    }
+    return n.ast;
+}
+
+// Number of members (objects) or elements (arrays)
+static int node_count(NodeRef n)
+{
+    if (n.tape)
+        return tape_count(n.tape, n.pos);
+    const JsonValue *v = node_container(n);
+    return v->type == JSON_OBJECT_TYPE ? v->data.object_val.num_members : v->data.array_val.num_elements;
+}
+
+static const char *node_string(NodeRef n)
+{
+    return n.tape ? tape_string(n.tape, n.pos) : ast_string_value(n.ast);
+}
+
+// Intern ID of a string value (0 if it is not shared)
+static unsigned int node_string_id(NodeRef n)
+{
+    return n.tape ? 0 : n.ast->string_id;
+}
+
+static double node_number(NodeRef n)
+{
+    return n.tape ? tape_number(n.tape, n.pos) : n.ast->data.num_val;
+}
+
+static int node_bool(NodeRef n)
+{
+    return n.tape ? tape_bool(n.tape, n.pos) : n.ast->data.bool_val;
+}
+
+static ChildIter node_children(NodeRef n)
+{
+    ChildIter it;
+    memset(&it, 0, sizeof(it));
+    it.is_object = node_type(n) == JSON_OBJECT_TYPE;
+    if (n.tape)
+    {
+        it.tape = n.tape;
+        it.pos = n.pos + 1;
+        it.end = tape_container_end(n.tape, n.pos);
+    }
+    else if (it.is_object)
+    {
+        it.member = node_container(n)->data.object_val.head;
+    }
+    else
+    {
+        it.element = node_container(n)->data.array_val.head;
+    }
+    return it;
+}
+
+// Advances to the next child. key is set to the member key (NULL for array elements).
+static int child_next(ChildIter *it, const char **key, NodeRef *child)
+{
+    if (it->tape)
+    {
+        if (it->pos >= it->end)
+            return 0;
+        *key = NULL;
+        if (it->is_object)
+        {
+            *key = tape_string(it->tape, it->pos);
+            it->pos++;
+        }
+        *child = node_from_tape(it->tape, it->pos);
+        it->pos = tape_next(it->tape, it->pos);
+        return 1;
+    }
+    if (it->is_object)
+    {
+        if (!it->member)
+            return 0;
+        *key = it->member->data.key;
+        *child = node_from_ast(it->member->data.value);
+        it->member = it->member->next;
+        return 1;
+    }
+    if (!it->element)
+        return 0;
+    *key = NULL;
+    *child = node_from_ast(it->element->value);
+    it->element = it->element->next;
+    return 1;
+}
+
+// First element of a non-empty array
+static NodeRef node_first_element(NodeRef n)
+{
+    if (n.tape)
+        return node_from_tape(n.tape, n.pos + 1);
+    return node_from_ast(node_container(n)->data.array_val.head->value);
+}
+
+static int node_is_scalar(NodeRef n)
+{
+    JsonValueType t = node_type(n);
+    return t == JSON_STRING_TYPE || t == JSON_NUMBER_TYPE || t == JSON_BOOLEAN_TYPE || t == JSON_NULL_TYPE;
+}
+
+// --select: composite members (objects/arrays) are only converted if their key is listed.
+// Scalars are always kept, so every selected table keeps its full set of columns.
+static int member_selected(const char *key, NodeRef member_value)
+{
+    if (!G_selected_keys || node_is_scalar(member_value))
+        return 1;
+    for (int i = 0; i < G_num_selected_keys; ++i)
+    {
+        if (strcmp(G_selected_keys[i], key) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static void generate_object_shape_signature(NodeRef obj, char *signature_buffer, size_t buffer_len)
 {
-    if (!obj || obj->num_members == 0)
+    int num_members = node_count(obj);
+    if (num_members == 0)
     {
         strncpy(signature_buffer, "{}", buffer_len - 1);
         signature_buffer[buffer_len - 1] = '\0';
         return;
     }
-    if (obj->num_members > MAX_COLUMNS_PER_TABLE * 2)
+    if (num_members > MAX_COLUMNS_PER_TABLE * 2)
     {
         fprintf(stderr, "Warning: Too many members for shape signature key array.\n");
         strncpy(signature_buffer, "{_too_many_keys_}", buffer_len - 1);
         signature_buffer[buffer_len - 1] = '\0';
         return;
     }
-    const char *keys[obj->num_members];
-    PairNode *current_member = obj->head;
+    const char *keys[num_members];
+    ChildIter it = node_children(obj);
+    const char *key;
+    NodeRef member_value;
     int i = 0;
-    while (current_member && i < obj->num_members)
+    while (i < num_members && child_next(&it, &key, &member_value))
     {
-        keys[i++] = current_member->data.key;
-        current_member = current_member->next;
+        keys[i++] = key;
     }
     qsort(keys, i, sizeof(const char *), compare_strings);
 
@@ -70,13 +282,348 @@ static void generate_object_shape_signature(JsonObject *obj, char *signature_buf
     }
 }
 
-static void discover_schemas_recursive(JsonValue *current_json_node, const char *current_node_key_hint, TableSchema *parent_object_schema, const char *input_filename_base);
-static void populate_csv_recursive(JsonValue *current_json_node, TableSchema *current_object_schema_context, long parent_pk_value, const char *json_key_of_current_node, const char *input_filename_base);
+// --- Explicit work stack for the document walks ---
+// Discovery and population visit nodes in document order (pre-order). Each open container keeps
+// one small frame with its child iterator and what its children inherit, instead of a C stack frame.
+
+typedef struct WalkFrame
+{
+    ChildIter it;
+    int use_member_keys;          // Children are visited with their member key (objects)...
+    const char *child_key;        // ...or all with this key (array elements)
+    int composites_only;          // Skip scalar children
+    long remaining;               // Children left to visit (-1: all; --infer-from sampling)
+    TableSchema *child_schema;    // Schema context for the children
+    long child_pk;                // Parent primary key for the children (population)
+    TableSchema *discover_schema; // Discovery's schema context for the children (--single-pass),
+    const char *discover_key;     // the key discovery gives array elements (population gives none)
+    int discover_only;            // and whether population skips them
+    JsonValue *release;           // --release-early: container whose children are freed when the frame is popped...
+    JsonLazy origin;              // ...and, if origin.index is set, made unparsed again
+    int in_unparsed;              // An enclosing container is made unparsed again (--single-pass)
+} WalkFrame;
+
+typedef struct WalkStack
+{
+    WalkFrame *frames;
+    size_t depth, cap;
+} WalkStack;
+
+static void walk_push(WalkStack *st, const WalkFrame *frame)
+{
+    if (st->depth == st->cap)
+    {
+        st->cap = st->cap ? st->cap * 2 : 64;
+        WalkFrame *grown = (WalkFrame *)realloc(st->frames, st->cap * sizeof(WalkFrame));
+        if (!grown)
+        {
+            perror("Error: schema_csv realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        st->frames = grown;
+    }
+    st->frames[st->depth++] = *frame;
+}
+
+// Frees a converted container's children, or makes it unparsed again if it came from the index.
+// Children are only gone for good if no enclosing container is made unparsed again either.
+static void release_container(JsonValue *container, const JsonLazy *origin, int in_unparsed)
+{
+    if (origin->index)
+    {
+        ast_make_lazy(container, origin->index, origin->begin);
+        return;
+    }
+    if (!in_unparsed && ((container->type == JSON_ARRAY_TYPE && container->data.array_val.head) ||
+                         (container->type == JSON_OBJECT_TYPE && container->data.object_val.head)))
+        G_subtrees_freed = 1;
+    ast_release_children(container);
+}
+
+static void release_frame(const WalkFrame *frame)
+{
+    if (frame->release)
+        release_container(frame->release, &frame->origin, frame->in_unparsed);
+}
+
+// Pops exhausted frames and returns the next child to visit (0 when the walk is done).
+// key is the key the child is visited with.
+static int walk_next(WalkStack *st, NodeRef *child, const char **key, WalkFrame **parent)
+{
+    while (st->depth > 0)
+    {
+        WalkFrame *top = &st->frames[st->depth - 1];
+        const char *member_key;
+        if (top->remaining == 0 || !child_next(&top->it, &member_key, child))
+        {
+            release_frame(top);
+            st->depth--;
+            continue;
+        }
+        if (top->composites_only)
+        {
+            JsonValueType t = node_type(*child);
+            if (t != JSON_ARRAY_TYPE && t != JSON_OBJECT_TYPE)
+                continue;
+        }
+        if (top->use_member_keys && !member_selected(member_key, *child))
+            continue;
+        *key = top->use_member_keys ? member_key : top->child_key;
+        *parent = top;
+        if (top->remaining > 0)
+            top->remaining--;
+        return 1;
+    }
+    return 0;
+}
+
+static void open_table_file(TableSchema *s);
+
+// --- Column lookup by member key ---
+
+static uint64_t hash_key(const char *key)
+{
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (; *key; ++key)
+    {
+        h ^= (unsigned char)*key;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static size_t key_slot(uint64_t h, int seed, int num_slots)
+{
+    h ^= (uint64_t)seed * 0x9E3779B97F4A7C15ULL; // splitmix64 finalizer
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return (size_t)((h ^ (h >> 31)) % (uint64_t)num_slots);
+}
+
+#define COLUMN_HASH_MAX_SEED (1 << 16)
+
+// Builds s->column_hash. Buckets are placed largest first, each with the first seed that maps all
+// of its keys to distinct free slots; one-key buckets then take the remaining slots directly.
+// Falls back to a linear lookup in the practically impossible case that no seed works.
+static void build_column_hash(TableSchema *s)
+{
+    int n = s->num_columns;
+    ColumnHash *ch = (ColumnHash *)safe_csv_malloc(sizeof(ColumnHash));
+    ch->column_source = (int *)safe_csv_malloc(n * sizeof(int));
+    int num_names = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        ch->column_source[i] = i;
+        for (int j = 0; j < i; ++j)
+        {
+            if (strcmp(s->columns[j].name, s->columns[i].name) == 0)
+            {
+                ch->column_source[i] = j;
+                break;
+            }
+        }
+        if (ch->column_source[i] == i)
+            num_names++;
+    }
+    ch->num_slots = num_names;
+    ch->num_buckets = num_names / 2 + 1;
+    ch->bucket_seed = (int *)safe_csv_malloc(ch->num_buckets * sizeof(int));
+    ch->slot_column = (int *)safe_csv_malloc(num_names * sizeof(int));
+    memset(ch->bucket_seed, 0, ch->num_buckets * sizeof(int));
+    for (int i = 0; i < num_names; ++i)
+        ch->slot_column[i] = -1;
+
+    // Distinct names grouped by bucket: bucket_cols[bucket_start[b] .. bucket_start[b + 1])
+    uint64_t hashes[MAX_COLUMNS_PER_TABLE];
+    int bucket_start[MAX_COLUMNS_PER_TABLE / 2 + 3] = {0};
+    int bucket_cols[MAX_COLUMNS_PER_TABLE];
+    int order[MAX_COLUMNS_PER_TABLE / 2 + 2];
+    for (int i = 0; i < n; ++i)
+    {
+        hashes[i] = hash_key(s->columns[i].name);
+        if (ch->column_source[i] == i)
+            bucket_start[hashes[i] % ch->num_buckets + 1]++;
+    }
+    for (int b = 0; b < ch->num_buckets; ++b)
+        bucket_start[b + 1] += bucket_start[b];
+    int fill[MAX_COLUMNS_PER_TABLE / 2 + 2];
+    memcpy(fill, bucket_start, ch->num_buckets * sizeof(int));
+    for (int i = 0; i < n; ++i)
+    {
+        if (ch->column_source[i] == i)
+            bucket_cols[fill[hashes[i] % ch->num_buckets]++] = i;
+    }
+    for (int b = 0; b < ch->num_buckets; ++b)
+    { // Insertion sort by bucket size, largest first
+        int j = b;
+        int size = bucket_start[b + 1] - bucket_start[b];
+        while (j > 0 && bucket_start[order[j - 1] + 1] - bucket_start[order[j - 1]] < size)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = b;
+    }
+
+    int ok = 1;
+    for (int k = 0; k < ch->num_buckets && ok; ++k)
+    {
+        int b = order[k];
+        int first = bucket_start[b], size = bucket_start[b + 1] - first;
+        if (size < 2)
+            break; // The rest are one-key or empty buckets
+        int seed = 1;
+        for (; seed < COLUMN_HASH_MAX_SEED; ++seed)
+        {
+            size_t slots[MAX_COLUMNS_PER_TABLE];
+            int fits = 1;
+            for (int i = 0; i < size && fits; ++i)
+            {
+                slots[i] = key_slot(hashes[bucket_cols[first + i]], seed, num_names);
+                fits = ch->slot_column[slots[i]] < 0;
+                for (int j = 0; j < i && fits; ++j)
+                    fits = slots[j] != slots[i];
+            }
+            if (fits)
+            {
+                for (int i = 0; i < size; ++i)
+                    ch->slot_column[slots[i]] = bucket_cols[first + i];
+                ch->bucket_seed[b] = seed;
+                break;
+            }
+        }
+        ok = seed < COLUMN_HASH_MAX_SEED;
+    }
+    int free_slot = 0;
+    for (int k = 0; k < ch->num_buckets && ok; ++k)
+    {
+        int b = order[k];
+        if (bucket_start[b + 1] - bucket_start[b] != 1)
+            continue;
+        while (ch->slot_column[free_slot] >= 0)
+            free_slot++;
+        ch->slot_column[free_slot] = bucket_cols[bucket_start[b]];
+        ch->bucket_seed[b] = -(free_slot + 1);
+    }
+
+    if (!ok)
+    {
+        free(ch->bucket_seed);
+        free(ch->slot_column);
+        ch->bucket_seed = ch->slot_column = NULL;
+    }
+    s->column_hash = ch;
+}
+
+static void free_column_hash(TableSchema *s)
+{
+    if (!s->column_hash)
+        return;
+    free(s->column_hash->bucket_seed);
+    free(s->column_hash->slot_column);
+    free(s->column_hash->column_source);
+    free(s->column_hash);
+    s->column_hash = NULL;
+}
+
+// Column that stores the value of member key (the first column with that name), or -1
+static int column_for_key(const TableSchema *s, const char *key)
+{
+    const ColumnHash *ch = s->column_hash;
+    if (!ch || !ch->bucket_seed)
+    {
+        for (int i = 0; i < s->num_columns; ++i)
+        {
+            if (strcmp(s->columns[i].name, key) == 0)
+                return i;
+        }
+        return -1;
+    }
+    uint64_t h = hash_key(key);
+    int seed = ch->bucket_seed[h % ch->num_buckets];
+    int col = ch->slot_column[seed < 0 ? (size_t)(-seed - 1) : key_slot(h, seed, ch->num_slots)];
+    return strcmp(s->columns[col].name, key) == 0 ? col : -1; // The one verification compare
+}
+
+// Type of a scalar for the binary --format outputs (COLUMN_NULL for nulls and containers)
+static ColumnType node_column_type(NodeRef v)
+{
+    switch (node_type(v))
+    {
+    case JSON_STRING_TYPE:
+        return COLUMN_TEXT;
+    case JSON_NUMBER_TYPE:
+        return column_type_of_number(node_number(v));
+    case JSON_BOOLEAN_TYPE:
+        return COLUMN_BOOL;
+    default:
+        return COLUMN_NULL;
+    }
+}
+
+// Column types are needed by the binary --format outputs and saved by --schema-out
+static int tracks_column_types(void)
+{
+    return G_track_column_types || row_batch_format() != OUTPUT_CSV;
+}
+
+// Widens the column types of s by the scalar members of obj (the key columns are integers)
+static void note_column_types(TableSchema *s, NodeRef obj)
+{
+    ChildIter it = node_children(obj);
+    const char *member_key;
+    NodeRef member_value;
+    while (child_next(&it, &member_key, &member_value))
+    {
+        int col = column_for_key(s, member_key);
+        if (col > 0 && strcmp(s->columns[col].name, s->parent_fk_column_name) != 0)
+            s->columns[col].type = column_type_merge(s->columns[col].type, node_column_type(member_value));
+    }
+}
+
+static int lookup_was_missed(const MissedLookups *m, const char *key)
+{
+    for (size_t i = 0; i < m->count; ++i)
+    {
+        if (strcmp(m->keys[i], key) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static void note_missed_lookup(MissedLookups *m, const char *key)
+{
+    if (!G_fusing || lookup_was_missed(m, key))
+        return;
+    if (m->count == m->cap)
+    {
+        m->cap = m->cap ? m->cap * 2 : 16;
+        char **grown = (char **)realloc(m->keys, m->cap * sizeof(char *));
+        if (!grown)
+        {
+            perror("Error: schema_csv realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        m->keys = grown;
+    }
+    size_t len = strlen(key);
+    m->keys[m->count] = (char *)safe_csv_malloc(len + 1);
+    memcpy(m->keys[m->count++], key, len + 1);
+}
+
+static void clear_missed_lookups(MissedLookups *m)
+{
+    for (size_t i = 0; i < m->count; ++i)
+        free(m->keys[i]);
+    free(m->keys);
+    m->keys = NULL;
+    m->count = m->cap = 0;
+}
 
 static TableSchema *get_or_create_table(
     const char *desired_table_name_hint,
     const char *shape_sig,
-    JsonObject *template_obj,
+    const NodeRef *template_obj,
     TableSchema *parent_schema,        // Parent object's schema, if this new table is for a nested structure
     int is_junction_table_flag,        // Is this an R3 junction table?
     int is_r2_array_element_table_flag // Is this a table for elements of an R2 array?
@@ -96,6 +643,9 @@ static TableSchema *get_or_create_table(
                 { // Simple guard against reusing parent's own schema if names are too similar
                     return s;
                 }
+                // The new table is newer than s, so two walks would have put s's fallback rows in it
+                if (G_fusing && s->shape_fallback_rows)
+                    G_rows_misplaced = 1;
             }
             s = s->next_schema;
         }
@@ -125,6 +675,10 @@ static TableSchema *get_or_create_table(
     }
     strncpy(new_schema->name, final_table_name, MAX_NAME_LEN - 1);
     new_schema->name[MAX_NAME_LEN - 1] = '\0';
+    if (G_fusing && (lookup_was_missed(&G_missed_names, new_schema->name) ||
+                     (shape_sig && !is_junction_table_flag && !is_r2_array_element_table_flag &&
+                      lookup_was_missed(&G_missed_shapes, shape_sig))))
+        G_rows_misplaced = 1;
 
     if (shape_sig)
     {
@@ -132,6 +686,7 @@ static TableSchema *get_or_create_table(
         new_schema->shape_signature[MAX_SHAPE_SIGNATURE_LEN - 1] = '\0';
     }
 
+    new_schema->columns[new_schema->num_columns].type = COLUMN_INT; // Keys are integers in every format
     strncpy(new_schema->columns[new_schema->num_columns++].name, "id", MAX_NAME_LEN - 1);
 
     if (parent_schema)
@@ -141,6 +696,7 @@ static TableSchema *get_or_create_table(
         // Add the FK column, but only if it's not a junction table (junction tables add their own FK)
         if (!is_junction_table_flag)
         {
+            new_schema->columns[new_schema->num_columns].type = COLUMN_INT;
             strncpy(new_schema->columns[new_schema->num_columns++].name, new_schema->parent_fk_column_name, MAX_NAME_LEN - 1);
         }
     }
@@ -155,29 +711,30 @@ static TableSchema *get_or_create_table(
             new_schema->parent_fk_column_name[MAX_NAME_LEN - 1] = '\0';
         }
         // Add the actual FK column for junction table
+        new_schema->columns[new_schema->num_columns].type = COLUMN_INT;
+        new_schema->columns[new_schema->num_columns + 1].type = COLUMN_INT;
         strncpy(new_schema->columns[new_schema->num_columns++].name, new_schema->parent_fk_column_name, MAX_NAME_LEN - 1);
         strncpy(new_schema->columns[new_schema->num_columns++].name, "idx", MAX_NAME_LEN - 1);
         strncpy(new_schema->columns[new_schema->num_columns++].name, "value", MAX_NAME_LEN - 1);
     }
     else if (template_obj)
     { // For R1 objects or R2 object elements
-        PairNode *member = template_obj->head;
-        while (member)
+        ChildIter it = node_children(*template_obj);
+        const char *member_key;
+        NodeRef member_value;
+        while (child_next(&it, &member_key, &member_value))
         {
             if (new_schema->num_columns >= MAX_COLUMNS_PER_TABLE)
             {
-                fprintf(stderr, "Warning: Max columns for table %s, key %s\n", new_schema->name, member->data.key);
+                fprintf(stderr, "Warning: Max columns for table %s, key %s\n", new_schema->name, member_key);
                 break;
             }
-            if (member->data.value->type == JSON_STRING_TYPE ||
-                member->data.value->type == JSON_NUMBER_TYPE ||
-                member->data.value->type == JSON_BOOLEAN_TYPE ||
-                member->data.value->type == JSON_NULL_TYPE)
+            if (node_is_scalar(member_value))
             {
                 int col_exists = 0;
                 for (int k = 0; k < new_schema->num_columns; ++k)
                 {
-                    if (strcmp(new_schema->columns[k].name, member->data.key) == 0)
+                    if (strcmp(new_schema->columns[k].name, member_key) == 0)
                     {
                         col_exists = 1;
                         break;
@@ -185,29 +742,33 @@ static TableSchema *get_or_create_table(
                 }
                 if (!col_exists)
                 {
-                    strncpy(new_schema->columns[new_schema->num_columns++].name, member->data.key, MAX_NAME_LEN - 1);
+                    strncpy(new_schema->columns[new_schema->num_columns++].name, member_key, MAX_NAME_LEN - 1);
                 }
             }
-            member = member->next;
         }
     }
 
     new_schema->next_schema = G_all_schemas_head;
     G_all_schemas_head = new_schema;
+    if (G_tables_open)
+        open_table_file(new_schema); // The columns are final once the table exists
     return new_schema;
 }
 
-static void discover_schemas_recursive(JsonValue *current_json_node, const char *current_node_key_hint, TableSchema *parent_object_schema, const char *input_filename_base)
+// Discovers the tables for one node. Returns 1 and fills *children if its children are visited next.
+static int discover_node(NodeRef current_json_node, const char *current_node_key_hint, TableSchema *parent_object_schema, const char *input_filename_base, WalkFrame *children)
 {
-    if (!current_json_node)
-        return;
+    if (!current_json_node.ast && !current_json_node.tape)
+        return 0;
+    memset(children, 0, sizeof(*children));
+    children->remaining = -1;
 
-    switch (current_json_node->type)
+    switch (node_type(current_json_node))
     {
     case JSON_OBJECT_TYPE:
     {
         char sig[MAX_SHAPE_SIGNATURE_LEN];
-        generate_object_shape_signature(&(current_json_node->data.object_val), sig, sizeof(sig));
+        generate_object_shape_signature(current_json_node, sig, sizeof(sig));
         TableSchema *table_for_this_object;
 
         if (parent_object_schema && parent_object_schema->is_child_array_table &&
@@ -229,53 +790,51 @@ static void discover_schemas_recursive(JsonValue *current_json_node, const char
             table_for_this_object = get_or_create_table(
                 current_node_key_hint ? current_node_key_hint : input_filename_base,
                 sig,
-                &(current_json_node->data.object_val),
+                &current_json_node,
                 actual_parent_for_fk, // Pass the true parent object's schema if this is a nested R1 object
                 0,                    // Not a junction table
                 0                     // Not an R2 array element table itself (its *parent* might be R2, but this obj is R1)
             );
         }
+        if (tracks_column_types())
+            note_column_types(table_for_this_object, current_json_node);
 
-        PairNode *member = current_json_node->data.object_val.head;
-        while (member)
-        {
-            discover_schemas_recursive(member->data.value, member->data.key, table_for_this_object, input_filename_base);
-            member = member->next;
-        }
-        break;
+        children->it = node_children(current_json_node);
+        children->use_member_keys = 1;
+        children->child_schema = table_for_this_object;
+        return 1;
     }
     case JSON_ARRAY_TYPE:
     {
-        JsonArray *arr = &(current_json_node->data.array_val);
-        if (arr->num_elements == 0)
+        if (node_count(current_json_node) == 0)
             break;
 
-        JsonValue *first_element = arr->head->value;
+        NodeRef first_element = node_first_element(current_json_node);
         char child_table_name_hint[MAX_NAME_LEN];
         const char *parent_name_for_hint = parent_object_schema ? parent_object_schema->name : input_filename_base;
         const char *array_key_for_hint = current_node_key_hint ? current_node_key_hint : "items";
         snprintf(child_table_name_hint, sizeof(child_table_name_hint), "%s_%s", parent_name_for_hint, array_key_for_hint);
 
-        if (first_element->type == JSON_OBJECT_TYPE)
+        if (node_type(first_element) == JSON_OBJECT_TYPE)
         { // R2: Array of objects
             char sig_first_obj[MAX_SHAPE_SIGNATURE_LEN];
-            generate_object_shape_signature(&(first_element->data.object_val), sig_first_obj, sizeof(sig_first_obj));
+            generate_object_shape_signature(first_element, sig_first_obj, sizeof(sig_first_obj));
 
             TableSchema *r2_elements_schema = get_or_create_table(
                 child_table_name_hint,
                 sig_first_obj,
-                &(first_element->data.object_val),
+                &first_element,
                 parent_object_schema, // The object containing this array is the parent
                 0,                    // Not a junction table
                 1                     // YES, this table is for R2 array elements
             );
 
-            ValueNode *elem_node = arr->head;
-            while (elem_node)
-            {
-                discover_schemas_recursive(elem_node->value, current_node_key_hint, r2_elements_schema, input_filename_base);
-                elem_node = elem_node->next;
-            }
+            children->it = node_children(current_json_node);
+            children->child_key = current_node_key_hint;
+            children->child_schema = r2_elements_schema;
+            if (G_infer_from > 0)
+                children->remaining = G_infer_from; // The rest of the elements are only populated
+            return 1;
         }
         else
         { // R3: Array of scalars (implicit due to previous checks)
@@ -287,58 +846,197 @@ static void discover_schemas_recursive(JsonValue *current_json_node, const char
                 1,                    // YES, this is a junction table
                 0                     // Not an R2 array element table
             );
+            if (tracks_column_types())
+            { // Widen the value column of the table population writes these elements to (the one with this exact name)
+                TableSchema *junction = G_all_schemas_head;
+                while (junction && (!junction->is_junction_table || strcmp(junction->name, child_table_name_hint) != 0))
+                    junction = junction->next_schema;
+                ChildIter it = node_children(current_json_node);
+                const char *unused_key;
+                NodeRef elem_value;
+                while (junction && child_next(&it, &unused_key, &elem_value))
+                    junction->columns[3].type = column_type_merge(junction->columns[3].type, node_column_type(elem_value));
+            }
         }
         break;
     }
     default:
         break;
     }
+    return 0;
+}
+
+// Discovery walk over the subtree at node (the whole document from discover_schemas)
+static void discover_subtree(NodeRef node, const char *node_key, TableSchema *parent_schema, const char *input_filename_base)
+{
+    WalkStack st = {NULL, 0, 0};
+    WalkFrame frame;
+    if (discover_node(node, node_key, parent_schema, input_filename_base, &frame))
+        walk_push(&st, &frame);
+
+    NodeRef child;
+    const char *key;
+    WalkFrame *parent;
+    while (walk_next(&st, &child, &key, &parent))
+    {
+        // Only containers that were still unparsed can be released during discovery: population
+        // parses them again when it reaches them
+        JsonLazy origin = {NULL, 0, JSON_NULL_TYPE};
+        if (G_release_early && child.ast && child.ast->type == JSON_LAZY_TYPE)
+            origin = *child.ast->data.lazy_val;
+        if (discover_node(child, key, parent->child_schema, input_filename_base, &frame))
+        {
+            if (origin.index)
+            {
+                frame.release = (JsonValue *)child.ast;
+                frame.origin = origin;
+            }
+            walk_push(&st, &frame); // May move the frames; parent is not used after this
+        }
+        else if (origin.index && child.ast->type != JSON_LAZY_TYPE)
+        {
+            ast_make_lazy((JsonValue *)child.ast, origin.index, origin.begin);
+        }
+    }
+    free(st.frames);
+}
+
+static void discover_schemas(NodeRef root, const char *input_filename_base)
+{
+    discover_subtree(root, NULL, NULL, input_filename_base);
 }
 
-static void write_csv_escaped_string(FILE *f, const char *str)
+static void write_csv_escaped_string(CsvWriter *w, const char *str)
 {
     if (str == NULL)
+        return;
+    if (strlen(str) == 0)
     {
-        fprintf(f, "");
+        csv_writer_write(w, "\"\"", 2);
         return;
     }
-    if (strlen(str) == 0)
+    if (!strpbrk(str, "\",\n\r"))
     {
-        fprintf(f, "\"\"");
+        csv_writer_puts(w, str);
         return;
     }
-    int needs_quoting = 0;
-    for (const char *p = str; *p; ++p)
+    // Quoted, with every '"' doubled: copy up to and including each quote, then add the second one
+    csv_writer_putc(w, '"');
+    for (const char *p = str; *p;)
     {
-        if (*p == '"' || *p == ',' || *p == '\n' || *p == '\r')
-        {
-            needs_quoting = 1;
-            break;
-        }
+        const char *quote = strchr(p, '"');
+        size_t n = quote ? (size_t)(quote - p) + 1 : strlen(p);
+        csv_writer_write(w, p, n);
+        if (quote)
+            csv_writer_putc(w, '"');
+        p += n;
     }
+    csv_writer_putc(w, '"');
+}
+
+// Same bytes as write_csv_escaped_string, built into a new buffer
+static char *csv_escape(const char *str, size_t *len_out)
+{
+    size_t len = strlen(str);
+    char *out = (char *)safe_csv_malloc(len * 2 + 3); // Every byte doubled, plus the quotes
+    size_t n = 0;
+    int needs_quoting = len == 0 || strpbrk(str, "\",\n\r") != NULL;
     if (needs_quoting)
-        fprintf(f, "\"");
+        out[n++] = '"';
     for (const char *p = str; *p; ++p)
     {
         if (*p == '"')
-            fprintf(f, "\"\"");
-        else
-            fprintf(f, "%c", *p);
+            out[n++] = '"';
+        out[n++] = *p;
     }
     if (needs_quoting)
-        fprintf(f, "\"");
+        out[n++] = '"';
+    *len_out = n;
+    return out;
 }
 
-static void populate_csv_recursive(JsonValue *current_json_node, TableSchema *current_object_schema_context, long parent_pk_value, const char *json_key_of_current_node, const char *input_filename_base)
+// Writes an interned string from its cached escaped bytes (escaping it on first use)
+static void write_csv_interned_string(CsvWriter *w, unsigned int id, const char *str)
 {
-    if (!current_json_node)
-        return;
+    if (id >= G_escaped_cache_cap)
+    {
+        unsigned int new_cap = intern_count() + 1;
+        if (new_cap <= id)
+            new_cap = id + 1;
+        EscapedString *grown = (EscapedString *)realloc(G_escaped_cache, new_cap * sizeof(EscapedString));
+        if (!grown)
+        {
+            perror("Error: schema_csv realloc failed");
+            exit(EXIT_FAILURE);
+        }
+        memset(grown + G_escaped_cache_cap, 0, (new_cap - G_escaped_cache_cap) * sizeof(EscapedString));
+        G_escaped_cache = grown;
+        G_escaped_cache_cap = new_cap;
+    }
+    EscapedString *e = &G_escaped_cache[id];
+    if (!e->bytes)
+        e->bytes = csv_escape(str, &e->len);
+    csv_writer_write(w, e->bytes, e->len);
+}
+
+// Writes one scalar field (R4: nulls and non-scalars become empty fields)
+static void write_csv_scalar(CsvWriter *w, NodeRef v)
+{
+    switch (node_type(v))
+    {
+    case JSON_STRING_TYPE:
+        if (node_string_id(v))
+            write_csv_interned_string(w, node_string_id(v), node_string(v));
+        else
+            write_csv_escaped_string(w, node_string(v));
+        break;
+    case JSON_NUMBER_TYPE:
+        csv_writer_printf(w, "%g", node_number(v));
+        break;
+    case JSON_BOOLEAN_TYPE:
+        csv_writer_puts(w, node_bool(v) ? "true" : "false");
+        break;
+    case JSON_NULL_TYPE:
+    default:
+        break;
+    }
+}
+
+// Typed counterpart of write_csv_scalar for the binary --format outputs
+static void put_batch_scalar(RowBatch *b, int col, NodeRef v)
+{
+    switch (node_type(v))
+    {
+    case JSON_STRING_TYPE:
+        if (node_string(v))
+            row_batch_put_text(b, col, node_string(v), strlen(node_string(v)));
+        break;
+    case JSON_NUMBER_TYPE:
+        row_batch_put_number(b, col, node_number(v));
+        break;
+    case JSON_BOOLEAN_TYPE:
+        row_batch_put_bool(b, col, node_bool(v));
+        break;
+    case JSON_NULL_TYPE:
+    default:
+        break;
+    }
+}
 
-    switch (current_json_node->type)
+// Writes the rows for one node. Returns 1 and fills *children if its children are visited next,
+// or -1 (only with --infer-from) if the sampled schema has no table for it.
+static int populate_node(NodeRef current_json_node, TableSchema *current_object_schema_context, long parent_pk_value, const char *json_key_of_current_node, const char *input_filename_base, WalkFrame *children)
+{
+    if (!current_json_node.ast && !current_json_node.tape)
+        return 0;
+    memset(children, 0, sizeof(*children));
+    children->remaining = -1;
+
+    switch (node_type(current_json_node))
     {
     case JSON_OBJECT_TYPE:
     {
-        JsonObject *obj = &(current_json_node->data.object_val);
+        NodeRef obj = current_json_node;
         char sig[MAX_SHAPE_SIGNATURE_LEN];
         generate_object_shape_signature(obj, sig, sizeof(sig));
         TableSchema *table_for_this_obj = NULL;
@@ -368,7 +1066,7 @@ static void populate_csv_recursive(JsonValue *current_json_node, TableSchema *cu
             {
                 // R1 tables are not child_array_tables and not junction_tables.
                 // And their shape must match.
-                // Also, their name should align with what discover_schemas_recursive would have named it.
+                // Also, their name should align with what discover_node would have named it.
                 if (!s_iter->is_child_array_table && !s_iter->is_junction_table &&
                     strcmp(s_iter->shape_signature, sig) == 0)
                 {
@@ -395,99 +1093,102 @@ static void populate_csv_recursive(JsonValue *current_json_node, TableSchema *cu
                 }
                 s_iter = s_iter->next_schema;
             }
+            // Not found by key: the newest table of the shape so far, which a later one would replace
+            if (G_fusing && table_for_this_obj &&
+                !(json_key_of_current_node && strcmp(table_for_this_obj->name, json_key_of_current_node) == 0))
+                table_for_this_obj->shape_fallback_rows = 1;
         }
 
+        if (!table_for_this_obj && schema_is_partial() && !G_widening)
+            return -1; // Not covered by the sampled or loaded schema
         if (!table_for_this_obj)
         {
+            note_missed_lookup(&G_missed_shapes, sig);
             // This object does not form its own table directly (e.g. it's a complex field whose parts are handled recursively)
             // or schema lookup failed.
             // For "author", if its schema has is_child_array_table=0, this lookup should find it.
             // If not found, it's an error or complex unhandled case.
             fprintf(stderr, "Warning: No table schema found for object with key '%s' and signature '%s'. Data may not be written.\n",
                     json_key_of_current_node ? json_key_of_current_node : "(root object)", sig);
-            PairNode *member_recurse = obj->head;
-            while (member_recurse)
-            { // Still recurse for its children that might form tables
-                populate_csv_recursive(member_recurse->data.value, current_object_schema_context, parent_pk_value, member_recurse->data.key, input_filename_base);
-                member_recurse = member_recurse->next;
-            }
-            return;
+            // Still visit its children that might form tables
+            children->it = node_children(obj);
+            children->use_member_keys = 1;
+            children->child_schema = current_object_schema_context;
+            children->child_pk = parent_pk_value;
+            return 1;
         }
 
         long current_row_pk = ++(table_for_this_obj->current_pk_id);
-        fprintf(table_for_this_obj->file_ptr, "%ld", current_row_pk);
 
+        // One pass over the members: each column gets the first member with its name
+        NodeRef column_values[MAX_COLUMNS_PER_TABLE];
+        char column_set[MAX_COLUMNS_PER_TABLE];
+        memset(column_set, 0, table_for_this_obj->num_columns);
+        ChildIter m_iter = node_children(obj);
+        const char *member_key;
+        NodeRef member_val;
+        while (child_next(&m_iter, &member_key, &member_val))
+        {
+            int col = column_for_key(table_for_this_obj, member_key);
+            if (col >= 0 && !column_set[col])
+            {
+                column_values[col] = member_val;
+                column_set[col] = 1;
+            }
+        }
+
+        RowBatch *rows = table_for_this_obj->rows;
+        CsvWriter *out = table_for_this_obj->writer;
+        if (rows)
+        {
+            row_batch_begin_row(rows);
+            row_batch_put_int(rows, 0, current_row_pk);
+        }
+        else
+            csv_writer_printf(out, "%ld", current_row_pk);
         for (int i = 1; i < table_for_this_obj->num_columns; ++i)
         {
-            fprintf(table_for_this_obj->file_ptr, ",");
+            if (!rows)
+                csv_writer_putc(out, ',');
             const char *col_name = table_for_this_obj->columns[i].name;
 
             // Check if this column is the defined parent_fk_column_name for this table
             if (strlen(table_for_this_obj->parent_fk_column_name) > 0 &&
                 strcmp(col_name, table_for_this_obj->parent_fk_column_name) == 0)
             {
-                fprintf(table_for_this_obj->file_ptr, "%ld", parent_pk_value);
+                if (rows)
+                    row_batch_put_int(rows, i, parent_pk_value);
+                else
+                    csv_writer_printf(out, "%ld", parent_pk_value);
             }
             else
             {
-                JsonValue *member_val = NULL;
-                PairNode *m_iter = obj->head;
-                while (m_iter)
-                {
-                    if (strcmp(m_iter->data.key, col_name) == 0)
-                    {
-                        member_val = m_iter->data.value;
-                        break;
-                    }
-                    m_iter = m_iter->next;
-                }
-                if (member_val)
-                {
-                    switch (member_val->type)
-                    {
-                    case JSON_STRING_TYPE:
-                        write_csv_escaped_string(table_for_this_obj->file_ptr, member_val->data.string_val);
-                        break;
-                    case JSON_NUMBER_TYPE:
-                        fprintf(table_for_this_obj->file_ptr, "%g", member_val->data.num_val);
-                        break;
-                    case JSON_BOOLEAN_TYPE:
-                        fprintf(table_for_this_obj->file_ptr, "%s", member_val->data.bool_val ? "true" : "false");
-                        break;
-                    case JSON_NULL_TYPE:
-                        fprintf(table_for_this_obj->file_ptr, "");
-                        break;
-                    default:
-                        fprintf(table_for_this_obj->file_ptr, "");
-                        break;
-                    }
-                }
-                else
-                {
-                    fprintf(table_for_this_obj->file_ptr, "");
-                }
+                int src = table_for_this_obj->column_hash ? table_for_this_obj->column_hash->column_source[i] : i;
+                if (column_set[src] && rows)
+                    put_batch_scalar(rows, i, column_values[src]);
+                else if (column_set[src])
+                    write_csv_scalar(out, column_values[src]);
             }
         }
-        fprintf(table_for_this_obj->file_ptr, "\n");
+        if (rows)
+            row_batch_end_row(rows);
+        else
+            csv_writer_putc(out, '\n');
 
-        PairNode *member = obj->head;
-        while (member)
-        {
-            if (member->data.value->type == JSON_ARRAY_TYPE || member->data.value->type == JSON_OBJECT_TYPE)
-            {
-                populate_csv_recursive(member->data.value, table_for_this_obj, current_row_pk, member->data.key, input_filename_base);
-            }
-            member = member->next;
-        }
-        break;
+        children->it = node_children(obj);
+        children->use_member_keys = 1;
+        children->composites_only = 1;
+        children->child_schema = table_for_this_obj;
+        children->child_pk = current_row_pk;
+        return 1;
     }
     case JSON_ARRAY_TYPE:
     {
-        JsonArray *arr = &(current_json_node->data.array_val);
-        if (arr->num_elements == 0)
+        if (node_count(current_json_node) == 0)
             break;
 
-        JsonValue *first_element = arr->head->value;
+        NodeRef first_element = node_first_element(current_json_node);
+        JsonValueType first_type = node_type(first_element);
         TableSchema *array_table_schema = NULL;
         char target_element_table_name[MAX_NAME_LEN];
         const char *parent_name_for_lookup = current_object_schema_context ? current_object_schema_context->name : input_filename_base;
@@ -499,14 +1200,14 @@ static void populate_csv_recursive(JsonValue *current_json_node, TableSchema *cu
         {
             if (strcmp(s_iter->name, target_element_table_name) == 0)
             {
-                if (first_element->type == JSON_OBJECT_TYPE && s_iter->is_child_array_table)
+                if (first_type == JSON_OBJECT_TYPE && s_iter->is_child_array_table)
                 { // R2 check
                     array_table_schema = s_iter;
                     break;
                 }
                 else if (s_iter->is_junction_table)
                 { // R3 check (scalar types already implicitly checked by first_element type)
-                    if (first_element->type != JSON_OBJECT_TYPE && first_element->type != JSON_ARRAY_TYPE)
+                    if (first_type != JSON_OBJECT_TYPE && first_type != JSON_ARRAY_TYPE)
                     { // Ensure it's scalar
                         array_table_schema = s_iter;
                         break;
@@ -516,53 +1217,52 @@ static void populate_csv_recursive(JsonValue *current_json_node, TableSchema *cu
             s_iter = s_iter->next_schema;
         }
 
+        // A root array (no parent table) is looked up under the input name, which discovery never
+        // uses for it, and an array of arrays gets a junction table no element can go to, so full
+        // discovery finds no table for either: warn as usual instead
+        if (!array_table_schema && schema_is_partial() && !G_widening && current_object_schema_context &&
+            first_type != JSON_ARRAY_TYPE)
+            return -1; // Not covered by the sampled or loaded schema
         if (!array_table_schema)
         {
+            note_missed_lookup(&G_missed_names, target_element_table_name);
             fprintf(stderr, "Warning: populate_csv: Could not find schema for array elements of key '%s' (expected table name '%s').\n",
                     json_key_of_current_node ? json_key_of_current_node : "(root_array)", target_element_table_name);
             break;
         }
 
-        if (first_element->type == JSON_OBJECT_TYPE)
+        ChildIter it = node_children(current_json_node);
+        const char *unused_key;
+        NodeRef elem_value;
+        if (first_type == JSON_OBJECT_TYPE)
         { // R2
-            ValueNode *elem_node = arr->head;
-            while (elem_node)
-            {
-                populate_csv_recursive(elem_node->value, array_table_schema, parent_pk_value, NULL, input_filename_base);
-                elem_node = elem_node->next;
-            }
+            children->it = it;
+            children->child_schema = array_table_schema;
+            children->child_pk = parent_pk_value;
+            children->discover_key = json_key_of_current_node;
+            return 1;
         }
         else
         { // R3
-            ValueNode *elem_node = arr->head;
             int idx = 0;
-            while (elem_node)
+            while (child_next(&it, &unused_key, &elem_value))
             {
                 long junction_row_pk = ++(array_table_schema->current_pk_id);
-                fprintf(array_table_schema->file_ptr, "%ld", junction_row_pk);
-                fprintf(array_table_schema->file_ptr, ",%ld", parent_pk_value);
-                fprintf(array_table_schema->file_ptr, ",%d", idx++);
-                fprintf(array_table_schema->file_ptr, ",");
-                switch (elem_node->value->type)
+                RowBatch *rows = array_table_schema->rows;
+                if (rows)
                 {
-                case JSON_STRING_TYPE:
-                    write_csv_escaped_string(array_table_schema->file_ptr, elem_node->value->data.string_val);
-                    break;
-                case JSON_NUMBER_TYPE:
-                    fprintf(array_table_schema->file_ptr, "%g", elem_node->value->data.num_val);
-                    break;
-                case JSON_BOOLEAN_TYPE:
-                    fprintf(array_table_schema->file_ptr, "%s", elem_node->value->data.bool_val ? "true" : "false");
-                    break;
-                case JSON_NULL_TYPE:
-                    fprintf(array_table_schema->file_ptr, "");
-                    break;
-                default:
-                    fprintf(array_table_schema->file_ptr, "");
-                    break;
+                    row_batch_begin_row(rows);
+                    row_batch_put_int(rows, 0, junction_row_pk);
+                    row_batch_put_int(rows, 1, parent_pk_value);
+                    row_batch_put_int(rows, 2, idx++);
+                    put_batch_scalar(rows, 3, elem_value);
+                    row_batch_end_row(rows);
+                    continue;
                 }
-                fprintf(array_table_schema->file_ptr, "\n");
-                elem_node = elem_node->next;
+                CsvWriter *out = array_table_schema->writer;
+                csv_writer_printf(out, "%ld,%ld,%d,", junction_row_pk, parent_pk_value, idx++);
+                write_csv_scalar(out, elem_value);
+                csv_writer_putc(out, '\n');
             }
         }
         break;
@@ -570,14 +1270,383 @@ static void populate_csv_recursive(JsonValue *current_json_node, TableSchema *cu
     default:
         break;
     }
+    return 0;
 }
 
-void process_json_to_csv(JsonValue *root_json_value, const char *output_dir_path, const char *input_filename_base)
+// --- Records outside the sampled schema (--infer-from / --on-mismatch) ---
+
+typedef struct JsonWriteFrame
 {
-    if (!root_json_value)
+    ChildIter it;
+    int first;
+} JsonWriteFrame;
+
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; ++s)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+        {
+            fputc('\\', f);
+            fputc(c, f);
+        }
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+// Writes node as compact JSON (explicit stack, like the walks)
+static void write_json_value(FILE *f, NodeRef node)
+{
+    JsonWriteFrame *stack = NULL;
+    size_t depth = 0, cap = 0;
+    for (;;)
+    {
+        JsonValueType t = node_type(node);
+        if (t == JSON_OBJECT_TYPE || t == JSON_ARRAY_TYPE)
+        {
+            fputc(t == JSON_OBJECT_TYPE ? '{' : '[', f);
+            if (depth == cap)
+            {
+                cap = cap ? cap * 2 : 16;
+                JsonWriteFrame *grown = (JsonWriteFrame *)realloc(stack, cap * sizeof(JsonWriteFrame));
+                if (!grown)
+                {
+                    perror("Error: schema_csv realloc failed");
+                    exit(EXIT_FAILURE);
+                }
+                stack = grown;
+            }
+            stack[depth].it = node_children(node);
+            stack[depth].first = 1;
+            depth++;
+        }
+        else if (t == JSON_STRING_TYPE)
+            write_json_string(f, node_string(node) ? node_string(node) : "");
+        else if (t == JSON_NUMBER_TYPE)
+            fprintf(f, "%.17g", node_number(node));
+        else if (t == JSON_BOOLEAN_TYPE)
+            fputs(node_bool(node) ? "true" : "false", f);
+        else
+            fputs("null", f);
+
+        // Move on to the next value, closing finished containers
+        while (depth > 0)
+        {
+            JsonWriteFrame *top = &stack[depth - 1];
+            const char *key;
+            if (child_next(&top->it, &key, &node))
+            {
+                if (!top->first)
+                    fputc(',', f);
+                top->first = 0;
+                if (top->it.is_object)
+                {
+                    write_json_string(f, key);
+                    fputc(':', f);
+                }
+                break;
+            }
+            fputc(top->it.is_object ? '}' : ']', f);
+            depth--;
+        }
+        if (depth == 0)
+            break;
+    }
+    free(stack);
+}
+
+// Writes a record the sampled schema has no table for to <input>_unmatched.csv as raw JSON
+static void write_side_table_row(NodeRef node, const char *key, const WalkFrame *parent, const char *input_filename_base)
+{
+    if (!G_side_table)
+    {
+        char hint[MAX_NAME_LEN];
+        snprintf(hint, sizeof(hint), "%s_unmatched", input_filename_base);
+        G_tables_open = 0; // Add the columns before the header is written
+        G_side_table = get_or_create_table(hint, NULL, NULL, NULL, 0, 0);
+        G_tables_open = 1;
+        G_all_schemas_head = G_side_table->next_schema; // Kept off the list so no lookup can match it
+        G_side_table->next_schema = NULL;
+        const char *columns[] = {"table", "parent_id", "key", "json"};
+        for (int i = 0; i < 4; ++i)
+        {
+            G_side_table->columns[G_side_table->num_columns].type = i == 1 ? COLUMN_INT : COLUMN_TEXT;
+            strncpy(G_side_table->columns[G_side_table->num_columns++].name, columns[i], MAX_NAME_LEN - 1);
+        }
+        open_table_file(G_side_table);
+    }
+
+    char *json = NULL;
+    size_t json_len = 0;
+    FILE *mem = open_memstream(&json, &json_len);
+    if (!mem)
+    {
+        perror("Error: open_memstream failed");
+        exit(EXIT_FAILURE);
+    }
+    write_json_value(mem, node);
+    fclose(mem);
+
+    RowBatch *rows = G_side_table->rows;
+    if (rows)
+    {
+        row_batch_begin_row(rows);
+        row_batch_put_int(rows, 0, ++G_side_table->current_pk_id);
+        if (parent && parent->child_schema)
+            row_batch_put_text(rows, 1, parent->child_schema->name, strlen(parent->child_schema->name));
+        row_batch_put_int(rows, 2, parent ? parent->child_pk : 0);
+        if (key)
+            row_batch_put_text(rows, 3, key, strlen(key));
+        row_batch_put_text(rows, 4, json, json_len);
+        row_batch_end_row(rows);
+        free(json);
+        return;
+    }
+    CsvWriter *out = G_side_table->writer;
+    csv_writer_printf(out, "%ld,", ++G_side_table->current_pk_id);
+    if (parent && parent->child_schema)
+        write_csv_escaped_string(out, parent->child_schema->name);
+    csv_writer_printf(out, ",%ld,", parent ? parent->child_pk : 0);
+    write_csv_escaped_string(out, key);
+    csv_writer_putc(out, ',');
+    write_csv_escaped_string(out, json);
+    csv_writer_putc(out, '\n');
+    free(json);
+}
+
+// Applies --on-mismatch to a node populate_node found no sampled table for. Returns like populate_node.
+static int populate_mismatch(NodeRef node, const char *key, const WalkFrame *parent, const char *input_filename_base, WalkFrame *children)
+{
+    switch (G_on_mismatch)
+    {
+    case MISMATCH_FAIL:
+        if (G_schema_loaded)
+            fprintf(stderr, "Error: Record with key '%s' does not fit the loaded schema.\n", key ? key : "(array element)");
+        else
+            fprintf(stderr, "Error: Record with key '%s' does not fit the schema inferred from the first %ld elements of each array.\n",
+                    key ? key : "(array element)", G_infer_from);
+        exit(EXIT_FAILURE);
+    case MISMATCH_SIDE_TABLE:
+        write_side_table_row(node, key, parent, input_filename_base);
+        return 0;
+    case MISMATCH_WIDEN:
+    default:
+    {
+        // Run the discovery rules on this record (new tables open their files at once), then retry
+        const char *discover_key = !parent ? NULL : parent->use_member_keys ? key : parent->discover_key;
+        discover_subtree(node, discover_key, parent ? parent->child_schema : NULL, input_filename_base);
+        G_widening = 1;
+        int rc = populate_node(node, parent ? parent->child_schema : NULL, parent ? parent->child_pk : 0, key,
+                               input_filename_base, children);
+        G_widening = 0;
+        return rc;
+    }
+    }
+}
+
+static void populate_csv(NodeRef root, const char *input_filename_base)
+{
+    WalkStack st = {NULL, 0, 0};
+    WalkFrame frame;
+    int rc = populate_node(root, NULL, 0, input_filename_base, input_filename_base, &frame);
+    if (rc < 0)
+        rc = populate_mismatch(root, input_filename_base, NULL, input_filename_base, &frame);
+    if (rc)
+    {
+        if (G_release_early)
+            frame.release = (JsonValue *)root.ast;
+        walk_push(&st, &frame);
+    }
+
+    NodeRef child;
+    const char *key;
+    WalkFrame *parent;
+    while (walk_next(&st, &child, &key, &parent))
+    {
+        // With --release-early a subtree is freed as soon as its rows are written
+        rc = populate_node(child, parent->child_schema, parent->child_pk, key, input_filename_base, &frame);
+        if (rc < 0)
+            rc = populate_mismatch(child, key, parent, input_filename_base, &frame);
+        if (rc)
+        {
+            if (G_release_early)
+                frame.release = (JsonValue *)child.ast;
+            walk_push(&st, &frame); // May move the frames; parent is not used after this
+        }
+        else if (G_release_early && child.ast)
+        {
+            ast_release_children((JsonValue *)child.ast);
+        }
+    }
+    free(st.frames);
+}
+
+// Discovers and populates one node (--single-pass). Returns 1 and fills *children if its children
+// are visited next; discover_only is set if only discovery descends into them.
+static int convert_node(NodeRef node, const char *key, const WalkFrame *parent, const char *input_filename_base, WalkFrame *children)
+{
+    WalkFrame discovered;
+    // Like the two walks, discovery names the root after the input and population looks it up by that name
+    const char *discover_key = !parent ? NULL : parent->use_member_keys ? key : parent->discover_key;
+    int discover_more = discover_node(node, discover_key, parent ? parent->discover_schema : NULL, input_filename_base, &discovered);
+    if (parent && parent->discover_only)
+    {
+        *children = discovered;
+        children->discover_only = 1;
+    }
+    else if (!populate_node(node, parent ? parent->child_schema : NULL, parent ? parent->child_pk : 0, key,
+                            input_filename_base, children))
+    {
+        if (!discover_more)
+            return 0;
+        *children = discovered; // Population found no table here, but discovery still descends
+        children->discover_only = 1;
+    }
+    children->discover_schema = discovered.child_schema;
+    children->discover_key = discovered.child_key;
+    if (G_release_early)
+        children->release = (JsonValue *)node.ast;
+    return 1;
+}
+
+// Discovery and population fused into one walk: each node's tables are created (and their files
+// opened) just before its rows are written. Population only sees the tables discovered so far,
+// which is nearly always all it needs: a table's columns come from the first object that creates
+// it. Lookups by name alone are final; a table created later with the shape of an object that no
+// table matched by name, or with a name an array found no table under, changes where the two walks
+// put those rows. The walk then stops and returns -1 if the document can still be walked again.
+static int convert_single_pass(NodeRef root, const char *input_filename_base)
+{
+    WalkStack st = {NULL, 0, 0};
+    WalkFrame frame;
+    G_fusing = 1;
+    if (convert_node(root, input_filename_base, NULL, input_filename_base, &frame))
+        walk_push(&st, &frame);
+
+    NodeRef child;
+    const char *key;
+    WalkFrame *parent;
+    while (!(G_rows_misplaced && !G_subtrees_freed) && walk_next(&st, &child, &key, &parent))
+    {
+        // As in discovery, a container parsed from the index is made unparsed again once released
+        JsonLazy origin = {NULL, 0, JSON_NULL_TYPE};
+        if (G_release_early && child.ast && child.ast->type == JSON_LAZY_TYPE)
+            origin = *child.ast->data.lazy_val;
+        int in_unparsed = parent->origin.index || parent->in_unparsed;
+        if (convert_node(child, key, parent, input_filename_base, &frame))
+        {
+            frame.origin = origin;
+            frame.in_unparsed = in_unparsed;
+            walk_push(&st, &frame); // May move the frames; parent is not used after this
+        }
+        else if (G_release_early && child.ast)
+            release_container((JsonValue *)child.ast, &origin, in_unparsed);
+    }
+    // Given up: the outermost open container that came from the index is made unparsed again,
+    // which brings back whatever was freed inside it
+    for (size_t i = 0; G_rows_misplaced && i < st.depth; ++i)
+    {
+        if (st.frames[i].origin.index)
+        {
+            release_frame(&st.frames[i]);
+            break;
+        }
+    }
+    free(st.frames);
+    G_fusing = 0;
+    clear_missed_lookups(&G_missed_shapes);
+    clear_missed_lookups(&G_missed_names);
+    if (G_rows_misplaced && G_subtrees_freed)
+        fprintf(stderr, "Warning: --single-pass wrote some rows to other tables than two walks would (--release-early had freed them, so the document was not converted again).\n");
+    return G_rows_misplaced && !G_subtrees_freed ? -1 : 0;
+}
+
+// Deletes a table's file and, for pgcopy, its .sql (both with the same compression suffix)
+static void remove_table_file(const char *path)
+{
+    remove(path);
+    const char *ext = NULL;
+    for (const char *p = strstr(path, ".pgcopy"); p; p = strstr(p + 1, ".pgcopy"))
+        ext = p;
+    if (row_batch_format() != OUTPUT_PGCOPY || !ext)
+        return;
+    char *ddl_path = (char *)safe_csv_malloc(strlen(path) + 1);
+    sprintf(ddl_path, "%.*s.sql%s", (int)(ext - path), path, ext + strlen(".pgcopy"));
+    remove(ddl_path);
+    free(ddl_path);
+}
+
+// Closes and deletes every table file and empties the registry (a --single-pass walk given up)
+static void discard_tables(void)
+{
+    TableSchema *s = G_all_schemas_head;
+    while (s)
+    {
+        TableSchema *next = s->next_schema;
+        CsvWriter *w = s->rows ? s->rows->out : s->writer;
+        char *path = w ? strdup(w->path) : NULL;
+        row_batch_close(s->rows);
+        csv_writer_close(s->writer);
+        if (path)
+            remove_table_file(path);
+        free(path);
+        free_column_hash(s);
+        free(s);
+        s = next;
+    }
+    G_all_schemas_head = NULL;
+    G_tables_open = 0;
+}
+
+static void open_table_file(TableSchema *s)
+{
+    build_column_hash(s); // The columns are final once the file is opened
+    char file_path[MAX_NAME_LEN * 3];
+    OutputFormat format = row_batch_format();
+    snprintf(file_path, sizeof(file_path), "%s/%s%s", G_output_dir, s->name, output_format_suffix(format));
+    if (format != OUTPUT_CSV)
+    {
+        const char *names[MAX_COLUMNS_PER_TABLE];
+        ColumnType types[MAX_COLUMNS_PER_TABLE];
+        for (int i = 0; i < s->num_columns; ++i)
+        {
+            names[i] = s->columns[i].name;
+            types[i] = s->columns[i].type;
+        }
+        // Only full discovery has seen every value; the side table's types are its own
+        int types_final = s == G_side_table || (!G_fusing && !G_infer_from && !G_schema_loaded);
+        s->rows = row_batch_create(file_path, s->num_columns, names, types, types_final);
         return;
+    }
+    s->writer = csv_writer_create(file_path); // The file itself is created by the first flush
+    for (int i = 0; i < s->num_columns; ++i)
+    {
+        write_csv_escaped_string(s->writer, s->columns[i].name);
+        if (i < s->num_columns - 1)
+            csv_writer_putc(s->writer, ',');
+    }
+    csv_writer_putc(s->writer, '\n');
+    csv_writer_end_header(s->writer);
+}
+
+static void process_document(NodeRef root, const char *output_dir_path, const char *input_filename_base)
+{
     strncpy(G_output_dir, output_dir_path, sizeof(G_output_dir) - 1);
     G_output_dir[sizeof(G_output_dir) - 1] = '\0';
+    // A loaded schema keeps the names it was discovered under, whatever this input is called
+    if (G_schema_loaded)
+        input_filename_base = G_schema_source;
+    else
+    {
+        strncpy(G_schema_source, input_filename_base, sizeof(G_schema_source) - 1);
+        G_schema_source[sizeof(G_schema_source) - 1] = '\0';
+    }
     struct stat st = {0};
     if (stat(G_output_dir, &st) == -1)
     {
@@ -588,7 +1657,20 @@ void process_json_to_csv(JsonValue *root_json_value, const char *output_dir_path
         }
     }
 
-    discover_schemas_recursive(root_json_value, NULL, NULL, input_filename_base);
+    if (G_single_pass)
+    {
+        G_tables_open = 1;
+        if (convert_single_pass(root, input_filename_base) == 0)
+        {
+            if (!G_all_schemas_head)
+                printf("No tables generated for this JSON (no schemas discovered).\n");
+            return;
+        }
+        discard_tables(); // Converted again below, the way the two walks choose tables
+    }
+
+    if (!G_schema_loaded)
+        discover_schemas(root, input_filename_base);
     if (!G_all_schemas_head)
     {
         printf("No tables generated for this JSON (no schemas discovered).\n");
@@ -598,25 +1680,281 @@ void process_json_to_csv(JsonValue *root_json_value, const char *output_dir_path
     TableSchema *s = G_all_schemas_head;
     while (s)
     {
-        char file_path[MAX_NAME_LEN * 3];
-        snprintf(file_path, sizeof(file_path), "%s/%s.csv", G_output_dir, s->name);
-        s->file_ptr = fopen(file_path, "w");
-        if (!s->file_ptr)
+        open_table_file(s);
+        s = s->next_schema;
+    }
+    G_tables_open = 1;
+    populate_csv(root, input_filename_base);
+}
+
+void process_json_to_csv(JsonValue *root_json_value, const char *output_dir_path, const char *input_filename_base)
+{
+    if (!root_json_value)
+        return;
+    process_document(node_from_ast(root_json_value), output_dir_path, input_filename_base);
+}
+
+void process_tape_to_csv(const JsonTape *tape, const char *output_dir_path, const char *input_filename_base)
+{
+    if (!tape || tape->num_words == 0)
+        return;
+    process_document(node_from_tape(tape, 0), output_dir_path, input_filename_base);
+}
+
+void set_selected_keys(const char *comma_separated_keys)
+{
+    free(G_selected_keys_buf);
+    free(G_selected_keys);
+    G_selected_keys_buf = NULL;
+    G_selected_keys = NULL;
+    G_num_selected_keys = 0;
+    if (!comma_separated_keys)
+        return;
+
+    size_t len = strlen(comma_separated_keys);
+    G_selected_keys_buf = (char *)safe_csv_malloc(len + 1);
+    memcpy(G_selected_keys_buf, comma_separated_keys, len + 1);
+    int max_keys = 1;
+    for (const char *p = comma_separated_keys; *p; ++p)
+    {
+        if (*p == ',')
+            max_keys++;
+    }
+    G_selected_keys = (const char **)safe_csv_malloc(max_keys * sizeof(const char *));
+    char *save = NULL;
+    for (char *tok = strtok_r(G_selected_keys_buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+    {
+        G_selected_keys[G_num_selected_keys++] = tok;
+    }
+}
+
+void set_release_early(int enabled)
+{
+    G_release_early = enabled;
+}
+
+void set_single_pass(int enabled)
+{
+    G_single_pass = enabled;
+}
+
+void set_schema_inference(long infer_from, MismatchPolicy on_mismatch)
+{
+    G_infer_from = infer_from;
+    G_on_mismatch = on_mismatch;
+}
+
+void set_track_column_types(int enabled)
+{
+    G_track_column_types = enabled;
+}
+
+// --- Schema files (--schema-out / --schema-in) ---
+// Line based: a "json2relcsv-schema 2" header, the input base name the tables were named after,
+// then one "table" line per table in registry order, each followed by its shape and columns
+// (name and type). Fields are tab separated; tabs, newlines and backslashes inside them are
+// escaped.
+
+#define SCHEMA_FILE_HEADER "json2relcsv-schema 2"
+
+// Column type names in schema files, by ColumnType
+static const char *const G_schema_column_types[] = {"null", "bool", "int", "float", "text"};
+
+static void write_schema_field(FILE *f, const char *s)
+{
+    for (; *s; ++s)
+    {
+        switch (*s)
         {
-            perror("Error opening CSV file for writing");
-            fprintf(stderr, "Failed to open: %s\n", file_path);
-            exit(EXIT_FAILURE);
+        case '\\': fputs("\\\\", f); break;
+        case '\t': fputs("\\t", f); break;
+        case '\n': fputs("\\n", f); break;
+        case '\r': fputs("\\r", f); break;
+        default: fputc(*s, f);
         }
+    }
+}
+
+int save_schemas(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not write schema file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "%s\nsource\t", SCHEMA_FILE_HEADER);
+    write_schema_field(f, G_schema_source);
+    fprintf(f, "\n");
+    for (const TableSchema *s = G_all_schemas_head; s; s = s->next_schema)
+    {
+        fprintf(f, "table\t%s\t", s->is_junction_table ? "r3" : s->is_child_array_table ? "r2" : "r1");
+        write_schema_field(f, s->name);
+        fprintf(f, "\t");
+        write_schema_field(f, s->parent_fk_column_name);
+        fprintf(f, "\nshape\t");
+        write_schema_field(f, s->shape_signature);
+        fprintf(f, "\n");
         for (int i = 0; i < s->num_columns; ++i)
         {
-            write_csv_escaped_string(s->file_ptr, s->columns[i].name);
-            if (i < s->num_columns - 1)
-                fprintf(s->file_ptr, ",");
+            fprintf(f, "column\t");
+            write_schema_field(f, s->columns[i].name);
+            fprintf(f, "\t%s\n", G_schema_column_types[s->columns[i].type]);
         }
-        fprintf(s->file_ptr, "\n");
-        s = s->next_schema;
     }
-    populate_csv_recursive(root_json_value, NULL, 0, input_filename_base, input_filename_base);
+    if (fclose(f) != 0)
+    {
+        fprintf(stderr, "Error: Could not write schema file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Splits line into at most max_fields tab-separated fields, unescaping them in place.
+// Returns the number of fields, or -1 on a bad escape.
+static int split_schema_fields(char *line, char **fields, int max_fields)
+{
+    int n = 0;
+    char *out = line;
+    fields[n++] = out;
+    for (char *p = line; *p; ++p)
+    {
+        if (*p == '\t')
+        {
+            *out++ = '\0';
+            if (n == max_fields)
+                return -1;
+            fields[n++] = out;
+        }
+        else if (*p == '\\')
+        {
+            switch (*++p)
+            {
+            case '\\': *out++ = '\\'; break;
+            case 't': *out++ = '\t'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            default: return -1;
+            }
+        }
+        else
+        {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+    return n;
+}
+
+// Copies src into a dst of dst_size bytes; 0 if it fits
+static int copy_schema_field(char *dst, size_t dst_size, const char *src)
+{
+    size_t len = strlen(src);
+    if (len >= dst_size)
+        return -1;
+    memcpy(dst, src, len + 1);
+    return 0;
+}
+
+const char *schema_source_name(void)
+{
+    return G_schema_source;
+}
+
+int load_schemas(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not read schema file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    TableSchema *tail = NULL;
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t line_len;
+    int line_no = 0, ok = 1, have_source = 0;
+    while (ok && (line_len = getline(&line, &line_cap, f)) >= 0)
+    {
+        line_no++;
+        if (line_len > 0 && line[line_len - 1] == '\n')
+            line[--line_len] = '\0';
+        if (line_no == 1)
+        {
+            ok = strcmp(line, SCHEMA_FILE_HEADER) == 0;
+            continue;
+        }
+        if (line_len == 0)
+            continue;
+
+        char *fields[4];
+        int n = split_schema_fields(line, fields, 4);
+        if (n == 2 && strcmp(fields[0], "source") == 0)
+        {
+            ok = !have_source && copy_schema_field(G_schema_source, sizeof(G_schema_source), fields[1]) == 0;
+            have_source = 1;
+        }
+        else if (n == 4 && strcmp(fields[0], "table") == 0)
+        {
+            TableSchema *s = (TableSchema *)safe_csv_malloc(sizeof(TableSchema));
+            memset(s, 0, sizeof(TableSchema));
+            // Appended, so lookups walk the tables in the order discovery left them
+            if (tail)
+                tail->next_schema = s;
+            else
+                G_all_schemas_head = s;
+            tail = s;
+            s->is_child_array_table = strcmp(fields[1], "r2") == 0;
+            s->is_junction_table = strcmp(fields[1], "r3") == 0;
+            ok = (s->is_child_array_table || s->is_junction_table || strcmp(fields[1], "r1") == 0) &&
+                 fields[2][0] != '\0' && copy_schema_field(s->name, sizeof(s->name), fields[2]) == 0 &&
+                 copy_schema_field(s->parent_fk_column_name, sizeof(s->parent_fk_column_name), fields[3]) == 0;
+        }
+        else if (n == 2 && strcmp(fields[0], "shape") == 0)
+        {
+            ok = tail && copy_schema_field(tail->shape_signature, sizeof(tail->shape_signature), fields[1]) == 0;
+        }
+        else if (n == 3 && strcmp(fields[0], "column") == 0)
+        {
+            ok = tail && tail->num_columns < MAX_COLUMNS_PER_TABLE &&
+                 copy_schema_field(tail->columns[tail->num_columns].name, MAX_NAME_LEN, fields[1]) == 0;
+            if (ok)
+            { // The types are declared for the binary --format outputs
+                ColumnInfo *col = &tail->columns[tail->num_columns];
+                int t = COLUMN_TEXT;
+                while (t >= COLUMN_NULL && strcmp(fields[2], G_schema_column_types[t]) != 0)
+                    t--;
+                ok = t >= COLUMN_NULL;
+                col->type = (ColumnType)t;
+            }
+            if (ok)
+                tail->num_columns++;
+        }
+        else
+        {
+            ok = 0;
+        }
+    }
+    free(line);
+    fclose(f);
+    if (ok && !have_source)
+    {
+        ok = 0;
+        line_no = 2;
+    }
+
+    // Every table needs at least its id column
+    for (const TableSchema *s = G_all_schemas_head; ok && s; s = s->next_schema)
+        ok = s->num_columns > 0;
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Invalid schema file %s (line %d).\n", path, line_no);
+        cleanup_schemas();
+        return -1;
+    }
+    G_schema_loaded = 1;
+    return 0;
 }
 
 void cleanup_schemas()
@@ -625,10 +1963,27 @@ void cleanup_schemas()
     while (current)
     {
         TableSchema *next = current->next_schema;
-        if (current->file_ptr)
-            fclose(current->file_ptr);
+        row_batch_close(current->rows);
+        csv_writer_close(current->writer);
+        free_column_hash(current);
         free(current);
         current = next;
     }
     G_all_schemas_head = NULL;
+    G_tables_open = 0;
+    G_schema_loaded = 0;
+    if (G_side_table)
+    {
+        row_batch_close(G_side_table->rows);
+        csv_writer_close(G_side_table->writer);
+        free_column_hash(G_side_table);
+        free(G_side_table);
+        G_side_table = NULL;
+    }
+    set_selected_keys(NULL);
+    for (unsigned int i = 0; i < G_escaped_cache_cap; ++i)
+        free(G_escaped_cache[i].bytes);
+    free(G_escaped_cache);
+    G_escaped_cache = NULL;
+    G_escaped_cache_cap = 0;
 }
\ No newline at end of file
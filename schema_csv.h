@@ -3,7 +3,9 @@
 #define SCHEMA_CSV_H
 
 #include "ast.h"
-#include <stdio.h> // For FILE*
+#include "tape.h"
+#include "csv_writer.h"
+#include "row_batch.h"
 
 #define MAX_NAME_LEN 512
 #define MAX_COLUMNS_PER_TABLE 128
@@ -12,9 +14,19 @@
 typedef struct ColumnInfo
 {
     char name[MAX_NAME_LEN];
-    // Could add type hint if needed, but CSV is typeless
+    ColumnType type; // Values seen by discovery (only tracked for the binary --format outputs and --schema-out)
 } ColumnInfo;
 
+// Minimal perfect hash from member keys to column slots, built once a table's columns are final
+// (hash-and-displace: each key's bucket picks a seed that sends its keys to free slots)
+typedef struct ColumnHash
+{
+    int num_buckets, num_slots; // num_slots is the number of distinct column names
+    int *bucket_seed;           // Per bucket: seed of the slot hash, or -(slot + 1) for one-key buckets
+    int *slot_column;           // Per slot: first column with the slot's name
+    int *column_source;         // Per column: first column with the same name
+} ColumnHash;
+
 typedef struct TableSchema
 {
     char name[MAX_NAME_LEN]; // CSV file name (without .csv)
@@ -23,7 +35,8 @@ typedef struct TableSchema
 
     char shape_signature[MAX_SHAPE_SIGNATURE_LEN]; // Sorted unique keys string for R1
 
-    FILE *file_ptr;     // Open file pointer for writing CSV
+    CsvWriter *writer;  // Buffered output for the CSV file (csv_writer.h)
+    RowBatch *rows;     // Typed rows instead, for the binary --format outputs (row_batch.h)
     long current_pk_id; // To generate unique primary keys for this table
 
     // For R2 (array of objects -> child table)
@@ -33,6 +46,9 @@ typedef struct TableSchema
     // For R3 (array of scalars -> junction table)
     int is_junction_table; // True if this is a junction table for array of scalars
 
+    ColumnHash *column_hash; // Key -> column lookup for population (NULL until the file is opened)
+    int shape_fallback_rows; // --single-pass: got rows of objects no table matched by name
+
     struct TableSchema *next_schema; // For linked list of all schemas
 } TableSchema;
 
@@ -40,6 +56,43 @@ typedef struct TableSchema
 extern TableSchema *G_all_schemas_head;
 
 void process_json_to_csv(JsonValue *root_json_value, const char *output_dir_path, const char *input_filename_base);
+void process_tape_to_csv(const JsonTape *tape, const char *output_dir_path, const char *input_filename_base); // Same rules over a tape
+// Limits conversion to nested objects/arrays whose key is in the comma-separated list (NULL: all).
+// Applies at every depth; the root document is always converted.
+void set_selected_keys(const char *comma_separated_keys);
+// Frees each AST subtree as soon as its rows are written, so only the open path stays resident
+// (the converted AST is left as empty containers). With --lazy, discovery also re-releases each
+// container it parsed, and population parses it again; peak memory is then about the largest
+// subtree that has to be resident at once. No effect on tapes.
+void set_release_early(int enabled);
+// Discovers and populates in one walk instead of two, opening each table's file (header first)
+// as soon as the table is created. Same tables and rows; with --lazy --release-early the whole
+// document is then parsed and freed exactly once. Population can only look up the tables created
+// so far: if a later one is where the two walks would have put rows already written (a newer table
+// of an object's shape, or the table an array found none under), the files are dropped and the
+// document is converted again in two walks. Plain --release-early has freed those subtrees by
+// then, so the rows stay where they are, with a warning.
+void set_single_pass(int enabled);
+// --infer-from N: discovery only looks at the first N elements of each array; the rest are
+// populated through the tables found there. on_mismatch decides what happens to a record that
+// needs a table the sample did not produce.
+typedef enum
+{
+    MISMATCH_WIDEN,      // Run discovery on the record and add the tables it needs
+    MISMATCH_SIDE_TABLE, // Write it as raw JSON to <input>_unmatched.csv
+    MISMATCH_FAIL        // Report it and exit
+} MismatchPolicy;
+void set_schema_inference(long infer_from, MismatchPolicy on_mismatch); // infer_from 0: discover from everything
+// Has discovery record column types with CSV output as well, so --schema-out can save them
+void set_track_column_types(int enabled);
+// --schema-out / --schema-in: the table registry (names, flags, FK column, shape, columns and
+// their types) as a text file. save_schemas writes the tables of the last conversion, including any added while
+// populating. load_schemas replaces discovery: the next conversion streams rows straight into the
+// loaded tables, named as in the run that saved them. Records they do not cover are handled as
+// under --infer-from (see set_schema_inference). Both return 0, or -1 after reporting the error.
+int save_schemas(const char *path);
+int load_schemas(const char *path);
+const char *schema_source_name(void); // Input base name the registry's tables are named after
 void cleanup_schemas(); // Frees all schema memory and closes files
 
 #endif // SCHEMA_CSV_H
\ No newline at end of file
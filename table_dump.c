@@ -0,0 +1,1207 @@
+// table_dump.c
+// json2relcsv-dump: reads a table written with --format and prints it as CSV, quoted like
+// json2relcsv's CSV output (integers in full, floats with %g, nulls as empty fields). Every
+// offset and length in the file is checked, so it doubles as a validator for the round-trip
+// check (make check-formats).
+//
+//   ./json2relcsv-dump <file.arrow|file.parquet|file.pgcopy>
+//
+// A .pgcopy file carries no types: they are read from the CREATE TABLE in the .sql next to it.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "arrow_writer.h"   // For ARROW_MAGIC
+#include "parquet_writer.h" // For PARQUET_MAGIC and the Thrift and Parquet constants
+#include "pgcopy_writer.h"  // For PGCOPY_SIGNATURE
+
+typedef struct Bytes
+{
+    const unsigned char *data;
+    size_t len;
+} Bytes;
+
+typedef enum
+{
+    DUMP_INT,
+    DUMP_FLOAT,
+    DUMP_BOOL,
+    DUMP_TEXT
+} DumpType;
+
+typedef struct DumpColumn
+{
+    char *name;
+    DumpType type;
+    int optional; // Parquet: has definition levels
+    // Current batch (the Parquet reader decodes a row group into buffers laid out the same way)
+    const unsigned char *validity; // NULL: no nulls
+    const unsigned char *values;
+    const int32_t *offsets;
+    const unsigned char *text;
+} DumpColumn;
+
+static void fail(const char *path, const char *what)
+{
+    fprintf(stderr, "Error: %s: %s\n", path, what);
+    exit(EXIT_FAILURE);
+}
+
+static uint64_t read_le(const unsigned char *p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = n; i-- > 0;)
+        v = v << 8 | p[i];
+    return v;
+}
+
+// --- Flatbuffers reading (bounds-checked) ---
+
+typedef struct FbTable
+{
+    Bytes buf;
+    size_t pos;                 // Table start
+    const unsigned char *vtable;
+    size_t vtable_len;
+} FbTable;
+
+static const char *G_path = "";
+
+static void need(Bytes b, size_t pos, size_t n)
+{
+    if (pos > b.len || b.len - pos < n)
+        fail(G_path, "offset out of bounds");
+}
+
+static FbTable fb_table_at(Bytes buf, size_t pos)
+{
+    need(buf, pos, 4);
+    int32_t soffset = (int32_t)read_le(buf.data + pos, 4);
+    size_t vt = (size_t)((int64_t)pos - soffset);
+    need(buf, vt, 4);
+    FbTable t = {buf, pos, buf.data + vt, read_le(buf.data + vt, 2)};
+    need(buf, vt, t.vtable_len);
+    return t;
+}
+
+static FbTable fb_root(Bytes buf)
+{
+    need(buf, 0, 4);
+    return fb_table_at(buf, read_le(buf.data, 4));
+}
+
+// Position of field id, or 0 if absent
+static size_t fb_field(const FbTable *t, int id)
+{
+    size_t entry = 4 + 2 * (size_t)id;
+    if (entry + 2 > t->vtable_len)
+        return 0;
+    size_t off = read_le(t->vtable + entry, 2);
+    return off ? t->pos + off : 0;
+}
+
+static uint64_t fb_scalar(const FbTable *t, int id, size_t n, uint64_t dflt)
+{
+    size_t at = fb_field(t, id);
+    if (!at)
+        return dflt;
+    need(t->buf, at, n);
+    return read_le(t->buf.data + at, n);
+}
+
+// Position of the object an offset field points to, or 0
+static size_t fb_deref(const FbTable *t, int id)
+{
+    size_t at = fb_field(t, id);
+    if (!at)
+        return 0;
+    need(t->buf, at, 4);
+    return at + read_le(t->buf.data + at, 4);
+}
+
+static FbTable fb_subtable(const FbTable *t, int id, const char *what)
+{
+    size_t at = fb_deref(t, id);
+    if (!at)
+        fail(G_path, what);
+    return fb_table_at(t->buf, at);
+}
+
+// Vector: its element count, *elems set to where the elements start
+static size_t fb_vector(const FbTable *t, int id, size_t elem_size, size_t *elems)
+{
+    size_t at = fb_deref(t, id);
+    if (!at)
+    {
+        *elems = 0;
+        return 0;
+    }
+    need(t->buf, at, 4);
+    size_t n = read_le(t->buf.data + at, 4);
+    *elems = at + 4;
+    if (n > t->buf.len / (elem_size ? elem_size : 1))
+        fail(G_path, "vector out of bounds");
+    need(t->buf, *elems, n * elem_size);
+    return n;
+}
+
+static char *fb_string(const FbTable *t, int id)
+{
+    size_t at;
+    size_t len = fb_vector(t, id, 1, &at);
+    char *s = (char *)malloc(len + 1);
+    if (!s)
+        fail(G_path, "out of memory");
+    memcpy(s, t->buf.data + at, len);
+    s[len] = '\0';
+    return s;
+}
+
+// --- CSV output ---
+
+static void print_field(const char *s, size_t len)
+{
+    int quote = len == 0;
+    for (size_t i = 0; i < len && !quote; ++i)
+        quote = s[i] == '"' || s[i] == ',' || s[i] == '\n' || s[i] == '\r';
+    if (!quote)
+    {
+        fwrite(s, 1, len, stdout);
+        return;
+    }
+    putchar('"');
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (s[i] == '"')
+            putchar('"');
+        putchar(s[i]);
+    }
+    putchar('"');
+}
+
+static void print_header(const DumpColumn *cols, int n)
+{
+    for (int c = 0; c < n; ++c)
+    {
+        if (c)
+            putchar(',');
+        print_field(cols[c].name, strlen(cols[c].name));
+    }
+    putchar('\n');
+}
+
+static int bit(const unsigned char *bits, size_t i)
+{
+    return bits[i / 8] >> (i % 8) & 1;
+}
+
+// Prints the rows of the current batch
+static void print_rows(const DumpColumn *cols, int n, size_t rows)
+{
+    for (size_t r = 0; r < rows; ++r)
+    {
+        for (int c = 0; c < n; ++c)
+        {
+            const DumpColumn *col = &cols[c];
+            if (c)
+                putchar(',');
+            if (col->validity && !bit(col->validity, r))
+                continue;
+            int64_t i;
+            double d;
+            switch (col->type)
+            {
+            case DUMP_INT:
+                memcpy(&i, col->values + 8 * r, 8);
+                printf("%" PRId64, i);
+                break;
+            case DUMP_FLOAT:
+                memcpy(&d, col->values + 8 * r, 8);
+                printf("%g", d);
+                break;
+            case DUMP_BOOL:
+                fputs(bit(col->values, r) ? "true" : "false", stdout);
+                break;
+            case DUMP_TEXT:
+                print_field((const char *)col->text + col->offsets[r], (size_t)(col->offsets[r + 1] - col->offsets[r]));
+                break;
+            }
+        }
+        putchar('\n');
+    }
+}
+
+// --- Arrow IPC file ---
+
+static int read_arrow_schema(FbTable schema, DumpColumn **cols_out)
+{
+    size_t elems;
+    size_t n = fb_vector(&schema, 1, 4, &elems);
+    DumpColumn *cols = (DumpColumn *)calloc(n ? n : 1, sizeof(DumpColumn));
+    if (!cols)
+        fail(G_path, "out of memory");
+    for (size_t c = 0; c < n; ++c)
+    {
+        size_t at = elems + 4 * c;
+        FbTable field = fb_table_at(schema.buf, at + read_le(schema.buf.data + at, 4));
+        cols[c].name = fb_string(&field, 0);
+        int type_type = (int)fb_scalar(&field, 2, 1, 0);
+        FbTable type = fb_subtable(&field, 3, "field without a type");
+        if (type_type == 2 && fb_scalar(&type, 0, 4, 0) == 64 && fb_scalar(&type, 1, 1, 0) == 1)
+            cols[c].type = DUMP_INT;
+        else if (type_type == 3 && fb_scalar(&type, 0, 2, 0) == 2)
+            cols[c].type = DUMP_FLOAT;
+        else if (type_type == 6)
+            cols[c].type = DUMP_BOOL;
+        else if (type_type == 5)
+            cols[c].type = DUMP_TEXT;
+        else
+            fail(G_path, "unsupported column type (only int64, float64, bool and utf8 are written)");
+    }
+    *cols_out = cols;
+    return (int)n;
+}
+
+// Points buf (offset, length) of a record batch body at its bytes
+static const unsigned char *arrow_buffer(Bytes body, const unsigned char *spec, size_t min_len)
+{
+    uint64_t off = read_le(spec, 8), len = read_le(spec + 8, 8);
+    if (off > body.len || body.len - off < len || len < min_len)
+        fail(G_path, "record batch buffer out of bounds");
+    return body.data + off;
+}
+
+static void dump_arrow_batch(Bytes file, size_t offset, size_t meta_len, size_t body_len, DumpColumn *cols, int n)
+{
+    need(file, offset, 8);
+    if (read_le(file.data + offset, 4) != 0xFFFFFFFFu || 8 + read_le(file.data + offset + 4, 4) != meta_len)
+        fail(G_path, "bad record batch message prefix");
+    need(file, offset, meta_len);
+    need(file, offset + meta_len, body_len);
+    Bytes meta = {file.data + offset + 8, meta_len - 8};
+    Bytes body = {file.data + offset + meta_len, body_len};
+    FbTable msg = fb_root(meta);
+    if (fb_scalar(&msg, 1, 1, 0) != 3)
+        fail(G_path, "block is not a record batch");
+    if (fb_scalar(&msg, 3, 8, 0) != body_len)
+        fail(G_path, "record batch body length does not match its block");
+    FbTable batch = fb_subtable(&msg, 2, "record batch without a header");
+    size_t rows = fb_scalar(&batch, 0, 8, 0);
+    size_t nodes, buffers;
+    if (fb_vector(&batch, 1, 16, &nodes) != (size_t)n)
+        fail(G_path, "record batch has a different number of columns than the schema");
+    size_t num_buffers = fb_vector(&batch, 2, 16, &buffers);
+    size_t k = 0;
+    for (int c = 0; c < n; ++c)
+    {
+        const unsigned char *node = meta.data + nodes + 16 * c;
+        size_t nulls = read_le(node + 8, 8);
+        if (read_le(node, 8) != rows)
+            fail(G_path, "column length differs from the batch length");
+        if (k + (cols[c].type == DUMP_TEXT ? 3 : 2) > num_buffers)
+            fail(G_path, "too few buffers in record batch");
+        const unsigned char *spec = meta.data + buffers + 16 * k;
+        cols[c].validity = read_le(spec + 8, 8) ? arrow_buffer(body, spec, (rows + 7) / 8) : NULL;
+        if (!cols[c].validity && nulls)
+            fail(G_path, "nulls without a validity bitmap");
+        size_t counted = 0;
+        for (size_t r = 0; cols[c].validity && r < rows; ++r)
+            counted += !bit(cols[c].validity, r);
+        if (cols[c].validity && counted != nulls)
+            fail(G_path, "null count does not match the validity bitmap");
+        spec += 16;
+        size_t values_len = cols[c].type == DUMP_BOOL ? (rows + 7) / 8 : cols[c].type == DUMP_TEXT ? (rows + 1) * 4 : rows * 8;
+        cols[c].values = arrow_buffer(body, spec, values_len);
+        k += 2;
+        if (cols[c].type == DUMP_TEXT)
+        {
+            cols[c].offsets = (const int32_t *)cols[c].values;
+            spec += 16;
+            cols[c].text = arrow_buffer(body, spec, 0);
+            size_t text_len = read_le(spec + 8, 8);
+            for (size_t r = 0; r < rows; ++r)
+            {
+                if (cols[c].offsets[r] < 0 || cols[c].offsets[r] > cols[c].offsets[r + 1] || (size_t)cols[c].offsets[r + 1] > text_len)
+                    fail(G_path, "bad utf8 offsets");
+            }
+            k++;
+        }
+    }
+
+    print_rows(cols, n, rows);
+}
+
+static void dump_arrow(Bytes file)
+{
+    size_t magic_len = strlen(ARROW_MAGIC);
+    if (file.len < 8 + 10 || memcmp(file.data, ARROW_MAGIC, magic_len) != 0 ||
+        memcmp(file.data + file.len - magic_len, ARROW_MAGIC, magic_len) != 0)
+        fail(G_path, "not an Arrow IPC file");
+    size_t footer_len = read_le(file.data + file.len - 10, 4);
+    if (footer_len > file.len - 18)
+        fail(G_path, "footer out of bounds");
+    Bytes footer = {file.data + file.len - 10 - footer_len, footer_len};
+    FbTable root = fb_root(footer);
+    DumpColumn *cols;
+    int n = read_arrow_schema(fb_subtable(&root, 1, "footer without a schema"), &cols);
+    print_header(cols, n);
+    size_t blocks;
+    size_t num_blocks = fb_vector(&root, 3, 24, &blocks);
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        const unsigned char *block = footer.data + blocks + 24 * i;
+        dump_arrow_batch(file, read_le(block, 8), read_le(block + 8, 4), read_le(block + 16, 8), cols, n);
+    }
+    for (int c = 0; c < n; ++c)
+        free(cols[c].name);
+    free(cols);
+}
+
+// --- Parquet file ---
+
+typedef struct ThriftReader
+{
+    Bytes buf;
+    size_t pos;
+} ThriftReader;
+
+typedef struct ParquetChunk
+{
+    int type, codec;
+    int64_t num_values, size, data_page_offset, dictionary_page_offset; // -1: no dictionary page
+    int has_null_count, has_min_max;
+    int64_t null_count;
+    Bytes min, max;
+} ParquetChunk;
+
+static const unsigned char G_bool_bytes[2] = {0, 1}; // What decoded booleans point at
+
+static uint64_t read_varint(Bytes b, size_t *pos)
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        need(b, *pos, 1);
+        unsigned char byte = b.data[(*pos)++];
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return v;
+    }
+    fail(G_path, "bad varint");
+    return 0;
+}
+
+static int64_t tr_int(ThriftReader *t)
+{
+    uint64_t v = read_varint(t->buf, &t->pos);
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static int64_t tr_int_field(ThriftReader *t, int type)
+{
+    if (type != THRIFT_I16 && type != THRIFT_I32 && type != THRIFT_I64)
+        fail(G_path, "metadata field of an unexpected type");
+    return tr_int(t);
+}
+
+// Next field of the struct being read (0 at its end); *last is the previous field id
+static int tr_field(ThriftReader *t, int *last, int *type)
+{
+    need(t->buf, t->pos, 1);
+    unsigned char byte = t->buf.data[t->pos++];
+    if (byte == THRIFT_STOP)
+        return 0;
+    *type = byte & 0x0F;
+    *last = byte >> 4 ? *last + (byte >> 4) : (int)tr_int(t);
+    return *last;
+}
+
+static Bytes tr_binary(ThriftReader *t)
+{
+    size_t len = read_varint(t->buf, &t->pos);
+    need(t->buf, t->pos, len);
+    Bytes b = {t->buf.data + t->pos, len};
+    t->pos += len;
+    return b;
+}
+
+static size_t tr_list(ThriftReader *t, int *elem_type)
+{
+    need(t->buf, t->pos, 1);
+    unsigned char byte = t->buf.data[t->pos++];
+    size_t n = byte >> 4 == 15 ? read_varint(t->buf, &t->pos) : (size_t)(byte >> 4);
+    *elem_type = byte & 0x0F;
+    if (n > t->buf.len - t->pos) // Every element takes a byte at least
+        fail(G_path, "list out of bounds");
+    return n;
+}
+
+static void tr_skip(ThriftReader *t, int type, int depth);
+
+// A boolean in a list or map is a byte of its own
+static void tr_skip_element(ThriftReader *t, int type, int depth)
+{
+    if (type == THRIFT_TRUE || type == THRIFT_FALSE)
+        type = THRIFT_BYTE;
+    tr_skip(t, type, depth);
+}
+
+static void tr_skip(ThriftReader *t, int type, int depth)
+{
+    if (depth > 64)
+        fail(G_path, "metadata nested too deeply");
+    int last = 0, elem_type;
+    size_t n;
+    switch (type)
+    {
+    case THRIFT_TRUE:
+    case THRIFT_FALSE:
+        break; // The value is in the field header
+    case THRIFT_BYTE:
+        need(t->buf, t->pos, 1);
+        t->pos++;
+        break;
+    case THRIFT_I16:
+    case THRIFT_I32:
+    case THRIFT_I64:
+        tr_int(t);
+        break;
+    case THRIFT_DOUBLE:
+        need(t->buf, t->pos, 8);
+        t->pos += 8;
+        break;
+    case THRIFT_BINARY:
+        tr_binary(t);
+        break;
+    case THRIFT_LIST:
+    case THRIFT_SET:
+        n = tr_list(t, &elem_type);
+        for (size_t i = 0; i < n; ++i)
+            tr_skip_element(t, elem_type, depth + 1);
+        break;
+    case THRIFT_MAP:
+        n = read_varint(t->buf, &t->pos);
+        if (n)
+        {
+            need(t->buf, t->pos, 1);
+            int kv = t->buf.data[t->pos++];
+            for (size_t i = 0; i < n; ++i)
+            {
+                tr_skip_element(t, kv >> 4, depth + 1);
+                tr_skip_element(t, kv & 0x0F, depth + 1);
+            }
+        }
+        break;
+    case THRIFT_STRUCT:
+        while (tr_field(t, &last, &elem_type))
+            tr_skip(t, elem_type, depth + 1);
+        break;
+    default:
+        fail(G_path, "unknown Thrift type in metadata");
+    }
+}
+
+static int parquet_type_of(DumpType type)
+{
+    switch (type)
+    {
+    case DUMP_INT:
+        return PARQUET_TYPE_INT64;
+    case DUMP_FLOAT:
+        return PARQUET_TYPE_DOUBLE;
+    case DUMP_BOOL:
+        return PARQUET_TYPE_BOOLEAN;
+    default:
+        return PARQUET_TYPE_BYTE_ARRAY;
+    }
+}
+
+// Schema list of FileMetaData: a root with the columns as its children (a flat table)
+static int read_parquet_schema(ThriftReader *t, DumpColumn **cols_out)
+{
+    int elem_type;
+    size_t count = tr_list(t, &elem_type);
+    if (elem_type != THRIFT_STRUCT || count < 1)
+        fail(G_path, "bad schema");
+    DumpColumn *cols = (DumpColumn *)calloc(count, sizeof(DumpColumn));
+    if (!cols)
+        fail(G_path, "out of memory");
+    for (size_t e = 0; e < count; ++e)
+    {
+        int last = 0, type, id, physical = -1, repetition = -1;
+        int64_t children = 0;
+        char *name = NULL;
+        while ((id = tr_field(t, &last, &type)))
+        {
+            if (id == 1)
+                physical = (int)tr_int_field(t, type);
+            else if (id == 3)
+                repetition = (int)tr_int_field(t, type);
+            else if (id == 4 && type == THRIFT_BINARY && !name)
+            {
+                Bytes b = tr_binary(t);
+                name = (char *)malloc(b.len + 1);
+                if (!name)
+                    fail(G_path, "out of memory");
+                memcpy(name, b.data, b.len);
+                name[b.len] = '\0';
+            }
+            else if (id == 5)
+                children = tr_int_field(t, type);
+            else
+                tr_skip(t, type, 0);
+        }
+        if (e == 0)
+        {
+            if (children != (int64_t)count - 1)
+                fail(G_path, "nested schemas are not supported");
+            free(name);
+            continue;
+        }
+        if (children || repetition > PARQUET_OPTIONAL || !name)
+            fail(G_path, "nested or repeated columns are not supported");
+        DumpColumn *col = &cols[e - 1];
+        col->name = name;
+        col->optional = repetition == PARQUET_OPTIONAL;
+        if (physical == PARQUET_TYPE_INT64)
+            col->type = DUMP_INT;
+        else if (physical == PARQUET_TYPE_DOUBLE)
+            col->type = DUMP_FLOAT;
+        else if (physical == PARQUET_TYPE_BOOLEAN)
+            col->type = DUMP_BOOL;
+        else if (physical == PARQUET_TYPE_BYTE_ARRAY)
+            col->type = DUMP_TEXT;
+        else
+            fail(G_path, "unsupported column type (only INT64, DOUBLE, BOOLEAN and BYTE_ARRAY are written)");
+    }
+    *cols_out = cols;
+    return (int)count - 1;
+}
+
+static void read_parquet_chunk(ThriftReader *t, ParquetChunk *ch)
+{
+    memset(ch, 0, sizeof(*ch));
+    ch->type = ch->codec = -1;
+    ch->num_values = ch->size = ch->data_page_offset = ch->dictionary_page_offset = -1;
+    int last = 0, type, id, has_meta = 0;
+    while ((id = tr_field(t, &last, &type)))
+    {
+        if (id == 1)
+            fail(G_path, "column chunks in other files are not supported");
+        if (id != 3 || type != THRIFT_STRUCT)
+        {
+            tr_skip(t, type, 0);
+            continue;
+        }
+        has_meta = 1;
+        int meta_last = 0;
+        while ((id = tr_field(t, &meta_last, &type)))
+        {
+            if (id == 1)
+                ch->type = (int)tr_int_field(t, type);
+            else if (id == 4)
+                ch->codec = (int)tr_int_field(t, type);
+            else if (id == 5)
+                ch->num_values = tr_int_field(t, type);
+            else if (id == 7)
+                ch->size = tr_int_field(t, type);
+            else if (id == 9)
+                ch->data_page_offset = tr_int_field(t, type);
+            else if (id == 11)
+                ch->dictionary_page_offset = tr_int_field(t, type);
+            else if (id == 12 && type == THRIFT_STRUCT)
+            {
+                int stats_last = 0, has_min = 0, has_max = 0;
+                while ((id = tr_field(t, &stats_last, &type)))
+                {
+                    if (id == 3)
+                    {
+                        ch->null_count = tr_int_field(t, type);
+                        ch->has_null_count = 1;
+                    }
+                    else if (id == 5 && type == THRIFT_BINARY)
+                    {
+                        ch->max = tr_binary(t);
+                        has_max = 1;
+                    }
+                    else if (id == 6 && type == THRIFT_BINARY)
+                    {
+                        ch->min = tr_binary(t);
+                        has_min = 1;
+                    }
+                    else
+                        tr_skip(t, type, 0);
+                }
+                ch->has_min_max = has_min && has_max;
+            }
+            else
+                tr_skip(t, type, 0);
+        }
+    }
+    if (!has_meta)
+        fail(G_path, "column chunk without metadata");
+}
+
+// Decodes n values of the RLE/bit-packed hybrid encoding
+static void decode_hybrid(Bytes data, int width, uint32_t *out, size_t n)
+{
+    size_t pos = 0, got = 0, value_len = (size_t)(width + 7) / 8;
+    while (got < n)
+    {
+        uint64_t header = read_varint(data, &pos);
+        uint64_t count = header >> 1;
+        if (header & 1)
+        { // count groups of 8 bit-packed values
+            if (count > data.len)
+                fail(G_path, "bit-packed run out of bounds");
+            need(data, pos, count * (size_t)width);
+            for (size_t k = 0; k < count * 8 && got < n; ++k)
+            {
+                uint32_t v = 0;
+                for (int b = 0; b < width; ++b)
+                {
+                    size_t at = k * (size_t)width + (size_t)b;
+                    v |= (uint32_t)(data.data[pos + at / 8] >> (at % 8) & 1) << b;
+                }
+                out[got++] = v;
+            }
+            pos += count * (size_t)width;
+        }
+        else
+        {
+            if (!count)
+                fail(G_path, "empty RLE run");
+            need(data, pos, value_len);
+            uint32_t v = (uint32_t)read_le(data.data + pos, value_len);
+            pos += value_len;
+            for (uint64_t k = 0; k < count && got < n; ++k)
+                out[got++] = v;
+        }
+    }
+}
+
+// PLAIN values: each one's bytes (8 for int64 and double, a byte of G_bool_bytes for booleans)
+static void decode_plain(Bytes data, DumpType type, size_t count, Bytes *out)
+{
+    size_t pos = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        switch (type)
+        {
+        case DUMP_BOOL:
+            need(data, i / 8, 1);
+            out[i].data = &G_bool_bytes[bit(data.data, i)];
+            out[i].len = 1;
+            break;
+        case DUMP_TEXT:
+            need(data, pos, 4);
+            out[i].len = read_le(data.data + pos, 4);
+            need(data, pos + 4, out[i].len);
+            out[i].data = data.data + pos + 4;
+            pos += 4 + out[i].len;
+            break;
+        default:
+            need(data, pos, 8);
+            out[i].data = data.data + pos;
+            out[i].len = 8;
+            pos += 8;
+            break;
+        }
+    }
+}
+
+// Orders two decoded values as the statistics do (-1, 0, 1)
+static int compare_plain(DumpType type, Bytes a, Bytes b)
+{
+    if (type == DUMP_INT)
+    {
+        int64_t x = (int64_t)read_le(a.data, 8), y = (int64_t)read_le(b.data, 8);
+        return (x > y) - (x < y);
+    }
+    if (type == DUMP_FLOAT)
+    {
+        uint64_t xb = read_le(a.data, 8), yb = read_le(b.data, 8);
+        double x, y;
+        memcpy(&x, &xb, 8);
+        memcpy(&y, &yb, 8);
+        return (x > y) - (x < y);
+    }
+    size_t len = a.len < b.len ? a.len : b.len;
+    int c = memcmp(a.data, b.data, len);
+    return c ? (c > 0) - (c < 0) : (a.len > b.len) - (a.len < b.len);
+}
+
+static void *dump_alloc(size_t size)
+{
+    void *p = calloc(size ? size : 1, 1);
+    if (!p)
+        fail(G_path, "out of memory");
+    return p;
+}
+
+// Decodes a column chunk of rows rows into col's buffers (laid out as an Arrow batch's) and checks
+// its statistics against the values
+static void decode_parquet_chunk(Bytes data, const ParquetChunk *ch, DumpColumn *col, size_t rows)
+{
+    if (ch->type != parquet_type_of(col->type))
+        fail(G_path, "column chunk type differs from the schema");
+    if (ch->codec != PARQUET_CODEC_UNCOMPRESSED)
+        fail(G_path, "compressed column chunks are not supported");
+    if (ch->num_values != (int64_t)rows)
+        fail(G_path, "column chunk value count differs from its row group");
+    int64_t start = ch->dictionary_page_offset >= 0 ? ch->dictionary_page_offset : ch->data_page_offset;
+    if (start < 4 || ch->size < 0)
+        fail(G_path, "column chunk out of bounds");
+    need(data, (size_t)start, (size_t)ch->size);
+    Bytes chunk = {data.data + start, (size_t)ch->size};
+
+    unsigned char *validity = (unsigned char *)dump_alloc((rows + 7) / 8);
+    unsigned char *values = col->type == DUMP_TEXT ? NULL : (unsigned char *)dump_alloc(col->type == DUMP_BOOL ? (rows + 7) / 8 : rows * 8);
+    int32_t *offsets = col->type == DUMP_TEXT ? (int32_t *)dump_alloc((rows + 1) * 4) : NULL;
+    unsigned char *text = NULL;
+    size_t text_len = 0, text_cap = 0;
+    Bytes *dict = NULL, *page_values = NULL, min = {NULL, 0}, max = {NULL, 0};
+    size_t dict_len = 0, present_total = 0, row = 0, pos = 0;
+    uint32_t *levels = NULL;
+    while (row < rows)
+    {
+        ThriftReader h = {chunk, pos};
+        int last = 0, type, id, page_type = -1;
+        int64_t page_len = -1, stored_len = -1, num_values = -1, encoding = -1, level_encoding = -1;
+        while ((id = tr_field(&h, &last, &type)))
+        {
+            if (id == 1)
+                page_type = (int)tr_int_field(&h, type);
+            else if (id == 2)
+                page_len = tr_int_field(&h, type);
+            else if (id == 3)
+                stored_len = tr_int_field(&h, type);
+            else if ((id == 5 || id == 7) && type == THRIFT_STRUCT)
+            { // DataPageHeader or DictionaryPageHeader: num_values, encoding (, definition levels)
+                int header_last = 0;
+                while ((id = tr_field(&h, &header_last, &type)))
+                {
+                    if (id == 1)
+                        num_values = tr_int_field(&h, type);
+                    else if (id == 2)
+                        encoding = tr_int_field(&h, type);
+                    else if (id == 3)
+                        level_encoding = tr_int_field(&h, type);
+                    else
+                        tr_skip(&h, type, 0);
+                }
+            }
+            else
+                tr_skip(&h, type, 0);
+        }
+        if (page_len < 0 || stored_len != page_len)
+            fail(G_path, "bad page sizes");
+        need(chunk, h.pos, (size_t)page_len);
+        Bytes page = {chunk.data + h.pos, (size_t)page_len};
+        pos = h.pos + (size_t)page_len;
+
+        if (page_type == PARQUET_PAGE_DICTIONARY)
+        {
+            if (dict || row || col->type == DUMP_BOOL || num_values < 0 || (size_t)num_values > page.len)
+                fail(G_path, "bad dictionary page");
+            if (encoding != PARQUET_ENCODING_PLAIN && encoding != PARQUET_ENCODING_PLAIN_DICTIONARY)
+                fail(G_path, "unsupported dictionary page encoding");
+            dict_len = (size_t)num_values;
+            dict = (Bytes *)dump_alloc(dict_len * sizeof(Bytes));
+            decode_plain(page, col->type, dict_len, dict);
+            continue;
+        }
+        if (page_type != PARQUET_PAGE_DATA)
+        {
+            if (page_type == PARQUET_PAGE_DATA_V2)
+                fail(G_path, "version 2 data pages are not supported");
+            continue; // Index pages
+        }
+        if (num_values <= 0 || (uint64_t)num_values > rows - row)
+            fail(G_path, "bad data page value count");
+        size_t n = (size_t)num_values, at = 0, present = 0;
+        levels = (uint32_t *)realloc(levels, n * sizeof(uint32_t));
+        page_values = (Bytes *)realloc(page_values, n * sizeof(Bytes));
+        if (!levels || !page_values)
+            fail(G_path, "out of memory");
+        if (col->optional)
+        {
+            if (level_encoding != PARQUET_ENCODING_RLE)
+                fail(G_path, "unsupported definition level encoding");
+            need(page, 0, 4);
+            size_t len = read_le(page.data, 4);
+            need(page, 4, len);
+            decode_hybrid((Bytes){page.data + 4, len}, 1, levels, n);
+            at = 4 + len;
+        }
+        for (size_t k = 0; k < n; ++k)
+            present += col->optional ? levels[k] : 1;
+        Bytes encoded = {page.data + at, page.len - at};
+        if (encoding == PARQUET_ENCODING_PLAIN)
+            decode_plain(encoded, col->type, present, page_values);
+        else if (encoding == PARQUET_ENCODING_PLAIN_DICTIONARY || encoding == PARQUET_ENCODING_RLE_DICTIONARY)
+        {
+            need(encoded, 0, 1);
+            int width = encoded.data[0];
+            if (!dict || width > 32)
+                fail(G_path, "bad dictionary encoded page");
+            uint32_t *indices = (uint32_t *)dump_alloc(present * sizeof(uint32_t));
+            decode_hybrid((Bytes){encoded.data + 1, encoded.len - 1}, width, indices, present);
+            for (size_t k = 0; k < present; ++k)
+            {
+                if (indices[k] >= dict_len)
+                    fail(G_path, "dictionary index out of range");
+                page_values[k] = dict[indices[k]];
+            }
+            free(indices);
+        }
+        else
+            fail(G_path, "unsupported data page encoding");
+
+        size_t v = 0;
+        for (size_t k = 0; k < n; ++k, ++row)
+        {
+            if (col->type == DUMP_TEXT)
+                offsets[row] = (int32_t)text_len;
+            if (col->optional && !levels[k])
+                continue;
+            Bytes value = page_values[v++];
+            if (!max.data || compare_plain(col->type, value, max) > 0)
+                max = value;
+            if (!min.data || compare_plain(col->type, value, min) < 0)
+                min = value;
+            validity[row / 8] |= (unsigned char)(1 << (row % 8));
+            if (col->type == DUMP_BOOL)
+                values[row / 8] |= (unsigned char)(value.data[0] << (row % 8));
+            else if (col->type != DUMP_TEXT)
+                memcpy(values + 8 * row, value.data, 8); // Little-endian in the file and here
+            else
+            {
+                if (value.len > (size_t)INT32_MAX - text_len)
+                    fail(G_path, "text of a row group too large to dump");
+                if (text_cap - text_len < value.len)
+                {
+                    text_cap = text_cap ? text_cap : 4096;
+                    while (text_cap - text_len < value.len)
+                        text_cap *= 2;
+                    text = (unsigned char *)realloc(text, text_cap);
+                    if (!text)
+                        fail(G_path, "out of memory");
+                }
+                memcpy(text + text_len, value.data, value.len);
+                text_len += value.len;
+            }
+        }
+        present_total += present;
+    }
+    if (offsets)
+        offsets[rows] = (int32_t)text_len;
+
+    if (ch->has_null_count && ch->null_count != (int64_t)(rows - present_total))
+        fail(G_path, "null count in the statistics does not match the values");
+    if (ch->has_min_max && present_total)
+    {
+        size_t fixed = col->type == DUMP_BOOL ? 1 : col->type == DUMP_TEXT ? 0 : 8;
+        if ((fixed && (ch->min.len != fixed || ch->max.len != fixed)) ||
+            compare_plain(col->type, ch->min, min) != 0 || compare_plain(col->type, ch->max, max) != 0)
+            fail(G_path, "min/max in the statistics do not match the values");
+    }
+    free(levels);
+    free(page_values);
+    free(dict);
+    col->validity = validity;
+    col->values = values;
+    col->offsets = offsets;
+    col->text = text ? text : G_bool_bytes; // Any non-NULL pointer for an all-empty column
+}
+
+static size_t dump_parquet_row_group(Bytes data, ThriftReader *t, DumpColumn *cols, int n)
+{
+    int last = 0, type, id, have_columns = 0;
+    int64_t rows = -1;
+    ParquetChunk *chunks = (ParquetChunk *)dump_alloc((size_t)n * sizeof(ParquetChunk));
+    while ((id = tr_field(t, &last, &type)))
+    {
+        if (id == 1 && type == THRIFT_LIST)
+        {
+            int elem_type;
+            if (tr_list(t, &elem_type) != (size_t)n || elem_type != THRIFT_STRUCT)
+                fail(G_path, "row group has a different number of columns than the schema");
+            for (int c = 0; c < n; ++c)
+                read_parquet_chunk(t, &chunks[c]);
+            have_columns = 1;
+        }
+        else if (id == 3)
+            rows = tr_int_field(t, type);
+        else
+            tr_skip(t, type, 0);
+    }
+    if (!have_columns || rows < 0)
+        fail(G_path, "bad row group");
+    for (int c = 0; c < n; ++c)
+        decode_parquet_chunk(data, &chunks[c], &cols[c], (size_t)rows);
+    print_rows(cols, n, (size_t)rows);
+    for (int c = 0; c < n; ++c)
+    {
+        free((void *)cols[c].validity);
+        free((void *)cols[c].values);
+        free((void *)cols[c].offsets);
+        if (cols[c].text != G_bool_bytes)
+            free((void *)cols[c].text);
+    }
+    free(chunks);
+    return (size_t)rows;
+}
+
+static void dump_parquet(Bytes file)
+{
+    size_t magic_len = strlen(PARQUET_MAGIC);
+    if (file.len < 2 * magic_len + 4 || memcmp(file.data, PARQUET_MAGIC, magic_len) != 0 ||
+        memcmp(file.data + file.len - magic_len, PARQUET_MAGIC, magic_len) != 0)
+        fail(G_path, "not a Parquet file");
+    size_t footer_len = read_le(file.data + file.len - magic_len - 4, 4);
+    if (footer_len > file.len - 2 * magic_len - 4)
+        fail(G_path, "footer out of bounds");
+    Bytes data = {file.data, file.len - magic_len - 4 - footer_len}; // The pages
+    ThriftReader t = {{data.data + data.len, footer_len}, 0};
+    DumpColumn *cols = NULL;
+    int n = -1, last = 0, type, id;
+    int64_t num_rows = -1;
+    size_t row_groups = 0, num_row_groups = 0;
+    while ((id = tr_field(&t, &last, &type)))
+    {
+        if (id == 2 && type == THRIFT_LIST && !cols)
+            n = read_parquet_schema(&t, &cols);
+        else if (id == 3)
+            num_rows = tr_int_field(&t, type);
+        else if (id == 4 && type == THRIFT_LIST)
+        { // Read once the schema is known
+            int elem_type;
+            num_row_groups = tr_list(&t, &elem_type);
+            row_groups = t.pos;
+            for (size_t g = 0; g < num_row_groups; ++g)
+                tr_skip(&t, elem_type, 0);
+        }
+        else
+            tr_skip(&t, type, 0);
+    }
+    if (!cols)
+        fail(G_path, "footer without a schema");
+    print_header(cols, n);
+    t.pos = row_groups;
+    int64_t rows = 0;
+    for (size_t g = 0; g < num_row_groups; ++g)
+        rows += (int64_t)dump_parquet_row_group(data, &t, cols, n);
+    if (rows != num_rows)
+        fail(G_path, "row count of the file differs from its row groups'");
+    for (int c = 0; c < n; ++c)
+        free(cols[c].name);
+    free(cols);
+}
+
+static Bytes read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    Bytes file = {NULL, 0};
+    size_t cap = 0;
+    unsigned char *data = NULL;
+    for (;;)
+    {
+        if (file.len == cap)
+        {
+            cap = cap ? cap * 2 : 1 << 16;
+            data = (unsigned char *)realloc(data, cap);
+            if (!data)
+                fail(path, "out of memory");
+        }
+        size_t got = fread(data + file.len, 1, cap - file.len, f);
+        if (got == 0)
+            break;
+        file.len += got;
+    }
+    fclose(f);
+    file.data = data;
+    return file;
+}
+
+// --- PostgreSQL binary COPY file ---
+
+// Columns of the CREATE TABLE json2relcsv writes to <name>.sql: one "name" type line each
+static int read_pgcopy_ddl(const char *ddl_path, DumpColumn **cols_out)
+{
+    Bytes ddl = read_file(ddl_path);
+    const char *s = (const char *)ddl.data;
+    size_t pos = 0, n = 0;
+    while (pos < ddl.len && s[pos] != '(')
+        pos++;
+    if (pos == ddl.len || strncmp(s, "CREATE TABLE ", 13) != 0)
+        fail(ddl_path, "no CREATE TABLE");
+    pos++;
+    DumpColumn *cols = (DumpColumn *)calloc(ddl.len, sizeof(DumpColumn)); // More than enough
+    if (!cols)
+        fail(ddl_path, "out of memory");
+    for (;;)
+    {
+        while (pos < ddl.len && (s[pos] == ' ' || s[pos] == '\n' || s[pos] == ','))
+            pos++;
+        if (pos < ddl.len && s[pos] == ')')
+            break;
+        if (pos == ddl.len || s[pos] != '"')
+            fail(ddl_path, "expected a quoted column name");
+        char *name = (char *)malloc(ddl.len);
+        if (!name)
+            fail(ddl_path, "out of memory");
+        size_t len = 0;
+        for (pos++;; pos++)
+        {
+            if (pos == ddl.len)
+                fail(ddl_path, "unterminated column name");
+            if (s[pos] == '"' && (pos + 1 == ddl.len || s[pos + 1] != '"'))
+                break;
+            name[len++] = s[pos];
+            pos += s[pos] == '"'; // A doubled quote
+        }
+        name[len] = '\0';
+        size_t type = ++pos;
+        while (pos < ddl.len && s[pos] != ',' && s[pos] != '\n')
+            pos++;
+        size_t type_len = pos - type;
+        const struct
+        {
+            const char *sql;
+            DumpType type;
+        } types[] = {{" bigint", DUMP_INT}, {" double precision", DUMP_FLOAT}, {" boolean", DUMP_BOOL}, {" text", DUMP_TEXT}};
+        size_t t;
+        for (t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+        {
+            if (strlen(types[t].sql) == type_len && strncmp(s + type, types[t].sql, type_len) == 0)
+                break;
+        }
+        if (t == sizeof(types) / sizeof(types[0]))
+            fail(ddl_path, "unsupported column type (only bigint, double precision, boolean and text are written)");
+        cols[n].name = name;
+        cols[n++].type = types[t].type;
+    }
+    free((void *)ddl.data);
+    *cols_out = cols;
+    return (int)n;
+}
+
+static uint64_t read_be(const unsigned char *p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i)
+        v = v << 8 | p[i];
+    return v;
+}
+
+static void dump_pgcopy(Bytes file, const char *ddl_path)
+{
+    DumpColumn *cols;
+    int n = read_pgcopy_ddl(ddl_path, &cols);
+    if (file.len < PGCOPY_SIGNATURE_LEN + 8 || memcmp(file.data, PGCOPY_SIGNATURE, PGCOPY_SIGNATURE_LEN) != 0)
+        fail(G_path, "not a PostgreSQL binary COPY file");
+    uint32_t flags = (uint32_t)read_be(file.data + PGCOPY_SIGNATURE_LEN, 4);
+    if (flags & 0xFFFF)
+        fail(G_path, "unknown critical flags in the header");
+    if (flags & 0x10000)
+        fail(G_path, "tuples with OIDs are not supported");
+    size_t extension_len = read_be(file.data + PGCOPY_SIGNATURE_LEN + 4, 4);
+    size_t pos = PGCOPY_SIGNATURE_LEN + 8;
+    need(file, pos, extension_len);
+    pos += extension_len;
+    print_header(cols, n);
+    for (;;)
+    {
+        need(file, pos, 2);
+        int16_t fields = (int16_t)read_be(file.data + pos, 2);
+        pos += 2;
+        if (fields == -1)
+            break;
+        if (fields != n)
+            fail(G_path, "tuple has a different number of fields than the table");
+        for (int c = 0; c < n; ++c)
+        {
+            need(file, pos, 4);
+            int32_t len = (int32_t)read_be(file.data + pos, 4);
+            pos += 4;
+            if (c)
+                putchar(',');
+            if (len == -1)
+                continue;
+            if (len < 0)
+                fail(G_path, "bad field length");
+            need(file, pos, (size_t)len);
+            const unsigned char *value = file.data + pos;
+            pos += (size_t)len;
+            uint64_t bits;
+            double d;
+            switch (cols[c].type)
+            {
+            case DUMP_INT:
+                if (len != 8)
+                    fail(G_path, "bigint field is not 8 bytes");
+                printf("%" PRId64, (int64_t)read_be(value, 8));
+                break;
+            case DUMP_FLOAT:
+                if (len != 8)
+                    fail(G_path, "double precision field is not 8 bytes");
+                bits = read_be(value, 8);
+                memcpy(&d, &bits, 8);
+                printf("%g", d);
+                break;
+            case DUMP_BOOL:
+                if (len != 1 || value[0] > 1)
+                    fail(G_path, "bad boolean field");
+                fputs(value[0] ? "true" : "false", stdout);
+                break;
+            case DUMP_TEXT:
+                print_field((const char *)value, (size_t)len);
+                break;
+            }
+        }
+        putchar('\n');
+    }
+    if (pos != file.len)
+        fail(G_path, "data after the trailer");
+    for (int c = 0; c < n; ++c)
+        free(cols[c].name);
+    free(cols);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <file.arrow|file.parquet|file.pgcopy>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    G_path = argv[1];
+    Bytes file = read_file(G_path);
+    size_t path_len = strlen(G_path);
+    if (file.len >= 4 && memcmp(file.data, PARQUET_MAGIC, 4) == 0)
+        dump_parquet(file);
+    else if (file.len >= PGCOPY_SIGNATURE_LEN && memcmp(file.data, PGCOPY_SIGNATURE, PGCOPY_SIGNATURE_LEN) == 0)
+    { // The types are in the .sql written next to it
+        if (path_len < 7 || strcmp(G_path + path_len - 7, ".pgcopy") != 0)
+            fail(G_path, "expected a .pgcopy file with its .sql next to it");
+        char *ddl_path = (char *)malloc(path_len);
+        if (!ddl_path)
+            fail(G_path, "out of memory");
+        memcpy(ddl_path, G_path, path_len - 7);
+        memcpy(ddl_path + path_len - 7, ".sql", 5);
+        dump_pgcopy(file, ddl_path);
+        free(ddl_path);
+    }
+    else
+        dump_arrow(file);
+    free((void *)file.data);
+    return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,429 @@
+// tape.c
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h> // For munmap (cached tapes)
+
+#include "tape.h"
+#include "json_source.h"
+
+#define TAPE_WORD(tag, payload) (((uint64_t)(tag) << 56) | ((uint64_t)(payload) & 0x00FFFFFFFFFFFFFFULL))
+
+static void *safe_tape_realloc(void *ptr, size_t size)
+{
+    void *grown = realloc(ptr, size);
+    if (!grown)
+    {
+        perror("Error: tape realloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+void tape_init(JsonTape *tape)
+{
+    memset(tape, 0, sizeof(*tape));
+}
+
+void tape_free(JsonTape *tape)
+{
+    if (!tape)
+        return;
+    if (tape->map_base)
+    {
+        munmap(tape->map_base, tape->map_len);
+    }
+    else
+    {
+        free(tape->words);
+        free(tape->strings);
+    }
+    memset(tape, 0, sizeof(*tape));
+}
+
+static size_t tape_push(JsonTape *tape, uint64_t word)
+{
+    if (tape->num_words == tape->words_cap)
+    {
+        tape->words_cap = tape->words_cap ? tape->words_cap * 2 : 1024;
+        tape->words = (uint64_t *)safe_tape_realloc(tape->words, tape->words_cap * sizeof(uint64_t));
+    }
+    tape->words[tape->num_words] = word;
+    return tape->num_words++;
+}
+
+// Reserves room for a string of up to max_len bytes and returns where its bytes go.
+static char *tape_string_reserve(JsonTape *tape, size_t max_len)
+{
+    size_t need = tape->strings_len + sizeof(uint32_t) + max_len + 1;
+    if (need > tape->strings_cap)
+    {
+        size_t cap = tape->strings_cap ? tape->strings_cap : 4096;
+        while (cap < need)
+            cap *= 2;
+        tape->strings = (char *)safe_tape_realloc(tape->strings, cap);
+        tape->strings_cap = cap;
+    }
+    return tape->strings + tape->strings_len + sizeof(uint32_t);
+}
+
+// Finishes the string reserved above and appends its TAPE_STRING word.
+static void tape_string_commit(JsonTape *tape, uint32_t len)
+{
+    size_t offset = tape->strings_len;
+    memcpy(tape->strings + offset, &len, sizeof(len));
+    tape->strings[offset + sizeof(uint32_t) + len] = '\0';
+    tape->strings_len += sizeof(uint32_t) + len + 1;
+    tape_push(tape, TAPE_WORD(TAPE_STRING, offset));
+}
+
+static void tape_push_string(JsonTape *tape, const char *s)
+{
+    size_t len = strlen(s);
+    char *dst = tape_string_reserve(tape, len);
+    memcpy(dst, s, len);
+    tape_string_commit(tape, (uint32_t)len);
+}
+
+static void tape_push_number(JsonTape *tape, double d)
+{
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    tape_push(tape, TAPE_WORD(TAPE_NUMBER, 0));
+    tape_push(tape, bits);
+}
+
+// Patches a start word once its end word has been written.
+static void tape_close_container(JsonTape *tape, size_t start, TapeTag end_tag, uint64_t count)
+{
+    size_t end = tape_push(tape, TAPE_WORD(end_tag, start));
+    if (count > TAPE_COUNT_SATURATED)
+        count = TAPE_COUNT_SATURATED;
+    TapeTag start_tag = tape_tag(tape, start);
+    tape->words[start] = TAPE_WORD(start_tag, (count << 32) | (uint64_t)(end + 1));
+}
+
+// --- Builder from the pointer AST ---
+
+// Containers still open while copying the AST (explicit stack, no recursion)
+typedef struct AstTapeFrame
+{
+    const JsonValue *container;
+    const PairNode *member;
+    const ValueNode *element;
+    size_t start;
+} AstTapeFrame;
+
+static void tape_push_scalar(JsonTape *tape, const JsonValue *v)
+{
+    switch (v->type)
+    {
+    case JSON_NULL_TYPE:
+        tape_push(tape, TAPE_WORD(TAPE_NULL, 0));
+        break;
+    case JSON_BOOLEAN_TYPE:
+        tape_push(tape, TAPE_WORD(v->data.bool_val ? TAPE_TRUE : TAPE_FALSE, 0));
+        break;
+    case JSON_NUMBER_TYPE:
+        tape_push_number(tape, v->data.num_val);
+        break;
+    case JSON_STRING_TYPE:
+    {
+        const char *s = ast_string_value(v);
+        tape_push_string(tape, s ? s : "");
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+int tape_from_ast(JsonTape *tape, const JsonValue *root)
+{
+    if (!root)
+        return -1;
+
+    size_t depth = 0, cap = 64;
+    AstTapeFrame *stack = (AstTapeFrame *)safe_tape_realloc(NULL, cap * sizeof(AstTapeFrame));
+    const JsonValue *next = root; // Value to emit next (NULL when resuming the top frame)
+
+    for (;;)
+    {
+        if (next)
+        {
+            if (next->type == JSON_OBJECT_TYPE || next->type == JSON_ARRAY_TYPE)
+            {
+                if (depth == cap)
+                {
+                    cap *= 2;
+                    stack = (AstTapeFrame *)safe_tape_realloc(stack, cap * sizeof(AstTapeFrame));
+                }
+                AstTapeFrame *f = &stack[depth++];
+                f->container = next;
+                f->member = next->type == JSON_OBJECT_TYPE ? next->data.object_val.head : NULL;
+                f->element = next->type == JSON_ARRAY_TYPE ? next->data.array_val.head : NULL;
+                f->start = tape_push(tape, TAPE_WORD(next->type == JSON_OBJECT_TYPE ? TAPE_START_OBJECT : TAPE_START_ARRAY, 0));
+            }
+            else
+            {
+                tape_push_scalar(tape, next);
+            }
+            next = NULL;
+        }
+        if (depth == 0)
+            break;
+
+        AstTapeFrame *top = &stack[depth - 1];
+        if (top->container->type == JSON_OBJECT_TYPE && top->member)
+        {
+            tape_push_string(tape, top->member->data.key);
+            next = top->member->data.value;
+            top->member = top->member->next;
+        }
+        else if (top->container->type == JSON_ARRAY_TYPE && top->element)
+        {
+            next = top->element->value;
+            top->element = top->element->next;
+        }
+        else
+        {
+            int is_object = top->container->type == JSON_OBJECT_TYPE;
+            uint64_t count = is_object ? (uint64_t)top->container->data.object_val.num_members
+                                       : (uint64_t)top->container->data.array_val.num_elements;
+            tape_close_container(tape, top->start, is_object ? TAPE_END_OBJECT : TAPE_END_ARRAY, count);
+            depth--;
+        }
+    }
+    free(stack);
+    return 0;
+}
+
+// --- Builder fed directly by the structural index (no AST nodes at all) ---
+
+typedef struct IndexTapeBuilder
+{
+    JsonTape *tape;
+    size_t *starts;   // Start word of each open container
+    uint64_t *counts; // Values seen so far in each open container
+    size_t depth, cap;
+} IndexTapeBuilder;
+
+static void index_builder_count_value(IndexTapeBuilder *b)
+{
+    if (b->depth > 0)
+        b->counts[b->depth - 1]++;
+}
+
+static int index_tape_event(void *ctx, const JsonEvent *ev)
+{
+    IndexTapeBuilder *b = (IndexTapeBuilder *)ctx;
+    JsonTape *tape = b->tape;
+    switch (ev->type)
+    {
+    case JSON_EVENT_NULL:
+        index_builder_count_value(b);
+        tape_push(tape, TAPE_WORD(TAPE_NULL, 0));
+        break;
+    case JSON_EVENT_TRUE:
+    case JSON_EVENT_FALSE:
+        index_builder_count_value(b);
+        tape_push(tape, TAPE_WORD(ev->type == JSON_EVENT_TRUE ? TAPE_TRUE : TAPE_FALSE, 0));
+        break;
+    case JSON_EVENT_NUMBER:
+        index_builder_count_value(b);
+        tape_push_number(tape, json_lexeme_to_double(ev->text, ev->len));
+        break;
+    case JSON_EVENT_STRING:
+    case JSON_EVENT_KEY:
+    {
+        if (ev->type == JSON_EVENT_STRING)
+            index_builder_count_value(b);
+        // Unescape straight into the string buffer; the result is never longer than the lexeme
+        char *dst = tape_string_reserve(tape, ev->len);
+        int len = unescape_json_string_into(dst, ev->text, (int)ev->len);
+        tape_string_commit(tape, (uint32_t)len);
+        break;
+    }
+    case JSON_EVENT_BEGIN_OBJECT:
+    case JSON_EVENT_BEGIN_ARRAY:
+        index_builder_count_value(b);
+        if (b->depth == b->cap)
+        {
+            b->cap = b->cap ? b->cap * 2 : 64;
+            b->starts = (size_t *)safe_tape_realloc(b->starts, b->cap * sizeof(size_t));
+            b->counts = (uint64_t *)safe_tape_realloc(b->counts, b->cap * sizeof(uint64_t));
+        }
+        b->starts[b->depth] = tape_push(tape, TAPE_WORD(ev->type == JSON_EVENT_BEGIN_OBJECT ? TAPE_START_OBJECT : TAPE_START_ARRAY, 0));
+        b->counts[b->depth] = 0;
+        b->depth++;
+        break;
+    case JSON_EVENT_END_OBJECT:
+    case JSON_EVENT_END_ARRAY:
+        b->depth--;
+        tape_close_container(tape, b->starts[b->depth], ev->type == JSON_EVENT_END_OBJECT ? TAPE_END_OBJECT : TAPE_END_ARRAY,
+                             b->counts[b->depth]);
+        break;
+    case JSON_EVENT_SKIPPED: // Never requested by this builder
+        break;
+    }
+    return 0;
+}
+
+int tape_from_index(JsonTape *tape, const JsonIndex *idx)
+{
+    IndexTapeBuilder b;
+    memset(&b, 0, sizeof(b));
+    b.tape = tape;
+    int rc = json_index_walk(idx, index_tape_event, &b);
+    free(b.starts);
+    free(b.counts);
+    return rc;
+}
+
+// --- Traversal ---
+
+JsonValueType tape_value_type(const JsonTape *tape, size_t pos)
+{
+    switch (tape_tag(tape, pos))
+    {
+    case TAPE_TRUE:
+    case TAPE_FALSE:
+        return JSON_BOOLEAN_TYPE;
+    case TAPE_NUMBER:
+        return JSON_NUMBER_TYPE;
+    case TAPE_STRING:
+        return JSON_STRING_TYPE;
+    case TAPE_START_OBJECT:
+        return JSON_OBJECT_TYPE;
+    case TAPE_START_ARRAY:
+        return JSON_ARRAY_TYPE;
+    default:
+        return JSON_NULL_TYPE;
+    }
+}
+
+int tape_count(const JsonTape *tape, size_t pos)
+{
+    uint64_t count = tape_payload(tape, pos) >> 32;
+    if (count < TAPE_COUNT_SATURATED)
+        return (int)count;
+
+    // Saturated: walk the children
+    int is_object = tape_tag(tape, pos) == TAPE_START_OBJECT;
+    size_t end = tape_container_end(tape, pos);
+    int n = 0;
+    for (size_t p = pos + 1; p < end; p = tape_next(tape, p))
+    {
+        if (is_object)
+            p = tape_next(tape, p); // Skip the key
+        n++;
+    }
+    return n;
+}
+
+static void print_indent(int level)
+{
+    for (int i = 0; i < level; ++i)
+        printf("  ");
+}
+
+// Open container while printing
+typedef struct TapePrintFrame
+{
+    size_t end; // Index of its end word
+    int index;  // Next element index (arrays)
+    int is_object;
+    int indent_level;
+} TapePrintFrame;
+
+// Prints the line of the value at pos. Returns 1 if it is a non-empty container.
+static int tape_print_line(const JsonTape *tape, size_t pos, int indent_level)
+{
+    print_indent(indent_level);
+    switch (tape_tag(tape, pos))
+    {
+    case TAPE_NULL:
+        printf("NULL\n");
+        break;
+    case TAPE_TRUE:
+    case TAPE_FALSE:
+        printf("BOOLEAN: %s\n", tape_bool(tape, pos) ? "true" : "false");
+        break;
+    case TAPE_NUMBER:
+        printf("NUMBER: %g\n", tape_number(tape, pos));
+        break;
+    case TAPE_STRING:
+        printf("STRING: \"%s\"\n", tape_string(tape, pos));
+        break;
+    case TAPE_START_ARRAY:
+    case TAPE_START_OBJECT:
+    {
+        int count = tape_count(tape, pos);
+        if (tape_tag(tape, pos) == TAPE_START_ARRAY)
+            printf("ARRAY (%d elements):\n", count);
+        else
+            printf("OBJECT (%d members):\n", count);
+        if (count > 0)
+            return 1;
+        print_indent(indent_level + 1);
+        printf("(empty)\n");
+        break;
+    }
+    default:
+        printf("Unknown Type\n");
+    }
+    return 0;
+}
+
+void tape_print_value(const JsonTape *tape, size_t pos, int indent_level)
+{
+    // The tape is already in document order, so printing is one forward scan; the stack only
+    // remembers where each open container ends and how to label its children
+    size_t depth = 0, cap = 64;
+    TapePrintFrame *stack = (TapePrintFrame *)safe_tape_realloc(NULL, cap * sizeof(TapePrintFrame));
+    size_t p = pos;
+    int indent = indent_level;
+    for (;;)
+    {
+        if (tape_print_line(tape, p, indent))
+        {
+            if (depth == cap)
+            {
+                cap *= 2;
+                stack = (TapePrintFrame *)safe_tape_realloc(stack, cap * sizeof(TapePrintFrame));
+            }
+            TapePrintFrame *f = &stack[depth++];
+            f->end = tape_container_end(tape, p);
+            f->index = 0;
+            f->is_object = tape_tag(tape, p) == TAPE_START_OBJECT;
+            f->indent_level = indent;
+            p++;
+        }
+        else
+        {
+            p = tape_next(tape, p);
+        }
+        while (depth > 0 && p >= stack[depth - 1].end)
+        {
+            p = stack[depth - 1].end + 1;
+            depth--;
+        }
+        if (depth == 0)
+            break;
+
+        TapePrintFrame *top = &stack[depth - 1];
+        print_indent(top->indent_level + 1);
+        if (top->is_object)
+        {
+            printf("\"%s\":\n", tape_string(tape, p));
+            p++;
+        }
+        else
+        {
+            printf("[%d]:\n", top->index++);
+        }
+        indent = top->indent_level + 2;
+    }
+    free(stack);
+}
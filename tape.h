@@ -0,0 +1,120 @@
+// tape.h
+#ifndef TAPE_H
+#define TAPE_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For uint64_t
+#include <string.h> // For memcpy in the inline accessors
+
+#include "ast.h"
+#include "json_index.h"
+
+// Flat "tape" form of a parsed document: one contiguous array of 64-bit words in document order.
+//
+// Each word holds a type tag in the top 8 bits and a 56-bit payload:
+//   TAPE_NULL / TAPE_TRUE / TAPE_FALSE   no payload
+//   TAPE_NUMBER                          the next word holds the raw bits of the double
+//   TAPE_STRING                          byte offset of the string in the string buffer
+//   TAPE_START_OBJECT / TAPE_START_ARRAY low 32 bits: index just past the matching end word
+//                                        (the skip offset), upper 24 bits: member/element count
+//   TAPE_END_OBJECT / TAPE_END_ARRAY     index of the matching start word
+// Object members are laid out as a TAPE_STRING key word followed by the value.
+// The string buffer stores each string as a uint32_t length, the bytes, and a terminating NUL.
+// The root value starts at word 0.
+
+typedef enum
+{
+    TAPE_NULL = 'n',
+    TAPE_TRUE = 't',
+    TAPE_FALSE = 'f',
+    TAPE_NUMBER = 'd',
+    TAPE_STRING = '"',
+    TAPE_START_OBJECT = '{',
+    TAPE_END_OBJECT = '}',
+    TAPE_START_ARRAY = '[',
+    TAPE_END_ARRAY = ']'
+} TapeTag;
+
+#define TAPE_COUNT_SATURATED 0xFFFFFFu // Container counts at or above this are recounted on demand
+
+typedef struct JsonTape
+{
+    uint64_t *words;
+    size_t num_words, words_cap;
+    char *strings;
+    size_t strings_len, strings_cap;
+    void *map_base; // Read-only mapping words/strings point into (tape_cache.h), or NULL if they are malloc'd
+    size_t map_len;
+} JsonTape;
+
+void tape_init(JsonTape *tape);
+void tape_free(JsonTape *tape);
+
+// Builders. Both return 0 on success; tape_from_index reports parse errors and returns -1.
+int tape_from_ast(JsonTape *tape, const JsonValue *root);
+int tape_from_index(JsonTape *tape, const JsonIndex *idx);
+
+// --- Traversal API ---
+static inline TapeTag tape_tag(const JsonTape *tape, size_t pos)
+{
+    return (TapeTag)(tape->words[pos] >> 56);
+}
+
+static inline uint64_t tape_payload(const JsonTape *tape, size_t pos)
+{
+    return tape->words[pos] & 0x00FFFFFFFFFFFFFFULL;
+}
+
+// Index of the value that follows the one at pos (skips whole containers in O(1)).
+static inline size_t tape_next(const JsonTape *tape, size_t pos)
+{
+    switch (tape_tag(tape, pos))
+    {
+    case TAPE_START_OBJECT:
+    case TAPE_START_ARRAY:
+        return (size_t)(tape_payload(tape, pos) & 0xFFFFFFFFu);
+    case TAPE_NUMBER:
+        return pos + 2;
+    default:
+        return pos + 1;
+    }
+}
+
+// AST type of the value at pos
+JsonValueType tape_value_type(const JsonTape *tape, size_t pos);
+// Number of members/elements of the container at pos
+int tape_count(const JsonTape *tape, size_t pos);
+// Index of the matching end word of the container at pos
+static inline size_t tape_container_end(const JsonTape *tape, size_t pos)
+{
+    return tape_next(tape, pos) - 1;
+}
+
+static inline const char *tape_string(const JsonTape *tape, size_t pos)
+{
+    return tape->strings + tape_payload(tape, pos) + sizeof(uint32_t);
+}
+
+static inline uint32_t tape_string_length(const JsonTape *tape, size_t pos)
+{
+    uint32_t len;
+    memcpy(&len, tape->strings + tape_payload(tape, pos), sizeof(len));
+    return len;
+}
+
+static inline double tape_number(const JsonTape *tape, size_t pos)
+{
+    double d;
+    memcpy(&d, &tape->words[pos + 1], sizeof(d));
+    return d;
+}
+
+static inline int tape_bool(const JsonTape *tape, size_t pos)
+{
+    return tape_tag(tape, pos) == TAPE_TRUE;
+}
+
+// Same output format as ast_print_value
+void tape_print_value(const JsonTape *tape, size_t pos, int indent_level);
+
+#endif // TAPE_H
@@ -0,0 +1,229 @@
+// tape_cache.c
+#define _XOPEN_SOURCE 700 // For realpath
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>    // For open
+#include <unistd.h>   // For read, write, close
+#include <sys/mman.h> // For mmap
+#include <sys/stat.h> // For stat, mkdir
+
+#include "tape_cache.h"
+#include "json_source.h"
+
+#define TAPE_CACHE_BYTE_ORDER 0x0102030405060708ULL // Reads back differently on another endianness
+
+typedef struct TapeCacheHeader
+{
+    char magic[8];         // TAPE_CACHE_MAGIC
+    uint64_t byte_order;   // TAPE_CACHE_BYTE_ORDER
+    uint64_t input_size;
+    int64_t input_mtime_sec;
+    int64_t input_mtime_nsec;
+    uint64_t content_hash;
+    uint64_t num_words;
+    uint64_t strings_len;
+    uint64_t path_len; // Bytes of the real path right after the header
+} TapeCacheHeader;
+
+static void *safe_cache_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (!ptr)
+    {
+        perror("Error: tape cache malloc failed");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Offset of the tape words: header and path, padded to a word boundary
+static size_t words_offset(size_t path_len)
+{
+    return (sizeof(TapeCacheHeader) + path_len + 7) & ~(size_t)7;
+}
+
+// 64-bit hash of the input bytes, eight bytes per step
+static uint64_t hash_bytes(const char *data, size_t len)
+{
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, len - i);
+    h = (h ^ tail) * 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+// FNV-1a, used to name the cache file after the input path
+static uint64_t hash_string(const char *s)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; ++s)
+    {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+int tape_cache_key(TapeCacheKey *key, const char *cache_dir, const char *input_path)
+{
+    memset(key, 0, sizeof(*key));
+    struct stat st;
+    if (stat(input_path, &st) != 0)
+        return -1;
+    key->real_path = realpath(input_path, NULL);
+    if (!key->real_path)
+        return -1;
+
+    JsonSource src;
+    if (json_source_open(&src, input_path) != 0)
+    {
+        tape_cache_key_free(key);
+        return -1;
+    }
+    key->content_hash = hash_bytes(src.data, src.len);
+    json_source_close(&src);
+
+    key->size = (uint64_t)st.st_size;
+    key->mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    key->mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+
+    size_t entry_len = strlen(cache_dir) + 32;
+    key->entry_path = (char *)safe_cache_malloc(entry_len);
+    snprintf(key->entry_path, entry_len, "%s/%016llx.tape", cache_dir, (unsigned long long)hash_string(key->real_path));
+    return 0;
+}
+
+void tape_cache_key_free(TapeCacheKey *key)
+{
+    free(key->entry_path);
+    free(key->real_path);
+    memset(key, 0, sizeof(*key));
+}
+
+int tape_cache_load(JsonTape *tape, const TapeCacheKey *key)
+{
+    int fd = open(key->entry_path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    TapeCacheHeader h;
+    struct stat st;
+    size_t path_len = strlen(key->real_path);
+    if (read(fd, &h, sizeof(h)) != (ssize_t)sizeof(h) || fstat(fd, &st) != 0 ||
+        memcmp(h.magic, TAPE_CACHE_MAGIC, sizeof(h.magic)) != 0 || h.byte_order != TAPE_CACHE_BYTE_ORDER ||
+        h.input_size != key->size || h.input_mtime_sec != key->mtime_sec || h.input_mtime_nsec != key->mtime_nsec ||
+        h.content_hash != key->content_hash || h.path_len != path_len ||
+        h.num_words == 0 || h.num_words > ((uint64_t)st.st_size - words_offset(path_len)) / sizeof(uint64_t) ||
+        (uint64_t)st.st_size != words_offset(path_len) + h.num_words * sizeof(uint64_t) + h.strings_len)
+    {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    if (memcmp((const char *)map + sizeof(h), key->real_path, path_len) != 0)
+    {
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    tape_free(tape);
+    tape->map_base = map;
+    tape->map_len = (size_t)st.st_size;
+    tape->words = (uint64_t *)((char *)map + words_offset(path_len));
+    tape->num_words = tape->words_cap = (size_t)h.num_words;
+    tape->strings = (char *)(tape->words + h.num_words);
+    tape->strings_len = tape->strings_cap = (size_t)h.strings_len;
+    return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *)buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int tape_cache_store(const JsonTape *tape, const TapeCacheKey *key)
+{
+    // The cache directory is the entry path up to its last '/'
+    const char *slash = strrchr(key->entry_path, '/');
+    size_t dir_len = (size_t)(slash - key->entry_path);
+    char *dir = (char *)safe_cache_malloc(dir_len + 1);
+    memcpy(dir, key->entry_path, dir_len);
+    dir[dir_len] = '\0';
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Warning: Could not create cache directory %s: %s\n", dir, strerror(errno));
+        free(dir);
+        return -1;
+    }
+    free(dir);
+
+    size_t tmp_len = strlen(key->entry_path) + 32;
+    char *tmp_path = (char *)safe_cache_malloc(tmp_len);
+    snprintf(tmp_path, tmp_len, "%s.%ld.tmp", key->entry_path, (long)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Warning: Could not write cache file %s: %s\n", tmp_path, strerror(errno));
+        free(tmp_path);
+        return -1;
+    }
+
+    TapeCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TAPE_CACHE_MAGIC, sizeof(h.magic));
+    h.byte_order = TAPE_CACHE_BYTE_ORDER;
+    h.input_size = key->size;
+    h.input_mtime_sec = key->mtime_sec;
+    h.input_mtime_nsec = key->mtime_nsec;
+    h.content_hash = key->content_hash;
+    h.num_words = tape->num_words;
+    h.strings_len = tape->strings_len;
+    h.path_len = strlen(key->real_path);
+    static const char padding[8] = {0};
+    size_t pad = words_offset(h.path_len) - sizeof(h) - h.path_len;
+
+    int rc = 0;
+    if (write_all(fd, &h, sizeof(h)) != 0 || write_all(fd, key->real_path, h.path_len) != 0 ||
+        write_all(fd, padding, pad) != 0 || write_all(fd, tape->words, tape->num_words * sizeof(uint64_t)) != 0 ||
+        write_all(fd, tape->strings, tape->strings_len) != 0)
+        rc = -1;
+    if (close(fd) != 0)
+        rc = -1;
+    if (rc == 0 && rename(tmp_path, key->entry_path) != 0)
+        rc = -1;
+    if (rc != 0)
+    {
+        fprintf(stderr, "Warning: Could not write cache file %s: %s\n", key->entry_path, strerror(errno));
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    return rc;
+}
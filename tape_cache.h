@@ -0,0 +1,40 @@
+// tape_cache.h
+#ifndef TAPE_CACHE_H
+#define TAPE_CACHE_H
+
+#include <stdint.h> // For uint64_t
+
+#include "tape.h"
+
+// Persistent cache of parsed documents (--cache-dir).
+//
+// A parsed tape is saved as one file per input, named after a hash of the input's real path:
+// a fixed header, the real path, the tape words, then the string buffer. The header records the
+// input's size, mtime and a hash of its bytes; a later run whose input matches all of them maps
+// the file read-only and converts from it without lexing or parsing anything. Cache files are
+// only valid on machines with the same endianness and word size (checked through the header).
+
+#define TAPE_CACHE_MAGIC "J2RTAPE1"
+
+// Identity of one input, taken before it is parsed
+typedef struct TapeCacheKey
+{
+    char *entry_path; // Cache file for this input
+    char *real_path;  // Canonical input path (stored in the entry to rule out name-hash collisions)
+    uint64_t size;
+    int64_t mtime_sec, mtime_nsec;
+    uint64_t content_hash;
+} TapeCacheKey;
+
+// Stats and hashes input_path. Returns 0, or -1 if it cannot be read (errno is set).
+int tape_cache_key(TapeCacheKey *key, const char *cache_dir, const char *input_path);
+void tape_cache_key_free(TapeCacheKey *key);
+
+// Loads the cached tape for key into *tape (mapped, released by tape_free).
+// Returns 0 on a hit, -1 if there is no valid, up-to-date entry.
+int tape_cache_load(JsonTape *tape, const TapeCacheKey *key);
+// Saves tape as the entry for key, creating the cache directory if needed. The file is written
+// under a temporary name and renamed into place. Returns 0, or -1 with a warning on stderr.
+int tape_cache_store(const JsonTape *tape, const TapeCacheKey *key);
+
+#endif // TAPE_CACHE_H